@@ -0,0 +1,421 @@
+#!/usr/bin/env python3
+
+"""Time reading, writing and validation of synthetic mmCIF and BinaryCIF
+   files, using both the C-accelerated parser (if built) and the pure
+   Python fallback.
+
+   Input files are generated from scratch (no network access is needed),
+   with a configurable number of atoms and models, plus metadata tables,
+   multiline text and save frames. Each benchmark runs in a fresh Python
+   process, so that its peak memory use (RSS) can be measured.
+
+   Results are written as JSON. Use --compare to check against results
+   from an earlier run, e.g.::
+
+       python3 benchmark/benchmark.py --output before.json
+       (make changes)
+       python3 benchmark/benchmark.py --compare before.json
+
+   A nonzero exit code is returned if any benchmark is significantly
+   slower, or uses significantly more memory, than before.
+"""
+
+import argparse
+import json
+import os
+import platform
+import random
+import subprocess
+import sys
+import tempfile
+import time
+
+TOPDIR = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+
+# Names of all benchmarks, with the parsers (C or Python) they can use
+BENCHMARKS = [('tokenize', ('C',)),
+              ('cif_reader', ('C', 'Python')),
+              ('bcif_reader', ('C', 'Python')),
+              ('read_cif', ('C', 'Python')),
+              ('read_bcif', ('C', 'Python')),
+              ('write_cif', ('C', 'Python')),
+              ('write_bcif', ('C', 'Python')),
+              ('validate', ('C', 'Python'))]
+
+
+def _import_ihm(parser):
+    """Import ihm, optionally hiding the C extension"""
+    if parser == 'Python':
+        # Make "from . import _format" fail, so the Python fallback is used
+        sys.modules['ihm._format'] = None
+    sys.path.insert(0, TOPDIR)
+    import ihm
+    return ihm
+
+
+def make_system(ihm, atoms, models, metadata_rows, text_lines):
+    """Make a System containing the given number of atoms, split between
+       models, plus some metadata"""
+    import ihm.model
+    import ihm.protocol
+    import ihm.representation
+    random.seed(42)
+    s = ihm.System(title='Benchmark system')
+    text = "\n".join("Line %d of a long description" % i
+                     for i in range(text_lines))
+    for i in range(metadata_rows):
+        s.citations.append(ihm.Citation(
+            pmid=str(i), title='Citation %d\n%s' % (i, text),
+            journal='J Benchmark', volume=i, page_range=(i, i + 10),
+            year=2000 + i % 20, authors=['Smith A', 'Jones B'],
+            doi='10.1000/%d' % i))
+        s.software.append(ihm.Software(
+            name='program%d' % i, classification='benchmark',
+            description='Program %d' % i, location='https://example.com/',
+            version='1.%d' % i))
+    e = ihm.Entity('ACGT' * 250, description='Benchmark entity')
+    s.entities.append(e)
+    atoms_per_model = max(atoms // models, 1)
+    # Put up to 5000 atoms (5 atoms for each of 1000 residues) in each chain
+    asyms = [ihm.AsymUnit(e, details='Chain %d' % i)
+             for i in range((atoms_per_model - 1) // 5000 + 1)]
+    s.asym_units.extend(asyms)
+    assembly = ihm.Assembly(asyms, name='All chains')
+    rep = ihm.representation.Representation(
+        [ihm.representation.AtomicSegment(a, rigid=False) for a in asyms])
+    protocol = ihm.protocol.Protocol(name='Benchmark protocol')
+    names = ['N', 'CA', 'C', 'O', 'CB']
+    mlist = []
+    for i in range(models):
+        m = ihm.model.Model(assembly=assembly, protocol=protocol,
+                            representation=rep, name='Model %d' % i)
+        for j in range(atoms_per_model):
+            m.add_atom(ihm.model.Atom(
+                asym_unit=asyms[j // 5000], seq_id=(j // 5) % 1000 + 1,
+                atom_id=names[j % 5], type_symbol=names[j % 5][0],
+                x=random.uniform(-100., 100.), y=random.uniform(-100., 100.),
+                z=random.uniform(-100., 100.), het=False,
+                biso=round(random.random(), 2)))
+        mlist.append(m)
+    s.state_groups.append(ihm.model.StateGroup(
+        [ihm.model.State([ihm.model.ModelGroup(mlist)])]))
+    return s
+
+
+def make_save_frames(num):
+    """Get mmCIF text for the given number of save frames"""
+    return "".join("save_frame%d\n_benchmark_frame.id %d\n"
+                   "_benchmark_frame.text\n;Frame %d\ntext\n;\nsave_\n"
+                   % (i, i, i) for i in range(num))
+
+
+def make_inputs(args, tmpdir):
+    """Write the synthetic input files, and return information about them"""
+    ihm = _import_ihm('C')
+    import ihm.dumper
+    s = make_system(ihm, args.atoms, args.models, args.metadata_rows,
+                    args.text_lines)
+    cif = os.path.join(tmpdir, 'input.cif')
+    with open(cif, 'w') as fh:
+        ihm.dumper.write(fh, [s])
+        fh.write(make_save_frames(args.save_frames))
+    with open(os.path.join(tmpdir, 'input.bcif'), 'wb') as fh:
+        ihm.dumper.write(fh, [s], format='BCIF')
+    with open(os.path.join(tmpdir, 'system.json'), 'w') as fh:
+        json.dump(vars(args), fh)
+    return {'cif_bytes': os.path.getsize(cif),
+            'bcif_bytes': os.path.getsize(os.path.join(tmpdir, 'input.bcif'))}
+
+
+class _CountHandler:
+    """Category handler that counts _atom_site rows"""
+    not_in_file = omitted = unknown = None
+
+    def __init__(self):
+        self.count = 0
+
+    def __call__(self, id, label_atom_id, cartn_x, cartn_y, cartn_z):
+        self.count += 1
+
+    def end_save_frame(self):
+        pass
+
+
+def make_dictionary(ihm, fname):
+    """Make a Dictionary covering every keyword in the given mmCIF file.
+       Atom coordinates and IDs are checked against numeric types, and all
+       other keywords against a generic text type."""
+    import re
+    import ihm.dictionary
+    any_type = ihm.dictionary.ItemType('text', 'char', r'[\s\S]*')
+    float_type = ihm.dictionary.ItemType(
+        'float', 'numb', r'-?(([0-9]+)[.]?|([0-9]*[.][0-9]+))([(][0-9]+[)])?'
+                         r'([eE][+-]?[0-9]+)?')
+    types = {'float': float_type,
+             'int': ihm.dictionary.ItemType('int', 'numb', '[+-]?[0-9]+')}
+    typed = {'cartn_x': 'float', 'cartn_y': 'float', 'cartn_z': 'float',
+             'b_iso_or_equiv': 'float', 'id': 'int',
+             'label_seq_id': 'int', 'auth_seq_id': 'int'}
+    d = ihm.dictionary.Dictionary()
+    with open(fname) as fh:
+        for m in re.finditer(r'^_(\w+)\.(\S+)', fh.read(), re.MULTILINE):
+            cat, kw = m.group(1), m.group(2).lower()
+            if cat not in d.categories:
+                c = d.categories[cat] = ihm.dictionary.Category()
+                c.name, c.mandatory = cat, False
+            k = ihm.dictionary.Keyword()
+            k.name, k.mandatory = kw, False
+            k.item_type = types.get(typed.get(kw)) if cat == 'atom_site' \
+                else any_type
+            d.categories[cat].keywords[kw] = k
+    return d
+
+
+def run_benchmark(name, parser, tmpdir, repeat):
+    """Run a single benchmark in this process and return its results"""
+    ihm = _import_ihm(parser)
+    import ihm.format
+    import ihm.format_bcif
+    import ihm.reader
+    import ihm.dumper
+    cif = os.path.join(tmpdir, 'input.cif')
+    bcif = os.path.join(tmpdir, 'input.bcif')
+    with open(os.path.join(tmpdir, 'system.json')) as fh:
+        params = json.load(fh)
+    atoms = params['atoms'] // params['models'] * params['models']
+    # Arguments for the benchmark function, prepared before timing starts
+    args = ()
+
+    if name == 'tokenize':
+        from ihm import _format
+
+        def func():
+            # Raw C tokenizer speed, with no handlers
+            with open(cif, 'rb') as fh:
+                c_file = _format.ihm_file_new_from_python(fh, False)
+                reader = _format.ihm_reader_new(c_file, False)
+                try:
+                    while _format.ihm_read_file(reader)[1]:
+                        pass
+                finally:
+                    _format.ihm_reader_free(reader)
+            return os.path.getsize(cif)
+    elif name in ('cif_reader', 'bcif_reader'):
+        def func():
+            h = _CountHandler()
+            binary = name == 'bcif_reader'
+            fname = bcif if binary else cif
+            cls = ihm.format_bcif.BinaryCifReader if binary \
+                else ihm.format.CifReader
+            with open(fname, 'rb' if binary else 'r') as fh:
+                r = cls(fh, {'_atom_site': h})
+                while r.read_file():
+                    pass
+            assert h.count == atoms
+            return os.path.getsize(fname)
+    elif name in ('read_cif', 'read_bcif'):
+        def func():
+            binary = name == 'read_bcif'
+            fname = bcif if binary else cif
+            with open(fname, 'rb' if binary else 'r') as fh:
+                ihm.reader.read(fh, format='BCIF' if binary else 'mmCIF')
+            return os.path.getsize(fname)
+    elif name in ('write_cif', 'write_bcif'):
+        with open(cif) as fh:
+            args = (ihm.reader.read(fh),)
+
+        def func(systems):
+            binary = name == 'write_bcif'
+            out = os.path.join(tmpdir, 'output-%s-%d' % (parser, os.getpid()))
+            with open(out, 'wb' if binary else 'w') as fh:
+                ihm.dumper.write(fh, systems,
+                                 format='BCIF' if binary else 'mmCIF')
+            size = os.path.getsize(out)
+            os.unlink(out)
+            return size
+    elif name == 'validate':
+        args = (make_dictionary(ihm, cif),)
+
+        def func(d):
+            with open(cif) as fh:
+                d.validate(fh)
+            return os.path.getsize(cif)
+    else:
+        raise ValueError("Unknown benchmark %s" % name)
+
+    times = []
+    for i in range(repeat):
+        start = time.perf_counter()
+        nbytes = func(*args)
+        times.append(time.perf_counter() - start)
+    best = min(times)
+    return {'name': name, 'parser': parser, 'seconds': best,
+            'all_seconds': times, 'bytes': nbytes, 'atoms': atoms,
+            'mb_per_s': nbytes / best / 1e6, 'atoms_per_s': atoms / best,
+            'peak_rss_kb': _get_peak_rss_kb()}
+
+
+def _get_peak_rss_kb():
+    """Get the peak memory use of this process, in KiB, if available"""
+    # On Linux, ru_maxrss includes the peak of the parent process (it is
+    # kept across exec) so use the kernel's high water mark instead
+    try:
+        with open('/proc/self/status') as fh:
+            for line in fh:
+                if line.startswith('VmHWM:'):
+                    return int(line.split()[1])
+    except IOError:
+        pass
+    try:
+        import resource
+    except ImportError:  # e.g. on Windows
+        return None
+    rss = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    # macOS reports bytes, Linux KiB
+    return rss // 1024 if sys.platform == 'darwin' else rss
+
+
+def have_c_extension():
+    """Return True iff the C extension is available"""
+    _import_ihm('C')
+    try:
+        from ihm import _format  # noqa: F401
+        return True
+    except ImportError:
+        return False
+
+
+def compare(results, baseline_file, tolerance):
+    """Compare results with an earlier run; return a list of regressions"""
+    with open(baseline_file) as fh:
+        baseline = dict(((r['name'], r['parser']), r)
+                        for r in json.load(fh)['results'])
+    regressions = []
+    for r in results:
+        old = baseline.get((r['name'], r['parser']))
+        if old is None:
+            continue
+        if r['mb_per_s'] < old['mb_per_s'] * (1. - tolerance):
+            regressions.append('%s (%s) throughput fell from %.2f to '
+                               '%.2f MB/s' % (r['name'], r['parser'],
+                                              old['mb_per_s'], r['mb_per_s']))
+        if (r['peak_rss_kb'] and old['peak_rss_kb']
+                and r['peak_rss_kb'] > old['peak_rss_kb'] * (1. + tolerance)):
+            regressions.append('%s (%s) peak RSS rose from %d to %d KiB'
+                               % (r['name'], r['parser'], old['peak_rss_kb'],
+                                  r['peak_rss_kb']))
+    return regressions
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description="Benchmark python-ihm reading, writing and validation")
+    parser.add_argument('benchmarks', nargs='*',
+                        help="Benchmarks to run (default all): %s"
+                        % ", ".join(b[0] for b in BENCHMARKS))
+    parser.add_argument('--atoms', type=int, default=100000,
+                        help="Total number of atoms (default %(default)s)")
+    parser.add_argument('--models', type=int, default=5,
+                        help="Number of models (default %(default)s)")
+    parser.add_argument('--metadata-rows', type=int, default=500,
+                        help="Number of rows in each metadata table "
+                             "(default %(default)s)")
+    parser.add_argument('--text-lines', type=int, default=10,
+                        help="Number of lines in each multiline text "
+                             "value (default %(default)s)")
+    parser.add_argument('--save-frames', type=int, default=100,
+                        help="Number of save frames (default %(default)s)")
+    parser.add_argument('--parser', choices=('C', 'Python'),
+                        help="Only use the given parser (default both)")
+    parser.add_argument('--repeat', type=int, default=3,
+                        help="Number of times to run each benchmark; the "
+                             "fastest is reported (default %(default)s)")
+    parser.add_argument('--output', help="Write JSON results to this file "
+                                         "(default standard output)")
+    parser.add_argument('--compare', metavar='FILE',
+                        help="Compare results with an earlier JSON output")
+    parser.add_argument('--tolerance', type=float, default=0.2,
+                        help="Fractional slowdown or memory increase "
+                             "reported as a regression (default "
+                             "%(default)s)")
+    parser.add_argument('--run-one', nargs=3,
+                        metavar=('NAME', 'PARSER', 'DIR'),
+                        help=argparse.SUPPRESS)
+    args = parser.parse_args()
+    unknown = set(args.benchmarks) - set(b[0] for b in BENCHMARKS)
+    if unknown:
+        parser.error("Unknown benchmark(s): %s" % ", ".join(sorted(unknown)))
+    return args
+
+
+def main():
+    args = parse_args()
+    if args.run_one:
+        name, parser, tmpdir = args.run_one
+        json.dump(run_benchmark(name, parser, tmpdir, args.repeat),
+                  sys.stdout)
+        return
+
+    parsers = ['C', 'Python'] if have_c_extension() else ['Python']
+    if args.parser:
+        parsers = [p for p in parsers if p == args.parser]
+    results = []
+    failures = []
+    with tempfile.TemporaryDirectory() as tmpdir:
+        print("Generating input files...", file=sys.stderr)
+        inputs = make_inputs(args, tmpdir)
+        for name, bench_parsers in BENCHMARKS:
+            if args.benchmarks and name not in args.benchmarks:
+                continue
+            for parser in bench_parsers:
+                if parser not in parsers:
+                    continue
+                p = subprocess.run(
+                    [sys.executable, os.path.abspath(__file__),
+                     '--repeat', str(args.repeat),
+                     '--run-one', name, parser, tmpdir],
+                    stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                    universal_newlines=True)
+                if p.returncode != 0:
+                    # Report the failure, but carry on with other benchmarks
+                    err = p.stderr.strip().split('\n')[-1]
+                    print("%-12s %-7s FAILED: %s" % (name, parser, err),
+                          file=sys.stderr)
+                    failures.append({'name': name, 'parser': parser,
+                                     'error': err})
+                    continue
+                r = json.loads(p.stdout)
+                print("%-12s %-7s %8.3f s %9.2f MB/s %11.0f atoms/s %9s KiB"
+                      % (name, parser, r['seconds'], r['mb_per_s'],
+                         r['atoms_per_s'], r['peak_rss_kb']),
+                      file=sys.stderr)
+                results.append(r)
+
+    import ihm
+    report = {'ihm_version': ihm.__version__,
+              'python': platform.python_version(),
+              'platform': platform.platform(),
+              'parameters': dict(atoms=args.atoms, models=args.models,
+                                 metadata_rows=args.metadata_rows,
+                                 text_lines=args.text_lines,
+                                 save_frames=args.save_frames,
+                                 repeat=args.repeat),
+              'inputs': inputs, 'results': results, 'failures': failures}
+    if args.output:
+        with open(args.output, 'w') as fh:
+            json.dump(report, fh, indent=2)
+    else:
+        json.dump(report, sys.stdout, indent=2)
+        print()
+
+    regressions = []
+    if args.compare:
+        regressions = compare(results, args.compare, args.tolerance)
+        for r in regressions:
+            print("REGRESSION: " + r, file=sys.stderr)
+    if regressions or failures:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -35,6 +35,11 @@ class __UnknownValue:
     def __hash__(self):
         return 0
 
+    # Pickle as a reference to the singleton (so that it is still
+    # the same object when unpickled, e.g. by ihm.reader.read_many)
+    def __reduce__(self):
+        return 'unknown'
+
     # Unknown value is a singleton and should only compare equal to itself
     def __eq__(self, other):
         return self is other
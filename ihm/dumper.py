@@ -3807,6 +3807,9 @@ class _NullLoopCategoryWriter:
     def write(self, *args, **keys):
         pass
 
+    def write_columns(self, **columns):
+        pass
+
     def __enter__(self):
         return self
 
@@ -3849,6 +3852,116 @@ class _IgnoreWriter:
         return self._base_writer.write_comment(comment)
 
 
+class _ProgressLoopWriter:
+    """Pass through to a loop or category writer, counting the rows
+       written in a _ProgressWriter"""
+    def __init__(self, progress_writer, base_loop):
+        self._progress_writer = progress_writer
+        self._base_loop = base_loop
+
+    def write(self, *args, **keys):
+        pw = self._progress_writer
+        pw.rows += 1
+        if pw.rows >= pw._next_check:
+            pw._check_progress()
+        return self._base_loop.write(*args, **keys)
+
+    def write_columns(self, **columns):
+        pw = self._progress_writer
+        # Count rows if we can do so without consuming the columns
+        for col in columns.values():
+            if col is not None and hasattr(col, '__len__'):
+                pw.rows += len(col)
+                break
+        ret = self._base_loop.write_columns(**columns)
+        if pw.rows >= pw._next_check:
+            pw._check_progress()
+        return ret
+
+    def __enter__(self):
+        self._base_loop.__enter__()
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        return self._base_loop.__exit__(exc_type, exc_value, traceback)
+
+
+class _ProgressWriter:
+    """Utility class which passes through to ``base_writer``, keeping
+       track of the number of rows written and the current category,
+       for progress reports by :func:`write`."""
+    # Rough size of a row, used to report progress by row count when the
+    # number of bytes written is not known or not changing (e.g. BinaryCIF,
+    # which is only written to the file at the end)
+    _bytes_per_row = 64
+
+    def __init__(self, base_writer, progress=None, fh=None,
+                 progress_interval=4194304):
+        self._base_writer = base_writer
+        self.rows = 0
+        self.current_category = None
+        self._progress = progress
+        self._fh = fh
+        self._row_interval = max(1, progress_interval // self._bytes_per_row)
+        self._byte_interval = progress_interval
+        # Querying the file position is not free, so only do it every
+        # so often
+        self._check_interval = min(1024, self._row_interval)
+        self._next_check = (self._check_interval if progress is not None
+                            else float('inf'))
+        self._last_bytes = self._last_rows = 0
+
+    def report(self):
+        """Call the progress callable with the current state"""
+        nbytes = _get_bytes_written(self._fh)
+        self._last_rows = self.rows
+        if nbytes is not None:
+            self._last_bytes = nbytes
+        self._progress(nbytes, None, self.rows, self.current_category)
+
+    def _check_progress(self):
+        """Report progress if at least the requested number of bytes
+           (or, failing that, an equivalent number of rows) have been
+           written since the last report"""
+        self._next_check = self.rows + self._check_interval
+        nbytes = _get_bytes_written(self._fh)
+        if nbytes is not None and nbytes > self._last_bytes:
+            if nbytes - self._last_bytes >= self._byte_interval:
+                self.report()
+        elif self.rows - self._last_rows >= self._row_interval:
+            self.report()
+
+    def category(self, category):
+        self.current_category = category
+        return _ProgressLoopWriter(self, self._base_writer.category(category))
+
+    def loop(self, category, keys):
+        self.current_category = category
+        return _ProgressLoopWriter(self,
+                                   self._base_writer.loop(category, keys))
+
+    # Pass through other methods to base_writer
+    def flush(self):
+        return self._base_writer.flush()
+
+    def end_block(self):
+        return self._base_writer.end_block()
+
+    def start_block(self, name):
+        return self._base_writer.start_block(name)
+
+    def write_comment(self, comment):
+        return self._base_writer.write_comment(comment)
+
+
+def _get_bytes_written(fh):
+    """Get the current position in the output file, or None if not known"""
+    try:
+        return fh.tell()
+    except (AttributeError, OSError, ValueError):
+        return None
+
+
 class Variant:
     """Utility class to select the type of file to output by :func:`write`."""
 
@@ -3932,7 +4045,7 @@ def set_line_wrap(line_wrap):
 
 
 def write(fh, systems, format='mmCIF', dumpers=[], variant=IHMVariant,
-          check=True):
+          check=True, progress=None, progress_interval=4194304):
     """Write out all `systems` to the file handle `fh`.
        Files can be written in either the text-based mmCIF format or the
        BinaryCIF format. The BinaryCIF writer needs the msgpack Python
@@ -3973,6 +4086,22 @@ def write(fh, systems, format='mmCIF', dumpers=[], variant=IHMVariant,
               the mmCIF dictionaries. (Note that some checks are always
               performed, as the library cannot function correctly without
               these.)
+       :param progress: If given, a callable that is periodically called
+              while the file is written, whenever at least
+              `progress_interval` more bytes have been written, as well as
+              after each :class:`Dumper` has written its data and once
+              more when the file is complete. It is given the same four
+              arguments as the `progress` callable of
+              :func:`ihm.reader.read`: the number of bytes written so far
+              (or `None` if this cannot be determined), the total size
+              (always `None`, as this is not known in advance), the number
+              of rows written so far, and the name of the category most
+              recently written. Note that BinaryCIF data are only written
+              to the file at the end, so in this case (or if the file
+              position is not known) progress is instead reported every
+              `progress_interval` / 64 rows.
+       :param int progress_interval: The minimum number of bytes to write
+              between periodic calls to `progress`.
     """
     if isinstance(variant, type):
         variant = variant()
@@ -3981,8 +4110,15 @@ def write(fh, systems, format='mmCIF', dumpers=[], variant=IHMVariant,
                   'BCIF': ihm.format_bcif.BinaryCifWriter}
 
     writer = writer_map[format](fh)
+    pw = None
     for system in systems:
         w = variant.get_system_writer(system, writer_map[format], writer)
+        if progress is not None:
+            if pw is None:
+                pw = _ProgressWriter(w, progress, fh, progress_interval)
+            else:
+                pw._base_writer = w
+            w = pw
         system._before_write()
 
         for d in dumpers:
@@ -3991,5 +4127,9 @@ def write(fh, systems, format='mmCIF', dumpers=[], variant=IHMVariant,
         system._check_after_write()
         for d in dumpers:
             d.dump(system, w)
+            if pw is not None:
+                pw.report()
         w.end_block()  # start_block is called by EntryDumper
     writer.flush()
+    if pw is not None:
+        pw.report()
@@ -15,6 +15,8 @@ import ihm
 from io import StringIO
 import inspect
 import re
+import io
+import os
 try:
     from . import _format
 except ImportError:
@@ -29,6 +31,28 @@ def _write_multiline(val, fh):
     fh.write(";\n")
 
 
+def _get_columns(keys, columns):
+    """Get the data for each of `keys` from the `columns` dict passed to
+       a loop writer's write_columns() method, as a list of lists (or None
+       for keys not in `columns`), and the number of rows."""
+    nrows = None
+    ret = []
+    for k in keys:
+        col = columns.get(k)
+        if col is not None:
+            # Convert NumPy arrays or array.array into lists of Python values
+            if hasattr(col, 'tolist'):
+                col = col.tolist()
+            elif not isinstance(col, (list, tuple)):
+                col = list(col)
+            if nrows is None:
+                nrows = len(col)
+            elif len(col) != nrows:
+                raise ValueError("All columns must be of the same length")
+        ret.append(col)
+    return ret, nrows or 0
+
+
 class _LineWriter:
     def __init__(self, writer, line_len=80):
         self.writer = writer
@@ -68,6 +92,9 @@ class _CifCategoryWriter:
 
 
 class _CifLoopWriter:
+    # Number of rows to format at once in write_columns
+    _chunk_size = 1000
+
     def __init__(self, writer, category, keys, line_wrap=True):
         self._line_wrap = line_wrap
         self.writer = writer
@@ -76,19 +103,59 @@ class _CifLoopWriter:
         # Remove characters that we can't use in Python identifiers
         self.python_keys = [k.replace('[', '').replace(']', '') for k in keys]
         self._empty_loop = True
-
-    def write(self, **kwargs):
+        # Use the fast C formatter if available, unless the writer
+        # customizes how values are represented (in a subclass, or by
+        # setting _repr on the writer object itself)
+        self._format_row = None
+        if (_format is not None
+                and getattr(type(writer), '_repr', None) is CifWriter._repr
+                and '_repr' not in vars(writer)):
+            self._format_row = _format.cif_format_row
+
+    def _write_header(self):
         if self._empty_loop:
             f = self.writer.fh
             f.write("#\nloop_\n")
             for k in self.keys:
                 f.write("%s.%s\n" % (self.category, k))
             self._empty_loop = False
+
+    def write(self, **kwargs):
+        self._write_header()
+        self._write_row([kwargs.get(k, None) for k in self.python_keys])
+
+    def _write_row(self, values):
+        if self._format_row is not None:
+            self.writer.fh.write(self._format_row(
+                values, 80 if self._line_wrap else 0))
+            return
         lw = _LineWriter(self.writer, line_len=80 if self._line_wrap else 0)
-        for k in self.python_keys:
-            lw.write(kwargs.get(k, None))
+        for val in values:
+            lw.write(val)
         self.writer.fh.write("\n")
 
+    def write_columns(self, **columns):
+        """Write multiple rows of data at once. Each keyword argument
+           should be a sequence (such as a list, array.array or NumPy
+           array) of values for the given key, one per row; all sequences
+           must be of the same length. As for `write`, missing keys or
+           None values are written as omitted. This is much faster than
+           calling `write` for each row."""
+        cols, nrows = _get_columns(self.python_keys, columns)
+        if nrows == 0:
+            return
+        self._write_header()
+        if self._format_row is not None:
+            line_len = 80 if self._line_wrap else 0
+            # Format in chunks to limit memory use
+            for start in range(0, nrows, self._chunk_size):
+                self.writer.fh.write(_format.cif_format_columns(
+                    cols, start, min(nrows, start + self._chunk_size),
+                    line_len))
+        else:
+            for i in range(nrows):
+                self._write_row([None if c is None else c[i] for c in cols])
+
     def __enter__(self):
         return self
 
@@ -358,46 +425,267 @@ class _SaveToken(_Token):
     pass
 
 
+class ReaderStats:
+    """Statistics about the data read so far by a reader.
+       See :meth:`CifReader.get_stats`.
+
+       Times are in seconds, and are only measured if timing was turned on
+       with :meth:`CifReader.set_timing`; otherwise they are zero.
+
+       .. attribute:: bytes_read
+
+          Number of bytes read from the file (or given to ``feed``).
+
+       .. attribute:: lines
+
+          Current mmCIF line number (zero for BinaryCIF).
+
+       .. attribute:: tokens
+
+          Number of mmCIF tokens read (zero for BinaryCIF).
+
+       .. attribute:: buffer_max
+
+          Largest size, in bytes, of the buffer holding file data.
+
+       .. attribute:: buffer_grows
+
+          Number of times the file buffer had to be reallocated to grow.
+
+       .. attribute:: total_time
+
+          Total time spent reading.
+
+       .. attribute:: io_time
+
+          Time spent reading data from the underlying file.
+
+       .. attribute:: parse_time
+
+          Time spent tokenizing mmCIF or decoding BinaryCIF, i.e. the total
+          time excluding I/O and callbacks.
+
+       .. attribute:: callback_time
+
+          Time spent in category handlers and in unknown category
+          and keyword handlers.
+
+       .. attribute:: categories
+
+          A dict, keyed by category name, of ``(rows, callback_time)``
+          tuples, giving the number of rows passed to each category's
+          handler and the time spent in it.
+    """
+    def __init__(self, stats):
+        self.categories = stats.pop('categories')
+        for key, value in stats.items():
+            setattr(self, key, value)
+
+    def __repr__(self):
+        return "<ReaderStats(%d bytes, %.3fs)>" % (self.bytes_read,
+                                                   self.total_time)
+
+
 class _Reader:
     """Base class for reading a file and extracting some or all of its data."""
 
+    def set_timing(self, timing=True):
+        """Turn on or off measuring of the time spent in each part of
+           reading (see :meth:`get_stats`). This adds a small overhead to
+           each row read, so is off by default."""
+        if hasattr(self, '_c_format'):
+            _format.ihm_reader_timing_set(self._c_format, timing)
+
+    def get_stats(self):
+        """Get statistics about the data read so far, as a
+           :class:`ReaderStats` object. These are useful to determine
+           whether a slow read is dominated by I/O, by parsing of the file,
+           or by a particular category handler.
+           Statistics are only collected by the C parser; if the C
+           extension is not available, `None` is returned."""
+        if hasattr(self, '_c_format'):
+            return ReaderStats(_format.ihm_reader_get_stats(self._c_format))
+
+    def set_progress_handler(self, handler, interval=4194304):
+        """Report progress while reading the file, for example to show
+           a progress bar or to let a job scheduler know that a long read
+           is not hung.
+
+           `handler` is called whenever data is read from the file and
+           at least `interval` bytes have been read since it was last
+           called. It is given four arguments: the number of bytes read
+           so far, the total size of the file in bytes (or `None` if not
+           known), the number of rows passed to category handlers so far,
+           and the name of the category most recently handled (or `None`).
+           Any exception raised by `handler` aborts the read.
+
+           Progress is only reported by the C parser; if the C extension
+           is not available, `handler` is never called."""
+        if hasattr(self, '_c_format'):
+            total = _get_file_size(self.fh)
+
+            def progress(bytes_read, rows, category):
+                handler(bytes_read, total, rows, category)
+            _format.add_progress_handler(self._c_format, progress, interval)
+
     def _add_category_keys(self):
         """Populate _keys for each category by inspecting its __call__
            method"""
-        def python_to_cif(field):
-            # Map valid Python identifiers to mmCIF keywords
-            if field.startswith('tr_vector') or field.startswith('rot_matrix'):
-                return re.sub(r'(\d)', r'[\1]', field)
-            else:
-                return field
+        for h in self.category_handler.values():
+            _add_handler_keys(h)
+
+    def feed(self, data):
+        """Add the next piece of the file to a reader created with a
+           file handle of `None`, and parse as much of it as possible.
+           Category handlers are called as for :meth:`read_file` as soon as
+           complete rows are available (if the C-accelerated _format module
+           is not available, data is only stored, and is parsed all at once
+           by :meth:`finish`).
+
+           If the end of a data block is reached (i.e. the start of the
+           next block is seen, or for BinaryCIF, all of the block's
+           categories have been read) True is returned; any remaining data
+           is kept and is parsed by the next call to this method (which can
+           be given empty data), so that the category handlers can be
+           changed first.
+
+           For mmCIF, :exc:`CifParserError` will be raised if the file
+           cannot be parsed.
+
+           :param data: The next piece of the file.
+           :type data: str or bytes (BinaryCIF data must be bytes)
+           :return: True iff a data block was completed.
+        """
+        if not self._push:
+            raise ValueError("feed() can only be used with a reader "
+                             "created with no file handle")
+        if not hasattr(self, '_c_format'):
+            if self._push_data is None:
+                raise ValueError("Cannot feed more data after finish()")
+            self._push_data.append(data.encode('utf-8')
+                                   if isinstance(data, str) else bytes(data))
+            return False
+        if not self._c_handlers_added:
+            self._add_category_keys()
+            self._add_c_handlers()
+        block_done = self._call_c_reader(_format.ihm_reader_feed, data)
+        if block_done:
+            self._c_handlers_added = False
+        return block_done
+
+    def finish(self):
+        """Signal that all data has been given to :meth:`feed`, and
+           read the rest of the current data block. This otherwise behaves
+           identically to :meth:`read_file`, and can similarly be called
+           again to read the next block.
 
-        def fill_keys(h, s, attr, typ):
-            if not hasattr(h, attr):
-                setattr(h, attr, frozenset(
-                    python_to_cif(k) for k, v in s.annotations.items()
-                    if v is typ))
+           :return: True iff more data blocks are available to be read.
+        """
+        if not self._push:
+            raise ValueError("finish() can only be used with a reader "
+                             "created with no file handle")
+        if not hasattr(self, '_c_format'):
+            if self._push_data is not None:
+                self.fh = self._push_file(b''.join(self._push_data))
+                self._push_data = None
+            return self.read_file()
+        if not self._c_handlers_added:
+            self._add_category_keys()
+            self._add_c_handlers()
+        self._c_handlers_added = False
+        return self._call_c_reader(_format.ihm_reader_finish)
+
+    def _add_c_handlers(self):
+        """Pass all category handlers to the C parser"""
+        _format.ihm_reader_remove_all_categories(self._c_format)
+        for category, handler in self.category_handler.items():
+            func = getattr(handler, '_add_c_handler', None) \
+                or _format.add_category_handler
+            func(self._c_format, category, handler._keys,
+                 frozenset(handler._int_keys), frozenset(handler._float_keys),
+                 frozenset(handler._bool_keys), handler)
+        if self.unknown_category_handler is not None:
+            _format.add_unknown_category_handler(self._c_format,
+                                                 self.unknown_category_handler)
+        if self.unknown_keyword_handler is not None:
+            _format.add_unknown_keyword_handler(self._c_format,
+                                                self.unknown_keyword_handler)
+        self._c_handlers_added = True
 
-        def check_extra(h, attr):
-            extra = frozenset(getattr(h, attr)) - frozenset(h._keys)
-            if extra:
-                raise ValueError("For %s, %s not in _keys: %s"
-                                 % (h, attr, ", ".join(extra)))
+    def _push_file(self, data):
+        """Return a file handle for all data given to :meth:`feed`,
+           for use by the Python reader"""
+        raise NotImplementedError
 
-        for h in self.category_handler.values():
-            s = inspect.getfullargspec(h.__call__)
-            if not hasattr(h, '_keys'):
-                h._keys = [python_to_cif(x) for x in s.args[1:]]
-            fill_keys(h, s, '_int_keys', int)
-            fill_keys(h, s, '_float_keys', float)
-            fill_keys(h, s, '_bool_keys', bool)
-            bad_keys = frozenset(k for k, v in s.annotations.items()
-                                 if v not in (int, float, str, bool))
-            if bad_keys:
-                raise ValueError("For %s, bad annotations: %s"
-                                 % (h, ", ".join(bad_keys)))
-            check_extra(h, '_int_keys')
-            check_extra(h, '_float_keys')
-            check_extra(h, '_bool_keys')
+    def _call_c_reader(self, func, *args):
+        """Call a function of the C reader, returning its output value"""
+        ret_ok, result = func(self._c_format, *args)
+        return result
+
+
+def _get_raw_file(fh):
+    """Get the underlying unbuffered file object of the file handle `fh`,
+       if any, or `fh` itself. Only plain files give an io.FileIO object;
+       e.g. gzip files also have a name and a fileno(), but these are
+       those of the compressed file."""
+    raw = fh
+    if isinstance(raw, io.TextIOWrapper):
+        raw = raw.buffer
+    if isinstance(raw, io.BufferedReader):
+        raw = raw.raw
+    return raw
+
+
+def _get_file_size(fh):
+    """Get the number of bytes left to read in the file handle `fh`,
+       or None if not known"""
+    raw = _get_raw_file(fh)
+    # Only trust the size of plain files
+    if isinstance(raw, io.FileIO):
+        try:
+            return os.fstat(raw.fileno()).st_size - raw.tell()
+        except OSError:
+            return None
+    elif isinstance(raw, io.BytesIO):
+        return len(raw.getbuffer()) - raw.tell()
+
+
+def _add_handler_keys(h):
+    """Populate _keys (and _int_keys etc.) for a category handler by
+       inspecting its __call__ method"""
+    def python_to_cif(field):
+        # Map valid Python identifiers to mmCIF keywords
+        if field.startswith('tr_vector') or field.startswith('rot_matrix'):
+            return re.sub(r'(\d)', r'[\1]', field)
+        else:
+            return field
+
+    def fill_keys(h, s, attr, typ):
+        if not hasattr(h, attr):
+            setattr(h, attr, frozenset(
+                python_to_cif(k) for k, v in s.annotations.items()
+                if v is typ))
+
+    def check_extra(h, attr):
+        extra = frozenset(getattr(h, attr)) - frozenset(h._keys)
+        if extra:
+            raise ValueError("For %s, %s not in _keys: %s"
+                             % (h, attr, ", ".join(extra)))
+
+    s = inspect.getfullargspec(h.__call__)
+    if not hasattr(h, '_keys'):
+        h._keys = [python_to_cif(x) for x in s.args[1:]]
+    fill_keys(h, s, '_int_keys', int)
+    fill_keys(h, s, '_float_keys', float)
+    fill_keys(h, s, '_bool_keys', bool)
+    bad_keys = frozenset(k for k, v in s.annotations.items()
+                         if v not in (int, float, str, bool))
+    if bad_keys:
+        raise ValueError("For %s, bad annotations: %s"
+                         % (h, ", ".join(bad_keys)))
+    check_extra(h, '_int_keys')
+    check_extra(h, '_float_keys')
+    check_extra(h, '_bool_keys')
 
 
 class _CifTokenizer:
@@ -1091,11 +1379,16 @@ class CifReader(_Reader, _CifTokenizer):
 
        Use :meth:`read_file` to actually read the file.
 
+       Alternatively, pass `None` for the file handle, then supply the file
+       contents piece by piece with :meth:`feed` (for example, as data
+       arrives over a pipe or network connection) and call :meth:`finish`
+       once all data has been given.
+
        See also :class:`CifTokenReader` for a class that operates on the
        lower-level structure of an mmCIF file, preserving data such as
        comments and whitespace.
 
-       :param file fh: Open handle to the mmCIF file
+       :param file fh: Open handle to the mmCIF file, or `None`
        :param dict category_handler: A dict to handle data
               extracted from the file. Keys are category names
               (e.g. "_entry") and values are objects that have a `__call__`
@@ -1126,12 +1419,21 @@ class CifReader(_Reader, _CifTokenizer):
     def __init__(self, fh, category_handler, unknown_category_handler=None,
                  unknown_keyword_handler=None):
         if _format is not None:
-            c_file = _format.ihm_file_new_from_python(fh, False)
+            if fh is None:
+                c_file = _format.ihm_file_new_push()
+            else:
+                c_file = _format.ihm_file_new_from_python(fh, False)
             self._c_format = _format.ihm_reader_new(c_file, False)
         self.category_handler = category_handler
         self.unknown_category_handler = unknown_category_handler
         self.unknown_keyword_handler = unknown_keyword_handler
         self._category_data = {}
+        self._push = fh is None
+        # Data given to feed(), if we don't have the C parser
+        self._push_data = [] if self._push else None
+        # True iff handlers have been given to the C parser for the
+        # data block currently being fed
+        self._c_handlers_added = False
         _CifTokenizer.__init__(self, fh)
 
     def __del__(self):
@@ -1267,6 +1569,9 @@ class CifReader(_Reader, _CifTokenizer):
 
            :return: True iff more data blocks are available to be read.
         """
+        if self._push and self.fh is None:
+            raise ValueError("Use feed() and finish() to read data with a "
+                             "reader created with no file handle")
         self._add_category_keys()
         if hasattr(self, '_c_format'):
             return self._read_file_c()
@@ -1308,22 +1613,19 @@ class CifReader(_Reader, _CifTokenizer):
 
     def _read_file_c(self):
         """Read the file using the C parser"""
-        _format.ihm_reader_remove_all_categories(self._c_format)
-        for category, handler in self.category_handler.items():
-            func = getattr(handler, '_add_c_handler', None) \
-                or _format.add_category_handler
-            func(self._c_format, category, handler._keys,
-                 frozenset(handler._int_keys), frozenset(handler._float_keys),
-                 frozenset(handler._bool_keys), handler)
-        if self.unknown_category_handler is not None:
-            _format.add_unknown_category_handler(self._c_format,
-                                                 self.unknown_category_handler)
-        if self.unknown_keyword_handler is not None:
-            _format.add_unknown_keyword_handler(self._c_format,
-                                                self.unknown_keyword_handler)
+        self._add_c_handlers()
+        self._c_handlers_added = False
+        return self._call_c_reader(_format.ihm_read_file)
+
+    def _push_file(self, data):
+        """Return a file handle for all data given to :meth:`feed`"""
+        return StringIO(data.decode('utf-8'))
+
+    def _call_c_reader(self, func, *args):
+        """Call a function of the C reader, returning its output value"""
         try:
-            ret_ok, more_data = _format.ihm_read_file(self._c_format)
+            ret_ok, result = func(self._c_format, *args)
         except _format.FileFormatError as exc:
             # Convert to the same exception used by the Python code
             raise CifParserError(str(exc))
-        return more_data
+        return result
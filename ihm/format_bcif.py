@@ -11,6 +11,8 @@
 
 import struct
 import sys
+import array
+import io
 import inspect
 import ihm.format
 import ihm
@@ -41,6 +43,15 @@ class _Decoder:
         pass
 
 
+def _to_src_float_type(enc, data):
+    """Round floating point data to single precision if that was the
+       type of the original (pre-encoding) data"""
+    if enc.get('srcType') == _Float32:
+        return array.array('f', data)
+    else:
+        return data
+
+
 class _StringArrayDecoder(_Decoder):
     """Decode an array of strings stored as a concatenation of all unique
        strings, an array of offsets describing substrings, and indices into
@@ -151,8 +162,7 @@ class _FixedPointDecoder(_Decoder):
 
     def __call__(self, enc, data):
         factor = float(enc['factor'])
-        for d in data:
-            yield float(d) / factor
+        return _to_src_float_type(enc, (float(d) / factor for d in data))
 
 
 class _IntervalQuantizationDecoder(_Decoder):
@@ -165,8 +175,7 @@ class _IntervalQuantizationDecoder(_Decoder):
         maxval = float(enc['max'])
         numsteps = int(enc['numSteps'])
         delta = (maxval - minval) / (numsteps - 1)
-        for d in data:
-            yield minval + delta * d
+        return _to_src_float_type(enc, (minval + delta * d for d in data))
 
 
 def _get_decoder_map():
@@ -203,23 +212,117 @@ class BinaryCifReader(ihm.format._Reader):
     """Class to read a BinaryCIF file and extract some or all of its data.
 
        Use :meth:`read_file` to actually read the file.
+
+       Alternatively, pass `None` for the file handle, then supply the file
+       contents piece by piece with :meth:`feed` and call :meth:`finish`
+       once all data has been given. Each category is decoded as soon as
+       all of its data has been given.
+
        See :class:`ihm.format.CifReader` for a description of the parameters.
+
+       :param int chunk_size: If nonzero, categories with more rows than
+              this are decoded this many rows at a time, rather than all
+              at once. This reduces peak memory usage when reading very
+              large files, at a small cost in speed. This only affects
+              the C-accelerated reader.
     """
     def __init__(self, fh, category_handler, unknown_category_handler=None,
-                 unknown_keyword_handler=None):
+                 unknown_keyword_handler=None, chunk_size=0):
         if _format is not None:
-            c_file = _format.ihm_file_new_from_python(fh, True)
+            if fh is None:
+                c_file = _format.ihm_file_new_push()
+            else:
+                c_file = _format.ihm_file_new_from_python(fh, True)
             self._c_format = _format.ihm_reader_new(c_file, True)
+            if chunk_size:
+                _format.ihm_reader_bcif_chunk_size_set(self._c_format,
+                                                       chunk_size)
         self.category_handler = category_handler
         self.unknown_category_handler = unknown_category_handler
         self.unknown_keyword_handler = unknown_keyword_handler
         self.fh = fh
         self._file_blocks = None
+        self._block_index = 0
+        self._push = fh is None
+        # Data given to feed(), if we don't have the C parser
+        self._push_data = [] if self._push else None
+        # True iff handlers have been given to the C parser for the
+        # data block currently being fed
+        self._c_handlers_added = False
 
     def __del__(self):
         if hasattr(self, '_c_format'):
             _format.ihm_reader_free(self._c_format)
 
+    def skip_to_block(self, block):
+        """Skip data blocks so that the next :meth:`read_file` reads
+           the given block.
+
+           Skipped blocks are not decoded, so this is much faster than
+           reading them with :meth:`read_file`.
+
+           :param block: Either the zero-based index of the data block
+                  in the file, or its name (header). Blocks can only be
+                  skipped forwards; it is an error to ask for a block
+                  that has already been read.
+           :return: True iff the block was found (if False, the end of
+                    the file was reached).
+        """
+        if hasattr(self, '_c_format'):
+            if isinstance(block, str):
+                ret_ok, found = _format.ihm_reader_bcif_skip_to_named_block(
+                    self._c_format, block)
+            else:
+                ret_ok, found = _format.ihm_reader_bcif_skip_to_block(
+                    self._c_format, block)
+            return found
+
+        if self._file_blocks is None:
+            self._file_blocks = self._read_msgpack()
+        if isinstance(block, str):
+            while (len(self._file_blocks) > 0
+                   and self._file_blocks[0].get('header') != block):
+                self._skip_block()
+        else:
+            if block < self._block_index:
+                raise ValueError(
+                    "Cannot skip back to data block %d; the next block is %d"
+                    % (block, self._block_index))
+            while len(self._file_blocks) > 0 and self._block_index < block:
+                self._skip_block()
+        return len(self._file_blocks) > 0
+
+    def get_contents(self):
+        """Get the names of all remaining data blocks and their categories.
+
+           No data is decoded, so this is much faster than reading the
+           file. However, this reads to the end of the file, so no further
+           data can be read with :meth:`read_file` afterwards.
+
+           :return: A list of ``(header, categories)`` tuples, one for
+                    each data block, where ``header`` is the name of the
+                    block (or None if it has no name) and ``categories``
+                    is a list of the names of all categories in the block.
+        """
+        if hasattr(self, '_c_format'):
+            contents = []
+            _format.bcif_contents(self._c_format, contents)
+            return contents
+
+        if self._file_blocks is None:
+            self._file_blocks = self._read_msgpack()
+        contents = [(block.get('header'),
+                     [c['name'] for c in block.get('categories', [])])
+                    for block in self._file_blocks]
+        while len(self._file_blocks) > 0:
+            self._skip_block()
+        return contents
+
+    def _skip_block(self):
+        """Discard the next data block (Python reader only)"""
+        del self._file_blocks[0]
+        self._block_index += 1
+
     def read_file(self):
         """Read the file and extract data.
 
@@ -228,6 +331,9 @@ class BinaryCifReader(ihm.format._Reader):
 
            :return: True iff more data blocks are available to be read.
         """
+        if self._push and self.fh is None:
+            raise ValueError("Use feed() and finish() to read data with a "
+                             "reader created with no file handle")
         self._add_category_keys()
         if hasattr(self, '_c_format'):
             return self._read_file_c()
@@ -242,26 +348,18 @@ class BinaryCifReader(ihm.format._Reader):
                     self._handle_category(handler, category, cat_name)
                 elif self.unknown_category_handler is not None:
                     self.unknown_category_handler(cat_name, 0)
-            del self._file_blocks[0]
+            self._skip_block()
         return len(self._file_blocks) > 0
 
     def _read_file_c(self):
         """Read the file using the C parser"""
-        _format.ihm_reader_remove_all_categories(self._c_format)
-        for category, handler in self.category_handler.items():
-            func = getattr(handler, '_add_c_handler', None) \
-                or _format.add_category_handler
-            func(self._c_format, category, handler._keys,
-                 frozenset(handler._int_keys), frozenset(handler._float_keys),
-                 frozenset(handler._bool_keys), handler)
-        if self.unknown_category_handler is not None:
-            _format.add_unknown_category_handler(self._c_format,
-                                                 self.unknown_category_handler)
-        if self.unknown_keyword_handler is not None:
-            _format.add_unknown_keyword_handler(self._c_format,
-                                                self.unknown_keyword_handler)
-        ret_ok, more_data = _format.ihm_read_file(self._c_format)
-        return more_data
+        self._add_c_handlers()
+        self._c_handlers_added = False
+        return self._call_c_reader(_format.ihm_read_file)
+
+    def _push_file(self, data):
+        """Return a file handle for all data given to :meth:`feed`"""
+        return io.BytesIO(data)
 
     def _get_type_handler(self, category_handler, keyword):
         """Return a function that converts keyword string into desired type"""
@@ -359,6 +457,12 @@ class _LoopWriter:
             val = kwargs.get(k, None)
             self._values[i].append(val)
 
+    def write_columns(self, **columns):
+        """See :meth:`ihm.format._CifLoopWriter.write_columns`."""
+        cols, nrows = ihm.format._get_columns(self.python_keys, columns)
+        for values, col in zip(self._values, cols):
+            values.extend([None] * nrows if col is None else col)
+
     def __enter__(self):
         return self
 
@@ -415,9 +519,12 @@ class _ByteArrayEncoder(_Encoder):
     _struct_map = _ByteArrayDecoder._struct_map
 
     def __call__(self, data):
-        ba_type = _get_int_float_type(data)
+        return self._encode(data, _get_int_float_type(data))
+
+    @classmethod
+    def _encode(cls, data, ba_type):
         encdict = {'kind': 'ByteArray', 'type': ba_type}
-        fmt = self._struct_map[ba_type]
+        fmt = cls._struct_map[ba_type]
         # All data is encoded little-endian in bcif
         return struct.pack('<' + fmt * len(data), *data), encdict
 
@@ -429,6 +536,10 @@ class _DeltaEncoder(_Encoder):
         # probably will exceed the space savings
         if len(data) <= 40:
             return data, None
+        return self._encode(data)
+
+    @staticmethod
+    def _encode(data):
         data_type = _get_int_float_type(data)
         encdict = {'kind': 'Delta', 'origin': data[0],
                    'srcType': data_type}
@@ -443,6 +554,15 @@ class _RunLengthEncoder(_Encoder):
         # probably will exceed the space savings
         if len(data) <= 40:
             return data, None
+        encdata, encdict = self._encode(data)
+        # If we didn't save any space, return the original unchanged
+        if len(encdata) > len(data):
+            return data, None
+        else:
+            return encdata, encdict
+
+    @staticmethod
+    def _encode(data):
         data_type = _get_int_float_type(data)
         encdict = {'kind': 'RunLength',
                    'srcType': data_type, 'srcSize': len(data)}
@@ -457,11 +577,7 @@ class _RunLengthEncoder(_Encoder):
             else:
                 repeat += 1
         encdata.extend((val, repeat))
-        # If we didn't save any space, return the original unchanged
-        if len(encdata) > len(data):
-            return data, None
-        else:
-            return encdata, encdict
+        return encdata, encdict
 
 
 def _encode(data, encoders):
@@ -475,8 +591,148 @@ def _encode(data, encoders):
     return data, encdicts
 
 
+# Approximate size in bytes of each BinaryCIF encoding dict in the file
+_ENCODING_COST = 32
+
+# Largest FixedPoint factor (as a power of 10) to try
+_MAX_FIXED_POINT_DIGITS = 6
+
+# Map IntegerPacking (byteCount, isUnsigned) to ByteArray type
+_integer_packing_type = {(1, True): _Uint8, (1, False): _Int8,
+                         (2, True): _Uint16, (2, False): _Int16}
+
+
+def _integer_packing_limits(byte_count, unsigned):
+    """Get the upper and lower limits of each IntegerPacking value"""
+    if unsigned:
+        return (0xFF if byte_count == 1 else 0xFFFF), None
+    else:
+        upper = 0x7F if byte_count == 1 else 0x7FFF
+        return upper, -upper - 1
+
+
+def _integer_packed_size(data, byte_count, unsigned):
+    """Get the number of values needed to store `data` using
+       IntegerPacking"""
+    upper, lower = _integer_packing_limits(byte_count, unsigned)
+    return sum(d // upper + 1 if d >= 0 else d // lower + 1 for d in data)
+
+
+def _integer_pack(data, byte_count, unsigned):
+    """Store an integer array as 8- or 16-bit values (IntegerPacking)"""
+    upper, lower = _integer_packing_limits(byte_count, unsigned)
+    encdata = []
+    for d in data:
+        if d >= 0:
+            while d >= upper:
+                encdata.append(upper)
+                d -= upper
+        else:
+            while d <= lower:
+                encdata.append(lower)
+                d -= lower
+        encdata.append(d)
+    return encdata
+
+
+def _encode_ints_smallest(data):
+    """Encode integers using whichever combination of Delta, RunLength,
+       IntegerPacking and ByteArray encodings gives the smallest output.
+       Return the encoded data and a list of BinaryCIF encoding dicts."""
+    best = None
+    for delta in (False, True):
+        for rle in (False, True):
+            d = data
+            encdicts = []
+            try:
+                if delta:
+                    d, encdict = _DeltaEncoder._encode(d)
+                    encdicts.append(encdict)
+                if rle:
+                    d, encdict = _RunLengthEncoder._encode(d)
+                    encdicts.append(encdict)
+                ba_type = _get_int_float_type(d)
+            except TypeError:
+                continue
+            # Candidates are (data size in bytes, IntegerPacking byteCount)
+            fmt = _ByteArrayDecoder._struct_map[ba_type]
+            cands = [(len(d) * struct.calcsize(fmt), 0)]
+            min_val, max_val = min(d), max(d)
+            # IntegerPacking only handles 32-bit signed input
+            if min_val >= -0x80000000 and max_val <= 0x7FFFFFFF:
+                unsigned = min_val >= 0
+                for byte_count in (1, 2):
+                    cands.append((byte_count * _integer_packed_size(
+                        d, byte_count, unsigned), byte_count))
+            for size, byte_count in cands:
+                cost = size + _ENCODING_COST * (len(encdicts)
+                                                + (byte_count > 0))
+                if best is None or cost < best[0]:
+                    best = (cost, d, encdicts, byte_count)
+    if best is None:
+        raise TypeError("Cannot represent data as BinaryCIF")
+    cost, d, encdicts, byte_count = best
+    if byte_count > 0:
+        unsigned = min(d) >= 0
+        encdicts = encdicts + [{'kind': 'IntegerPacking',
+                                'byteCount': byte_count,
+                                'isUnsigned': unsigned, 'srcSize': len(d)}]
+        ba_type = _integer_packing_type[byte_count, unsigned]
+        d = _integer_pack(d, byte_count, unsigned)
+    else:
+        ba_type = _get_int_float_type(d)
+    encdata, encdict = _ByteArrayEncoder._encode(d, ba_type)
+    return encdata, encdicts + [encdict]
+
+
+def _get_fixed_point(data):
+    """Find the smallest power of 10 factor which can be used to store
+       `data` as integers using FixedPoint encoding without any loss
+       of precision (floats are stored in single precision). Return the
+       factor and the integers, or None if no such factor exists."""
+    try:
+        single = array.array('f', data)
+        for digits in range(_MAX_FIXED_POINT_DIGITS + 1):
+            factor = 10 ** digits
+            ints = [round(d * factor) for d in data]
+            if (min(ints) >= -0x80000000 and max(ints) <= 0x7FFFFFFF
+                    and array.array('f', [i / factor for i in ints])
+                    == single):
+                return factor, ints
+    except (ValueError, OverflowError):
+        # Non-finite or out of range values
+        pass
+
+
+def _encode_floats_smallest(data):
+    """Encode floats as either a ByteArray or FixedPoint-encoded integers,
+       whichever gives the smallest output"""
+    fixed = _get_fixed_point(data)
+    if fixed is not None:
+        factor, ints = fixed
+        encdata, encdicts = _encode_ints_smallest(ints)
+        if (len(encdata) + _ENCODING_COST * len(encdicts)
+                < len(data) * struct.calcsize('f')):
+            return encdata, [{'kind': 'FixedPoint', 'factor': factor,
+                              'srcType': _Float32}] + encdicts
+    return _encode(data, [_ByteArrayEncoder()])
+
+
 class _MaskedEncoder:
-    """Base class for all encoders that handle potentially masked data"""
+    """Base class for all encoders that handle potentially masked data.
+       If `optimize` is True, try a number of different encodings and
+       use whichever gives the smallest output."""
+    _int_encoders = [_DeltaEncoder(), _RunLengthEncoder(),
+                     _ByteArrayEncoder()]
+
+    def __init__(self, optimize=False):
+        self.optimize = optimize
+
+    def _encode_ints(self, data):
+        if self.optimize:
+            return _encode_ints_smallest(data)
+        else:
+            return _encode(data, self._int_encoders)
 
     def __call__(self, data, mask):
         """Given raw data `data`, and `mask`, return encoded data"""
@@ -484,9 +740,6 @@ class _MaskedEncoder:
 
 
 class _StringArrayMaskedEncoder(_MaskedEncoder):
-    _int_encoders = [_DeltaEncoder(), _RunLengthEncoder(),
-                     _ByteArrayEncoder()]
-
     def __call__(self, data, mask):
         seen_substrs = {}  # keys are substrings, values indices
         sorted_substrs = []
@@ -511,8 +764,8 @@ class _StringArrayMaskedEncoder(_MaskedEncoder):
             total_len += len(s)
             offsets.append(total_len)
 
-        data_offsets, enc_offsets = _encode(offsets, self._int_encoders)
-        data_indices, enc_indices = _encode(indices, self._int_encoders)
+        data_offsets, enc_offsets = self._encode_ints(offsets)
+        data_indices, enc_indices = self._encode_ints(indices)
 
         enc_dict = {'kind': 'StringArray',
                     'dataEncoding': enc_indices,
@@ -523,15 +776,12 @@ class _StringArrayMaskedEncoder(_MaskedEncoder):
 
 
 class _IntArrayMaskedEncoder(_MaskedEncoder):
-    _encoders = [_DeltaEncoder(), _RunLengthEncoder(), _ByteArrayEncoder()]
-
     def __call__(self, data, mask):
         if mask:
             masked_data = [-1 if m else d for m, d in zip(mask, data)]
         else:
             masked_data = data
-        encdata, encoders = _encode(masked_data, self._encoders)
-        return encdata, encoders
+        return self._encode_ints(masked_data)
 
 
 class _FloatArrayMaskedEncoder(_MaskedEncoder):
@@ -542,8 +792,10 @@ class _FloatArrayMaskedEncoder(_MaskedEncoder):
             masked_data = [0. if m else d for m, d in zip(mask, data)]
         else:
             masked_data = data
-        encdata, encoders = _encode(masked_data, self._encoders)
-        return encdata, encoders
+        if self.optimize:
+            return _encode_floats_smallest(masked_data)
+        else:
+            return _encode(masked_data, self._encoders)
 
 
 def _get_mask_and_type(data):
@@ -575,20 +827,90 @@ def _get_mask_and_type(data):
     raise ValueError("Cannot determine type of data %s" % data)
 
 
+class _MsgPackStream:
+    """Write the top-level structure of a BinaryCIF file incrementally,
+       so that each category can be written out as soon as it is complete.
+       The number of data blocks and categories is not known in advance,
+       so these arrays are written with fixed-size (32-bit) headers which
+       are patched once the count is known. `fh` must be seekable."""
+
+    def __init__(self, fh, version, encoder):
+        import msgpack
+        if not fh.seekable():
+            raise ValueError("Streaming BinaryCIF output needs a "
+                             "seekable file handle")
+        self.fh = fh
+        self._packer = p = msgpack.Packer(use_bin_type=True)
+        fh.write(p.pack_map_header(3) + p.pack('version') + p.pack(version)
+                 + p.pack('encoder') + p.pack(encoder)
+                 + p.pack('dataBlocks'))
+        self._blocks = self._start_array()
+        self._categories = None
+
+    def _start_array(self):
+        """Write an array header and return its position and size"""
+        pos = self.fh.tell()
+        self.fh.write(b'\xdd\x00\x00\x00\x00')
+        return [pos, 0]
+
+    def _end_array(self, array):
+        """Fill in the size of a previously-written array header"""
+        pos = self.fh.tell()
+        self.fh.seek(array[0] + 1)
+        self.fh.write(struct.pack('>I', array[1]))
+        self.fh.seek(pos)
+
+    def start_block(self, name):
+        if self._categories is not None:
+            self._end_array(self._categories)
+        p = self._packer
+        self._blocks[1] += 1
+        self.fh.write(p.pack_map_header(2) + p.pack('header') + p.pack(name)
+                      + p.pack('categories'))
+        self._categories = self._start_array()
+
+    def add_category(self, category):
+        self._categories[1] += 1
+        self.fh.write(self._packer.pack(category))
+
+    def finish(self):
+        if self._categories is not None:
+            self._end_array(self._categories)
+            self._categories = None
+        self._end_array(self._blocks)
+
+
 class BinaryCifWriter(ihm.format._Writer):
     """Write information to a BinaryCIF file. See :class:`ihm.format.CifWriter`
-       for more information. The constructor takes a single argument - a Python
-       filelike object, open for writing in binary mode."""
+       for more information. The constructor takes a Python
+       filelike object, open for writing in binary mode.
+
+       :param bool optimize: If True, for each column try a number of
+              different combinations of BinaryCIF encodings (Delta,
+              RunLength, IntegerPacking, FixedPoint) and use whichever
+              gives the smallest output. This gives smaller files, but is
+              slower. Floating point values are only written using
+              FixedPoint encoding if this does not lose any precision.
+       :param bool stream: If True, write each category to the file as
+              soon as it is complete, rather than keeping the entire
+              file in memory until :meth:`flush` is called. This needs
+              a seekable file handle.
+    """
 
     _mask_encoders = [_DeltaEncoder(), _RunLengthEncoder(),
                       _ByteArrayEncoder()]
 
-    def __init__(self, fh):
+    _encoder = 'python-ihm library'
+
+    def __init__(self, fh, optimize=False, stream=False):
         super(BinaryCifWriter, self).__init__(fh)
         self._blocks = []
-        self._masked_encoder = {str: _StringArrayMaskedEncoder(),
-                                int: _IntArrayMaskedEncoder(),
-                                float: _FloatArrayMaskedEncoder()}
+        self._optimize = optimize
+        self._stream = stream
+        self._msgpack_stream = None
+        self._masked_encoder = {str: _StringArrayMaskedEncoder(optimize),
+                                int: _IntArrayMaskedEncoder(optimize),
+                                float: _FloatArrayMaskedEncoder(optimize)}
 
     def category(self, category):
         """See :meth:`ihm.format.CifWriter.category`."""
@@ -608,11 +930,22 @@ class BinaryCifWriter(ihm.format._Writer):
         pass
 
     def _encode_data(self, data):
+        if _format is not None:
+            encoded = _format.bcif_encode_data(data, ihm.unknown,
+                                               self._optimize)
+            if encoded is not None:
+                return encoded
+        return self._encode_data_python(data)
+
+    def _encode_data_python(self, data):
         mask, typ = _get_mask_and_type(data)
         enc = self._masked_encoder[typ]
         encdata, encs = enc(data, mask)
         if mask:
-            data_mask, enc_mask = _encode(mask, self._mask_encoders)
+            if self._optimize:
+                data_mask, enc_mask = _encode_ints_smallest(mask)
+            else:
+                data_mask, enc_mask = _encode(mask, self._mask_encoders)
             mask = {'data': data_mask, 'encoding': enc_mask}
         return mask, encdata, encs
 
@@ -623,6 +956,9 @@ class BinaryCifWriter(ihm.format._Writer):
 
     def start_block(self, name):
         """See :meth:`ihm.format.CifWriter.start_block`."""
+        if self._stream:
+            self._get_msgpack_stream().start_block(name)
+            return
         block = {'header': name, 'categories': []}
         self._categories = block['categories']
         self._blocks.append(block)
@@ -640,12 +976,24 @@ class BinaryCifWriter(ihm.format._Writer):
             if row_count == 0:
                 return
             cols.append(self._encode_column(k, v))
-        self._categories.append({'name': category,
-                                 'columns': cols, 'rowCount': row_count})
+        category = {'name': category, 'columns': cols, 'rowCount': row_count}
+        if self._stream:
+            self._msgpack_stream.add_category(category)
+        else:
+            self._categories.append(category)
+
+    def _get_msgpack_stream(self):
+        if self._msgpack_stream is None:
+            self._msgpack_stream = _MsgPackStream(self.fh, ihm.__version__,
+                                                  self._encoder)
+        return self._msgpack_stream
 
     def flush(self):
+        if self._stream:
+            self._get_msgpack_stream().finish()
+            return
         data = {'version': ihm.__version__,
-                'encoder': 'python-ihm library',
+                'encoder': self._encoder,
                 'dataBlocks': self._blocks}
         self._write_msgpack(data)
 
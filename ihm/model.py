@@ -4,6 +4,7 @@
 
 import struct
 import itertools
+import array
 from ihm.util import _text_choice_property, _check_residue_range
 
 
@@ -32,6 +33,15 @@ class Sphere:
         self.x, self.y, self.z = x, y, z
         self.radius, self.rmsf = radius, rmsf
 
+    def __reduce_ex__(self, protocol):
+        # Pickle as a simple constructor call; this is much faster and more
+        # compact than the default for classes using __slots__ (subclasses
+        # may add extra attributes, so use the default for them)
+        if type(self) is not Sphere:
+            return super(Sphere, self).__reduce_ex__(protocol)
+        return (Sphere, (self.asym_unit, self.seq_id_range, self.x, self.y,
+                         self.z, self.radius, self.rmsf))
+
 
 class Atom:
     """Coordinates of part of the model represented by an atom.
@@ -74,6 +84,14 @@ class Atom:
         self.occupancy = occupancy
         self.alt_id = alt_id
 
+    def __reduce_ex__(self, protocol):
+        # See Sphere.__reduce_ex__
+        if type(self) is not Atom:
+            return super(Atom, self).__reduce_ex__(protocol)
+        return (Atom, (self.asym_unit, self.seq_id, self.atom_id,
+                       self.type_symbol, self.x, self.y, self.z, self.het,
+                       self.biso, self.occupancy, self.alt_id))
+
 
 class Model:
     """A single set of coordinates (conformation).
@@ -155,6 +173,251 @@ class Model:
         self._atoms.append(atom)
 
 
+class _DictColumn:
+    """A column of values stored compactly by keeping only one copy of
+       each distinct value, plus an array of indices into those values.
+       Values are compared by identity if `by_identity` is True, otherwise
+       by equality."""
+    __slots__ = ['values', 'indices', '_index', '_by_identity']
+
+    def __init__(self, by_identity=False):
+        self.values = []
+        self.indices = array.array('I')
+        self._index = {}
+        self._by_identity = by_identity
+
+    def _get_index(self, val):
+        key = id(val) if self._by_identity else val
+        ind = self._index.get(key)
+        if ind is None:
+            ind = self._index[key] = len(self.values)
+            self.values.append(val)
+        return ind
+
+    def append(self, val):
+        self.indices.append(self._get_index(val))
+
+    def extend(self, vals):
+        self.indices.extend(map(self._get_index, vals))
+
+    def __getitem__(self, i):
+        return self.values[self.indices[i]]
+
+    def __setitem__(self, i, val):
+        self.indices[i] = self._get_index(val)
+
+
+class _FloatColumn:
+    """A column of floating point values (or None, stored as NaN)"""
+    __slots__ = ['data']
+
+    def __init__(self):
+        self.data = array.array('d')
+
+    def append(self, val):
+        self.data.append(float('nan') if val is None else val)
+
+    def frombytes(self, raw):
+        self.data.frombytes(raw)
+
+    def __getitem__(self, i):
+        val = self.data[i]
+        return None if val != val else val
+
+    def __setitem__(self, i, val):
+        self.data[i] = float('nan') if val is None else val
+
+
+class _IntColumn:
+    """A column of integer values (or None)"""
+    __slots__ = ['data']
+    _none = -2 ** 63
+
+    def __init__(self):
+        self.data = array.array('q')
+
+    def append(self, val):
+        self.data.append(self._none if val is None else val)
+
+    def extend(self, vals):
+        none = self._none
+        self.data.extend(none if val is None else val for val in vals)
+
+    def __getitem__(self, i):
+        val = self.data[i]
+        return None if val == self._none else val
+
+    def __setitem__(self, i, val):
+        self.data[i] = self._none if val is None else val
+
+
+class _BoolColumn:
+    """A column of bool values"""
+    __slots__ = ['data']
+
+    def __init__(self):
+        self.data = array.array('b')
+
+    def append(self, val):
+        self.data.append(bool(val))
+
+    def extend(self, vals):
+        self.data.extend(map(bool, vals))
+
+    def __getitem__(self, i):
+        return bool(self.data[i])
+
+    def __setitem__(self, i, val):
+        self.data[i] = bool(val)
+
+
+class _RangeColumn:
+    """A column of (begin, end) integer tuples"""
+    __slots__ = ['begin', 'end']
+
+    def __init__(self):
+        self.begin = _IntColumn()
+        self.end = _IntColumn()
+
+    def append(self, val):
+        self.begin.append(val[0])
+        self.end.append(val[1])
+
+    def __getitem__(self, i):
+        return (self.begin[i], self.end[i])
+
+    def __setitem__(self, i, val):
+        self.begin[i], self.end[i] = val
+
+
+def _column_property(name):
+    def getter(self):
+        return getattr(self._columns, name)[self._index]
+
+    def setter(self, val):
+        getattr(self._columns, name)[self._index] = val
+    return property(getter, setter)
+
+
+class _ColumnAtom(Atom):
+    """An Atom whose data are stored in a ColumnarModel"""
+    __slots__ = ['_columns', '_index']
+
+    def __init__(self, columns, index):
+        self._columns, self._index = columns, index
+
+
+class _ColumnSphere(Sphere):
+    """A Sphere whose data are stored in a ColumnarModel"""
+    __slots__ = ['_columns', '_index']
+
+    def __init__(self, columns, index):
+        self._columns, self._index = columns, index
+
+
+for _cls in _ColumnAtom, _ColumnSphere:
+    for _name in _cls.__bases__[0].__slots__:
+        setattr(_cls, _name, _column_property(_name))
+
+
+class _Columns:
+    """Storage for a list of Atom or Sphere objects, as a set of columns.
+       This behaves like a list, but stores each attribute of the objects
+       in a separate column; objects returned are views into the columns.
+       Subclasses should set `_proxy` and provide a `_make_columns` method
+       that returns a dict of column objects, keyed by attribute name."""
+
+    def __init__(self):
+        self._appenders = []
+        for name, col in self._make_columns().items():
+            setattr(self, name, col)
+            self._appenders.append((name, col.append))
+        self._len = 0
+
+    def append(self, obj):
+        for name, append in self._appenders:
+            append(getattr(obj, name))
+        self._len += 1
+
+    def __len__(self):
+        return self._len
+
+    def __getitem__(self, i):
+        if i < 0:
+            i += self._len
+        if i < 0 or i >= self._len:
+            raise IndexError("index out of range")
+        return self._proxy(self, i)
+
+    def __iter__(self):
+        proxy = self._proxy
+        for i in range(self._len):
+            yield proxy(self, i)
+
+
+class _AtomColumns(_Columns):
+    _proxy = _ColumnAtom
+
+    def _make_columns(self):
+        return {'asym_unit': _DictColumn(by_identity=True),
+                'seq_id': _IntColumn(), 'atom_id': _DictColumn(),
+                'type_symbol': _DictColumn(), 'x': _FloatColumn(),
+                'y': _FloatColumn(), 'z': _FloatColumn(),
+                'het': _BoolColumn(), 'biso': _FloatColumn(),
+                'occupancy': _FloatColumn(), 'alt_id': _DictColumn()}
+
+    def _extend_raw(self, asym_unit, seq_id, atom_id, type_symbol, x, y, z,
+                    het, biso, occupancy, alt_id):
+        """Add many atoms at once, given a sequence of values for each
+           attribute, except that floating point attributes are given
+           as bytes of native doubles (as passed by the C parser)"""
+        for name, vals in (('asym_unit', asym_unit), ('seq_id', seq_id),
+                           ('atom_id', atom_id),
+                           ('type_symbol', type_symbol), ('het', het),
+                           ('alt_id', alt_id)):
+            getattr(self, name).extend(vals)
+        for name, raw in (('x', x), ('y', y), ('z', z), ('biso', biso),
+                          ('occupancy', occupancy)):
+            getattr(self, name).frombytes(raw)
+        self._len += len(atom_id)
+
+
+class _SphereColumns(_Columns):
+    _proxy = _ColumnSphere
+
+    def _make_columns(self):
+        return {'asym_unit': _DictColumn(by_identity=True),
+                'seq_id_range': _RangeColumn(), 'x': _FloatColumn(),
+                'y': _FloatColumn(), 'z': _FloatColumn(),
+                'radius': _FloatColumn(), 'rmsf': _FloatColumn()}
+
+
+class ColumnarModel(Model):
+    """A model that stores its atoms and spheres compactly.
+
+       This behaves like :class:`Model`, but rather than keeping a list of
+       :class:`Atom` and :class:`Sphere` objects, each attribute of the
+       atoms and spheres is stored in a separate typed array (coordinates,
+       B factors, occupancies and sequence IDs) or as indices into a list
+       of distinct values (asymmetric units, atom names, element names
+       and alternate conformation IDs). This uses much less memory than
+       :class:`Model` for large systems. :meth:`get_atoms` and
+       :meth:`get_spheres` return lightweight :class:`Atom` and
+       :class:`Sphere` objects that read from (and write to) this storage.
+
+       Floating point values (such as coordinates) are stored in double
+       precision; None is stored as NaN, so NaN values will be returned as
+       None. Sequence IDs must be integers or None.
+
+       To read files using this class, pass it to :func:`ihm.reader.read`
+       as the `model_class` argument.
+    """
+    def __init__(self, *args, **kwargs):
+        super(ColumnarModel, self).__init__(*args, **kwargs)
+        self._atoms = _AtomColumns()
+        self._spheres = _SphereColumns()
+
+
 class ModelGroup(list):
     """A set of related models. See :class:`Model`. It is implemented as
        a simple list of the models.
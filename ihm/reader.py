@@ -16,9 +16,22 @@ import ihm.source
 import ihm.cross_linkers
 import ihm.multi_state_scheme
 import ihm.flr
+import array
 import inspect
 import warnings
+import asyncio
 import collections
+import concurrent.futures
+import functools
+import hashlib
+import io
+import itertools
+import os
+import pickle
+import queue
+import tempfile
+import threading
+import time
 from . import util
 try:
     from . import _format
@@ -74,6 +87,16 @@ def _get_matrix33(d, key):
                 for i in (1, 2, 3)]
 
 
+def _get_raw_ints(raw):
+    """Return a list of ints from the native 64-bit ints passed by the C
+       parser for handlers with _raw_numeric_columns set, with None for
+       missing values"""
+    ints = array.array('q')
+    ints.frombytes(raw)
+    none = ihm.model._IntColumn._none
+    return [None if i == none else i for i in ints]
+
+
 class IDMapper:
     """Utility class to handle mapping from mmCIF IDs to Python objects.
 
@@ -948,6 +971,13 @@ class Handler:
         """Called at the end of each save frame."""
         pass
 
+    def _add_columns(self, *columns):
+        """Handle many rows at once, given a list of values for each
+           keyword. This is called by the C parser for handlers that use
+           `_format.add_columnar_category_handler`."""
+        for row in zip(*columns):
+            self(*row)
+
     def _get_asym_or_entity(self, asym_id, entity_id):
         """Return an :class:`AsymUnit`, or an :class:`Entity`
            if asym_id is omitted"""
@@ -2168,8 +2198,12 @@ class _SphereObjSiteHandler(Handler):
     category = '_ihm_sphere_obj_site'
     ignored_keywords = ['ordinal_id']
 
-    def __call__(self, model_id, asym_id, rmsf: float, seq_id_begin,
-                 seq_id_end, cartn_x, cartn_y, cartn_z, object_radius):
+    if _format is not None:
+        _add_c_handler = _format.add_columnar_category_handler
+
+    def __call__(self, model_id, asym_id, rmsf: float, seq_id_begin: int,
+                 seq_id_end: int, cartn_x: float, cartn_y: float,
+                 cartn_z: float, object_radius: float):
         model = self.sysr.models.get_by_id(model_id)
         asym = self.sysr.asym_units.get_by_id(asym_id)
         s = ihm.model.Sphere(
@@ -2182,11 +2216,23 @@ class _SphereObjSiteHandler(Handler):
 class _AtomSiteHandler(Handler):
     category = '_atom_site'
 
+    if _format is not None:
+        # Get the atoms of each model in separate _add_columns calls, so
+        # that the C parser does not buffer the entire category
+        _add_c_handler = _format.add_grouped_columnar_category_handler
+
     def __init__(self, *args):
         super(_AtomSiteHandler, self).__init__(*args)
         self._missing_sequence = collections.defaultdict(dict)
         # Mapping from asym+auth_seq_id to internal ID
         self._seq_id_map = {}
+        # ColumnarModel can take coordinates straight from the C parser's
+        # buffers, without making a Python float for each one
+        model_class = getattr(self.sysr.models, '_cls', None)
+        self._raw_numeric_columns = (
+            isinstance(model_class, type)
+            and issubclass(model_class, ihm.model.ColumnarModel)
+            and model_class.add_atom is ihm.model.Model.add_atom)
 
     def _get_seq_id_from_auth(self, auth_seq_id, pdbx_pdb_ins_code, asym):
         """Get an internal seq_id for something not a polymer (nonpolymer,
@@ -2208,46 +2254,92 @@ class _AtomSiteHandler(Handler):
             asym.auth_seq_id_map[seq_id] = (auth_seq_id, pdbx_pdb_ins_code)
         return m[auth]
 
-    def __call__(self, pdbx_pdb_model_num, label_asym_id,
-                 b_iso_or_equiv: float, label_seq_id: int, label_atom_id,
-                 type_symbol, cartn_x: float, cartn_y: float, cartn_z: float,
-                 occupancy: float, group_pdb, auth_seq_id, pdbx_pdb_ins_code,
-                 auth_asym_id, label_comp_id, label_alt_id):
-        # seq_id can be None for non-polymers (HETATM)
-        seq_id = label_seq_id
-        # todo: handle fields other than those output by us
-        model = self.sysr.models.get_by_id(pdbx_pdb_model_num)
+    def _get_residue(self, label_asym_id, label_seq_id, auth_seq_id,
+                     pdbx_pdb_ins_code, auth_asym_id, label_comp_id):
+        """Get the AsymUnit and our internal seq_id for an atom, noting
+           any missing sequence or author-provided numbering"""
         if label_asym_id is None:
             # If no asym_id is provided (e.g. minimal PyMOL output) then
             # use the author-provided ID instead
             asym = self.sysr.asym_units.get_by_id(auth_asym_id)
             # Chances are the entity_poly table is missing too, so remember
             # the comp_id to help us construct missing sequence info
-            self._missing_sequence[asym][seq_id] = label_comp_id
+            self._missing_sequence[asym][label_seq_id] = label_comp_id
         else:
             asym = self.sysr.asym_units.get_by_id(label_asym_id)
         auth_seq_id = self.get_int_or_string(auth_seq_id)
-        if seq_id is None:
+        # seq_id can be None for non-polymers (HETATM)
+        if label_seq_id is None:
             # Fill in our internal seq_id using author-provided info
-            our_seq_id = self._get_seq_id_from_auth(
+            return asym, self._get_seq_id_from_auth(
                 auth_seq_id, pdbx_pdb_ins_code, asym)
-        else:
-            our_seq_id = seq_id
+        # Note any residues that have different seq_id and auth_seq_id
+        if (auth_seq_id is not None and
+                (label_seq_id != auth_seq_id
+                 or pdbx_pdb_ins_code not in (None, ihm.unknown))):
+            if asym.auth_seq_id_map == 0:
+                asym.auth_seq_id_map = {}
+            asym.auth_seq_id_map[label_seq_id] = (auth_seq_id,
+                                                  pdbx_pdb_ins_code)
+        return asym, label_seq_id
+
+    def _iter_residues(self, *columns):
+        """Yield the result of _get_residue for each row, given a list
+           of values for each of its arguments. Consecutive atoms in
+           the same residue are only looked up once."""
+        last_key = res = None
+        for key in zip(*columns):
+            if key != last_key:
+                res = self._get_residue(*key)
+                last_key = key
+            yield res
+
+    def __call__(self, pdbx_pdb_model_num, label_asym_id,
+                 b_iso_or_equiv: float, label_seq_id: int, label_atom_id,
+                 type_symbol, cartn_x: float, cartn_y: float, cartn_z: float,
+                 occupancy: float, group_pdb, auth_seq_id, pdbx_pdb_ins_code,
+                 auth_asym_id, label_comp_id, label_alt_id):
+        # todo: handle fields other than those output by us
+        model = self.sysr.models.get_by_id(pdbx_pdb_model_num)
+        asym, seq_id = self._get_residue(
+            label_asym_id, label_seq_id, auth_seq_id, pdbx_pdb_ins_code,
+            auth_asym_id, label_comp_id)
         group = 'ATOM' if group_pdb is None else group_pdb
         a = ihm.model.Atom(
-            asym_unit=asym, seq_id=our_seq_id, atom_id=label_atom_id,
+            asym_unit=asym, seq_id=seq_id, atom_id=label_atom_id,
             type_symbol=type_symbol, x=cartn_x, y=cartn_y,
             z=cartn_z, het=group != 'ATOM', biso=b_iso_or_equiv,
             occupancy=occupancy, alt_id=label_alt_id)
         model.add_atom(a)
 
-        # Note any residues that have different seq_id and auth_seq_id
-        if (auth_seq_id is not None and seq_id is not None and
-                (seq_id != auth_seq_id
-                 or pdbx_pdb_ins_code not in (None, ihm.unknown))):
-            if asym.auth_seq_id_map == 0:
-                asym.auth_seq_id_map = {}
-            asym.auth_seq_id_map[seq_id] = auth_seq_id, pdbx_pdb_ins_code
+    def _add_columns(self, pdbx_pdb_model_num, label_asym_id, b_iso_or_equiv,
+                     label_seq_id, label_atom_id, type_symbol, cartn_x,
+                     cartn_y, cartn_z, occupancy, group_pdb, auth_seq_id,
+                     pdbx_pdb_ins_code, auth_asym_id, label_comp_id,
+                     label_alt_id):
+        # Equivalent to calling __call__ for each row; the C parser
+        # only passes atoms from a single model in each call
+        model = self.sysr.models.get_by_id(pdbx_pdb_model_num[0])
+        if self._raw_numeric_columns:
+            label_seq_id = _get_raw_ints(label_seq_id)
+        residues = self._iter_residues(
+            label_asym_id, label_seq_id, auth_seq_id, pdbx_pdb_ins_code,
+            auth_asym_id, label_comp_id)
+        het = [group is not None and group != 'ATOM' for group in group_pdb]
+        if self._raw_numeric_columns:
+            asyms, seq_ids = zip(*residues)
+            model._atoms._extend_raw(
+                asyms, seq_ids, label_atom_id, type_symbol, cartn_x, cartn_y,
+                cartn_z, het, b_iso_or_equiv, occupancy, label_alt_id)
+        else:
+            add_atom = model.add_atom
+            Atom = ihm.model.Atom
+            for ((asym, seq_id), atom_id, symbol, x, y, z, h, biso, occ,
+                 alt_id) in zip(residues, label_atom_id, type_symbol, cartn_x,
+                                cartn_y, cartn_z, het, b_iso_or_equiv,
+                                occupancy, label_alt_id):
+                add_atom(Atom(asym, seq_id, atom_id, symbol, x, y, z, h,
+                              biso, occ, alt_id))
 
     def finalize(self):
         # Fill in missing Entity information from comp_ids
@@ -2269,6 +2361,66 @@ class _AtomSiteHandler(Handler):
                     self.system.entities.append(asym.entity)
 
 
+class _LazyAtomSiteHandler(Handler):
+    """Create the models referenced by _atom_site without reading
+       any coordinates (used by read() with lazy_coordinates)"""
+    category = '_atom_site'
+
+    if _format is not None:
+        _add_c_handler = _format.add_columnar_category_handler
+
+    def __call__(self, pdbx_pdb_model_num):
+        self.sysr.models.get_by_id(pdbx_pdb_model_num)
+
+    def _add_columns(self, pdbx_pdb_model_num):
+        for model_num in dict.fromkeys(pdbx_pdb_model_num):
+            self.sysr.models.get_by_id(model_num)
+
+
+class _ModelIterAtomSiteHandler(_AtomSiteHandler):
+    """Read _atom_site as for _AtomSiteHandler, but call `model_done`
+       with each model once all of its atoms have been read
+       (used by :func:`iter_models`)"""
+
+    def __init__(self, sysr, model_done):
+        super(_ModelIterAtomSiteHandler, self).__init__(sysr)
+        self._model_done = model_done
+        self._no_model = self._model_num = object()
+
+    def _finish_model(self):
+        if self._model_num is not self._no_model:
+            model = self.sysr.models.get_by_id(self._model_num)
+            self._model_num = self._no_model
+            self._model_done(model)
+
+    def __call__(self, pdbx_pdb_model_num, label_asym_id,
+                 b_iso_or_equiv: float, label_seq_id: int, label_atom_id,
+                 type_symbol, cartn_x: float, cartn_y: float, cartn_z: float,
+                 occupancy: float, group_pdb, auth_seq_id, pdbx_pdb_ins_code,
+                 auth_asym_id, label_comp_id, label_alt_id):
+        if pdbx_pdb_model_num != self._model_num:
+            self._finish_model()
+            self._model_num = pdbx_pdb_model_num
+        super(_ModelIterAtomSiteHandler, self).__call__(
+            pdbx_pdb_model_num, label_asym_id, b_iso_or_equiv, label_seq_id,
+            label_atom_id, type_symbol, cartn_x, cartn_y, cartn_z,
+            occupancy, group_pdb, auth_seq_id, pdbx_pdb_ins_code,
+            auth_asym_id, label_comp_id, label_alt_id)
+
+    def _add_columns(self, pdbx_pdb_model_num, *columns):
+        # The C parser never passes atoms from more than one model in
+        # a call, but may split a large model over several calls
+        if pdbx_pdb_model_num[0] != self._model_num:
+            self._finish_model()
+            self._model_num = pdbx_pdb_model_num[0]
+        super(_ModelIterAtomSiteHandler, self)._add_columns(
+            pdbx_pdb_model_num, *columns)
+
+    def finalize(self):
+        self._finish_model()
+        super(_ModelIterAtomSiteHandler, self).finalize()
+
+
 class _StartingModelCoordHandler(Handler):
     category = '_ihm_starting_model_coord'
 
@@ -3054,8 +3206,10 @@ class _UnknownCategoryHandler:
     def __init__(self):
         self.reset()
 
-    def reset(self):
-        self._seen_categories = set()
+    def reset(self, ignored=()):
+        # Don't warn about categories in `ignored` (e.g. those not read yet
+        # due to lazy_coordinates)
+        self._seen_categories = set(ignored)
 
     def __call__(self, catname, line):
         # Only warn about a given category once
@@ -3068,13 +3222,17 @@ class _UnknownCategoryHandler:
 
 
 class _UnknownKeywordHandler:
-    def add_category_handlers(self, handlers):
+    def add_category_handlers(self, handlers, ignored_categories=()):
         self._ignored_keywords = dict((h.category,
                                        frozenset(h.ignored_keywords))
                                       for h in handlers)
+        # Don't warn about any keywords in `ignored_categories` (e.g.
+        # those only partly read due to lazy_coordinates)
+        self._ignored_categories = frozenset(ignored_categories)
 
     def __call__(self, catname, keyname, line):
-        if keyname in self._ignored_keywords[catname]:
+        if (catname in self._ignored_categories
+                or keyname in self._ignored_keywords[catname]):
             return
         warnings.warn("Unknown keyword %s.%s encountered%s - will be ignored"
                       % (catname, keyname,
@@ -3886,12 +4044,369 @@ class IHMVariant(Variant):
         return _AuditConformHandler(sysr)
 
 
+#: Categories that are not read until needed if read() is given
+#: lazy_coordinates=True. This includes the scheme tables as their
+#: finalization depends on the contents of _atom_site.
+_LAZY_CATEGORIES = frozenset(('_atom_site', '_ihm_sphere_obj_site',
+                              '_ihm_starting_model_coord',
+                              '_pdbx_poly_seq_scheme', '_pdbx_nonpoly_scheme',
+                              '_pdbx_branch_scheme'))
+
+
+class _LazyCoordinates:
+    """Placeholder for the atoms or spheres of a model (or starting model)
+       read with lazy_coordinates. The real coordinates are read in the
+       first time this is used."""
+
+    def __init__(self, loader, obj, attr):
+        self._loader, self._obj, self._attr = loader, obj, attr
+        self._real = getattr(obj, attr)
+        setattr(obj, attr, self)
+
+    def _restore(self):
+        setattr(self._obj, self._attr, self._real)
+
+    def _load(self):
+        self._loader.load()
+        return getattr(self._obj, self._attr)
+
+    def __iter__(self):
+        return iter(self._load())
+
+    def __len__(self):
+        return len(self._load())
+
+    def __getitem__(self, key):
+        return self._load()[key]
+
+    def append(self, obj):
+        self._load().append(obj)
+
+
+class _CoordinateLoader:
+    """Read the categories that were skipped by read() with
+       lazy_coordinates=True for a single data block"""
+
+    def __init__(self, source, format, block, sysr, handlers,
+                 warn_unknown_keyword):
+        self._source, self._format, self._block = source, format, block
+        self._sysr, self._handlers = sysr, handlers
+        self._warn_unknown_keyword = warn_unknown_keyword
+        self._placeholders = []
+        for m in sysr.models.get_all():
+            self._placeholders.append(_LazyCoordinates(self, m, '_atoms'))
+            self._placeholders.append(_LazyCoordinates(self, m, '_spheres'))
+        if any(h.category == '_ihm_starting_model_coord' for h in handlers):
+            for m in sysr.starting_models.get_all():
+                self._placeholders.append(
+                    _LazyCoordinates(self, m, '_atoms'))
+        sysr.system._coordinate_loader = self
+
+    def load(self):
+        sysr = self._sysr
+        if sysr is None:
+            return
+        self._sysr = None
+        del sysr.system._coordinate_loader
+        for p in self._placeholders:
+            p._restore()
+        # Entities with no sequence may be filled in by the scheme handlers
+        for e in sysr.system.entities:
+            if len(e.sequence) == 0:
+                e.sequence = []
+        ukhandler = None
+        if self._warn_unknown_keyword:
+            ukhandler = _UnknownKeywordHandler()
+            ukhandler.add_category_handlers(self._handlers)
+        fh = self._source.open()
+        try:
+            r = _reader_map[self._format](fh, {},
+                                          unknown_keyword_handler=ukhandler)
+            # Skip any preceding data blocks
+            for i in range(self._block):
+                r.read_file()
+            r.category_handler = dict((h.category, h) for h in self._handlers)
+            r.read_file()
+        finally:
+            self._source.close(fh)
+        for h in self._handlers:
+            h.finalize()
+        sysr.finalize()
+        _finalize_entities(sysr.system)
+
+
+class _LazySource:
+    """Reopen a file read with lazy_coordinates=True at the same
+       position, either by name for plain files or, for anything else
+       (e.g. in-memory or compressed files), by seeking the original
+       file handle"""
+
+    def __init__(self, fh):
+        if hasattr(fh, 'seekable') and not fh.seekable():
+            raise ValueError("lazy_coordinates requires a seekable file")
+        self._pos = fh.tell()
+        name = getattr(fh, 'name', None)
+        if (isinstance(name, str)
+                and isinstance(ihm.format._get_raw_file(fh), io.FileIO)):
+            self._fh = None
+            self._name = name
+            self._text = isinstance(fh, io.TextIOBase)
+            self._encoding = getattr(fh, 'encoding', None)
+            self._errors = getattr(fh, 'errors', None)
+        else:
+            self._fh = fh
+
+    def open(self):
+        if self._fh is not None:
+            fh = self._fh
+        elif self._text:
+            fh = open(self._name, encoding=self._encoding,
+                      errors=self._errors)
+        else:
+            fh = open(self._name, 'rb')
+        fh.seek(self._pos)
+        return fh
+
+    def close(self, fh):
+        if fh is not self._fh:
+            fh.close()
+
+
+def load_coordinates(system):
+    """Read any coordinates that have not yet been read for a System.
+
+       This is only needed for systems read by :func:`read` with
+       `lazy_coordinates` set; it reads the coordinates and residue
+       numbering information immediately rather than waiting until they
+       are first used. It does nothing if the system has no such
+       coordinates (e.g. it was not read with `lazy_coordinates`, or they
+       have already been read).
+
+       :param system: The system to read coordinates for.
+       :type system: :class:`ihm.System`
+    """
+    loader = getattr(system, '_coordinate_loader', None)
+    if loader is not None:
+        loader.load()
+
+
+_reader_map = {'mmCIF': ihm.format.CifReader,
+               'BCIF': ihm.format_bcif.BinaryCifReader}
+
+
+def _get_cache_option(value):
+    """Get a representation of a read() option for the cache key"""
+    if isinstance(value, (list, tuple)):
+        return tuple(_get_cache_option(v) for v in value)
+    elif isinstance(value, functools.partial):
+        return (_get_cache_option(value.func),
+                _get_cache_option(value.args),
+                tuple(sorted((k, _get_cache_option(v))
+                             for k, v in value.keywords.items())))
+    elif isinstance(value, type):
+        return value.__module__ + '.' + value.__qualname__
+    elif isinstance(value, Variant):
+        return _get_cache_option(type(value))
+    else:
+        return repr(value)
+
+
+def _get_cache_key(contents, format, options):
+    """Get a key for the read() cache from the file contents and options"""
+    h = hashlib.sha256()
+    if isinstance(contents, str):
+        contents = contents.encode('utf-8', 'surrogatepass')
+    h.update(contents)
+    # Progress reporting doesn't affect the result
+    key = (ihm.__version__, pickle.HIGHEST_PROTOCOL, format,
+           tuple(sorted((k, _get_cache_option(v))
+                        for k, v in options.items()
+                        if k not in ('progress', 'progress_interval'))))
+    h.update(repr(key).encode('utf-8'))
+    return h.hexdigest()
+
+
+def _read_with_cache(fh, cache_dir, format, options):
+    """Read from the file handle `fh`, using a cached result in
+       `cache_dir` if available (see :func:`read`)"""
+    if options['add_to_system'] or options['lazy_coordinates']:
+        raise ValueError("cache_dir cannot be combined with add_to_system "
+                         "or lazy_coordinates")
+    contents = fh.read()
+    cache_file = os.path.join(cache_dir,
+                              _get_cache_key(contents, format, options)
+                              + '.pickle')
+    try:
+        with open(cache_file, 'rb') as cfh:
+            return pickle.load(cfh)
+    except FileNotFoundError:
+        pass
+    except Exception as exc:
+        # Ignore cache files that are corrupt or cannot be unpickled
+        # (e.g. if a handler class no longer exists); just reread the file
+        warnings.warn("Could not read cache file %s: %s" % (cache_file, exc))
+
+    if isinstance(contents, str):
+        systems = read(io.StringIO(contents), format=format, **options)
+    else:
+        systems = read(io.BytesIO(contents), format=format, **options)
+
+    # Write to a temporary file first, so that other processes never
+    # see a partially-written cache file
+    tmpname = None
+    try:
+        os.makedirs(cache_dir, exist_ok=True)
+        with tempfile.NamedTemporaryFile(dir=cache_dir, suffix='.tmp',
+                                         delete=False) as tfh:
+            tmpname = tfh.name
+            pickle.dump(systems, tfh, protocol=pickle.HIGHEST_PROTOCOL)
+        os.replace(tmpname, cache_file)
+    except Exception as exc:
+        if tmpname is not None and os.path.exists(tmpname):
+            os.unlink(tmpname)
+        warnings.warn("Could not write cache file %s: %s" % (cache_file, exc))
+    return systems
+
+
+class HandlerTiming:
+    """Time spent in a single :class:`Handler` subclass while reading a
+       file. See :class:`ReadProfile`. All times are in seconds."""
+
+    def __init__(self, handler_class):
+        #: The :class:`Handler` subclass
+        self.handler_class = handler_class
+        #: The mmCIF category handled
+        self.category = handler_class.category
+        #: The number of times the handler was called with data
+        #: (once per row, or once per batch of rows for handlers that
+        #: handle many rows at once)
+        self.calls = 0
+        #: The number of rows of data passed to the handler
+        self.rows = 0
+        #: Time spent handling data
+        self.call_time = 0.
+        #: Time spent in :meth:`Handler.finalize`
+        self.finalize_time = 0.
+        #: Time spent in :meth:`Handler.end_save_frame`
+        self.end_save_frame_time = 0.
+
+    total_time = property(
+        lambda self: self.call_time + self.finalize_time
+        + self.end_save_frame_time,
+        doc="Total time spent in the handler")
+
+
+class ReadProfile:
+    """Record the time spent in each :class:`Handler` while reading a file.
+       Pass an instance of this class as the `profile` argument to
+       :func:`read` to fill it in, e.g.::
+
+           profile = ihm.reader.ReadProfile()
+           systems = ihm.reader.read(fh, profile=profile)
+           print(profile)
+
+       If the same profile is used for multiple reads, times accumulate.
+    """
+
+    def __init__(self):
+        #: A dict of :class:`HandlerTiming` objects, keyed by
+        #: :class:`Handler` subclass. Times for each subclass are summed
+        #: over all data blocks in the file.
+        self.handlers = {}
+        #: Time spent finalizing each :class:`SystemReader` (e.g. to fill
+        #: in objects only referenced by ID) once all handlers are done
+        self.system_finalize_time = 0.
+        #: Statistics from the underlying file reader for the last file
+        #: read, as an :class:`ihm.format.ReaderStats` object (or `None`
+        #: if the C extension is not available). Its `callback_time`
+        #: includes the time spent in handlers.
+        self.reader_stats = None
+
+    def _get_timing(self, handler):
+        cls = type(handler)
+        timing = self.handlers.get(cls)
+        if timing is None:
+            timing = self.handlers[cls] = HandlerTiming(cls)
+        return timing
+
+    def get_sorted(self):
+        """Get all :class:`HandlerTiming` objects, slowest first"""
+        return sorted(self.handlers.values(), key=lambda t: t.total_time,
+                      reverse=True)
+
+    def __str__(self):
+        timings = self.get_sorted()
+        hwidth = max([len("Handler")] + [len(t.handler_class.__name__)
+                                         for t in timings])
+        cwidth = max([len("Category")] + [len(t.category) for t in timings])
+        lines = ["%-*s %-*s %9s %9s %9s %9s"
+                 % (hwidth, "Handler", cwidth, "Category", "Rows",
+                    "Call(s)", "Final(s)", "Total(s)")]
+        for t in timings:
+            lines.append("%-*s %-*s %9d %9.3f %9.3f %9.3f"
+                         % (hwidth, t.handler_class.__name__, cwidth,
+                            t.category, t.rows, t.call_time,
+                            t.finalize_time + t.end_save_frame_time,
+                            t.total_time))
+        lines.append("SystemReader finalize: %.3fs"
+                     % self.system_finalize_time)
+        return "\n".join(lines)
+
+
+class _ProfiledHandler:
+    """Wrap a Handler, recording the time spent in it in a HandlerTiming"""
+
+    def __init__(self, handler, timing):
+        # Get keywords from the original handler's __call__ signature,
+        # since ours takes any arguments
+        ihm.format._add_handler_keys(handler)
+        self._handler, self._timing = handler, timing
+
+    def __getattr__(self, name):
+        return getattr(self._handler, name)
+
+    def __call__(self, *args):
+        start = time.perf_counter()
+        try:
+            return self._handler(*args)
+        finally:
+            t = self._timing
+            t.call_time += time.perf_counter() - start
+            t.calls += 1
+            t.rows += 1
+
+    def _add_columns(self, *columns):
+        start = time.perf_counter()
+        try:
+            return self._handler._add_columns(*columns)
+        finally:
+            t = self._timing
+            t.call_time += time.perf_counter() - start
+            t.calls += 1
+            t.rows += len(columns[0]) if columns else 0
+
+    def finalize(self):
+        start = time.perf_counter()
+        try:
+            return self._handler.finalize()
+        finally:
+            self._timing.finalize_time += time.perf_counter() - start
+
+    def end_save_frame(self):
+        start = time.perf_counter()
+        try:
+            return self._handler.end_save_frame()
+        finally:
+            self._timing.end_save_frame_time += time.perf_counter() - start
+
+
 def read(fh, model_class=ihm.model.Model, format='mmCIF', handlers=[],
          warn_unknown_category=False, warn_unknown_keyword=False,
          read_starting_model_coord=True,
          starting_model_class=ihm.startmodel.StartingModel,
          reject_old_file=False, variant=IHMVariant,
-         add_to_system=None):
+         add_to_system=None, lazy_coordinates=False, cache_dir=None,
+         profile=None, progress=None, progress_interval=4194304):
     """Read data from the file handle `fh`.
 
        Note that the reader currently expects to see a file compliant
@@ -3973,43 +4488,448 @@ def read(fh, model_class=ihm.model.Model, format='mmCIF', handlers=[],
               where the data are split between multiple files) so cannot be
               used to combine two disparate mmCIF files into one.
        :type add_to_system: :class:`ihm.System`
+       :param bool lazy_coordinates: If True, don't read coordinates
+              (``_atom_site``, ``_ihm_sphere_obj_site`` and
+              ``_ihm_starting_model_coord``) immediately. Instead, they are
+              read from the file the first time the atoms or spheres of any
+              model (or the atoms of any starting model) in the system are
+              used, or when :func:`load_coordinates` is called. This makes
+              reading much faster if only other information is needed.
+              The file must be seekable and, if not an in-memory file,
+              must still exist at the same path when the coordinates are
+              read. Residue numbering information (the
+              ``_pdbx_*_scheme`` tables, which are stored in attributes
+              such as :attr:`ihm.AsymUnit.auth_seq_id_map`) depends on the
+              coordinates and so is read at the same time. Models must
+              store their atoms and spheres in the same way as
+              :class:`ihm.model.Model`.
+       :param str cache_dir: If given, a directory in which to cache the
+              result of reading the file. The first time a given file is
+              read, the resulting :class:`ihm.System` objects are stored
+              (using :mod:`pickle`) in this directory; subsequent reads of
+              a file with identical contents, using the same options and
+              version of this library, load the stored objects rather than
+              parsing the file again. (Warnings, such as those requested
+              by `warn_unknown_category`, are only emitted the first time.)
+              Any classes used (e.g. `model_class` or `handlers`) must be
+              importable, and the directory should not be writable by
+              untrusted users. This cannot be combined with `add_to_system`
+              or `lazy_coordinates`.
+       :param profile: If given, record the number of rows passed to,
+              and the time spent in, each :class:`Handler` in this
+              object (this slows down reading somewhat). Coordinates
+              read later due to `lazy_coordinates` are not included.
+              This cannot be combined with `cache_dir`.
+       :type profile: :class:`ReadProfile`
+       :param progress: If given, a callable that is periodically called
+              while the file is read, whenever at least `progress_interval`
+              more bytes have been read. It is given four arguments: the
+              number of bytes read so far, the total size of the file in
+              bytes (or `None` if not known, e.g. for compressed files),
+              the number of rows of data read so far, and the name of the
+              category most recently read. Progress is only reported by
+              the C-accelerated reader.
+              See :meth:`ihm.format.CifReader.set_progress_handler`.
+       :param int progress_interval: The minimum number of bytes to read
+              between calls to `progress`.
        :return: A list of :class:`ihm.System` objects.
     """
-    if isinstance(variant, type):
-        variant = variant()
-    systems = []
-    reader_map = {'mmCIF': ihm.format.CifReader,
-                  'BCIF': ihm.format_bcif.BinaryCifReader}
-
-    uchandler = _UnknownCategoryHandler() if warn_unknown_category else None
-    ukhandler = _UnknownKeywordHandler() if warn_unknown_keyword else None
-
-    r = reader_map[format](fh, {}, unknown_category_handler=uchandler,
-                           unknown_keyword_handler=ukhandler)
-    while True:
+    if cache_dir is not None:
+        if profile is not None:
+            raise ValueError("cache_dir cannot be combined with profile")
+        return _read_with_cache(
+            fh, cache_dir, format,
+            dict(model_class=model_class, handlers=handlers,
+                 warn_unknown_category=warn_unknown_category,
+                 warn_unknown_keyword=warn_unknown_keyword,
+                 read_starting_model_coord=read_starting_model_coord,
+                 starting_model_class=starting_model_class,
+                 reject_old_file=reject_old_file, variant=variant,
+                 add_to_system=add_to_system,
+                 lazy_coordinates=lazy_coordinates, progress=progress,
+                 progress_interval=progress_interval))
+    source = None
+    if lazy_coordinates:
         if add_to_system:
-            s = variant.system_reader(model_class, starting_model_class,
-                                      system=add_to_system)
+            raise ValueError("add_to_system cannot be combined with "
+                             "lazy_coordinates")
+        source = _LazySource(fh)
+
+    blocks = _BlockReader(fh, format, model_class, handlers,
+                          warn_unknown_category, warn_unknown_keyword,
+                          read_starting_model_coord, starting_model_class,
+                          reject_old_file, variant, add_to_system, source,
+                          profile, progress, progress_interval)
+    while True:
+        blocks.start_block()
+        more_data = blocks.reader.read_file()
+        blocks.end_block()
+        if not more_data:
+            break
+    blocks.end_file()
+
+    return blocks.systems
+
+
+class _BlockReader:
+    """Set up the handlers for each data block in a file, and make a
+       System from each block once it has been read (used by read and
+       read_async)"""
+
+    def __init__(self, fh, format, model_class, handlers,
+                 warn_unknown_category, warn_unknown_keyword,
+                 read_starting_model_coord, starting_model_class,
+                 reject_old_file, variant, add_to_system, lazy_source,
+                 profile, progress, progress_interval):
+        if isinstance(variant, type):
+            variant = variant()
+        self.format, self.model_class = format, model_class
+        self.handlers, self.variant = handlers, variant
+        self.warn_unknown_keyword = warn_unknown_keyword
+        self.read_starting_model_coord = read_starting_model_coord
+        self.starting_model_class = starting_model_class
+        self.reject_old_file = reject_old_file
+        self.add_to_system, self.lazy_source = add_to_system, lazy_source
+        self.systems = []
+        self.profile = profile
+
+        self.uchandler = _UnknownCategoryHandler() \
+            if warn_unknown_category else None
+        self.ukhandler = _UnknownKeywordHandler() \
+            if warn_unknown_keyword else None
+        self.reader = _reader_map[format](
+            fh, {}, unknown_category_handler=self.uchandler,
+            unknown_keyword_handler=self.ukhandler)
+        if profile is not None:
+            self.reader.set_timing(True)
+        if progress is not None:
+            self.reader.set_progress_handler(progress, progress_interval)
+
+    def start_block(self):
+        """Set up the reader's handlers for the next data block"""
+        variant = self.variant
+        if self.add_to_system:
+            s = variant.system_reader(self.model_class,
+                                      self.starting_model_class,
+                                      system=self.add_to_system)
         else:
             # e.g. older ModelCIF's SystemReader doesn't support add_to_system
-            s = variant.system_reader(model_class, starting_model_class)
-        hs = variant.get_handlers(s) + [h(s) for h in handlers]
-        if reject_old_file:
+            s = variant.system_reader(self.model_class,
+                                      self.starting_model_class)
+        hs = variant.get_handlers(s) + [h(s) for h in self.handlers]
+        if self.reject_old_file:
             hs.append(variant.get_audit_conform_handler(s))
-        if read_starting_model_coord:
+        if self.read_starting_model_coord:
             hs.append(_StartingModelCoordHandler(s))
-        if uchandler:
-            uchandler.reset()
-        if ukhandler:
-            ukhandler.add_category_handlers(hs)
-        r.category_handler = dict((h.category, h) for h in hs)
-        more_data = r.read_file()
-        for h in hs:
+        lazy_hs = []
+        if self.lazy_source:
+            lazy_hs = [h for h in hs if h.category in _LAZY_CATEGORIES]
+            hs = [h for h in hs if h.category not in _LAZY_CATEGORIES]
+            # We still need to know which models are in the file
+            hs.append(_LazyAtomSiteHandler(s))
+        if self.profile is not None:
+            hs = [_ProfiledHandler(h, self.profile._get_timing(h))
+                  for h in hs]
+        if self.uchandler:
+            self.uchandler.reset(
+                ignored=_LAZY_CATEGORIES if lazy_hs else ())
+        if self.ukhandler:
+            self.ukhandler.add_category_handlers(
+                hs, ignored_categories=_LAZY_CATEGORIES if lazy_hs else ())
+        self.reader.category_handler = dict((h.category, h) for h in hs)
+        self._sysr, self._hs, self._lazy_hs = s, hs, lazy_hs
+
+    def end_block(self):
+        """Make a System from the data block that was just read"""
+        s = self._sysr
+        for h in self._hs:
             h.finalize()
+        start = time.perf_counter()
         s.finalize()
         _finalize_entities(s.system)
-        systems.append(s.system)
-        if not more_data:
+        if self.profile is not None:
+            self.profile.system_finalize_time += time.perf_counter() - start
+        if self._lazy_hs:
+            _CoordinateLoader(self.lazy_source, self.format,
+                              len(self.systems), s, self._lazy_hs,
+                              self.warn_unknown_keyword)
+        self.systems.append(s.system)
+
+    def end_file(self):
+        """Record reader statistics once the whole file has been read"""
+        if self.profile is not None:
+            self.profile.reader_stats = self.reader.get_stats()
+
+
+async def read_async(stream, format='mmCIF', chunk_size=65536, **kwargs):
+    """Read data from `stream` without blocking the asyncio event loop.
+
+       This is an asynchronous version of :func:`read`, for use in
+       coroutines, e.g.::
+
+           reader, writer = await asyncio.open_connection(host, port)
+           systems = await ihm.reader.read_async(reader)
+
+       The stream is read `chunk_size` bytes (or characters) at a time.
+       The data are parsed, and category handlers run, in a separate
+       thread, so other tasks continue to run while a large file is read.
+       With the C-accelerated parser, data are parsed as each chunk
+       arrives (for BinaryCIF, each category is decoded once all of its
+       data have arrived); otherwise, all of the data are collected
+       first and then parsed.
+
+       :param stream: The stream to read from. This can be an
+              :class:`asyncio.StreamReader` (or any other object with a
+              ``read(n)`` coroutine method) or a regular file handle. It
+              can return either strings or bytes; for mmCIF, bytes are
+              treated as UTF-8.
+       :param str format: The format of the file, 'mmCIF' (the default)
+              or 'BCIF'.
+       :param int chunk_size: The most data to read (and parse) at a time.
+       :param kwargs: Any other arguments are passed to :func:`read`,
+              except for `lazy_coordinates` and `cache_dir`, which are not
+              supported.
+       :return: A list of :class:`ihm.System` objects.
+    """
+    if kwargs.get('lazy_coordinates') or kwargs.get('cache_dir') is not None:
+        raise ValueError("lazy_coordinates and cache_dir are not supported "
+                         "by read_async")
+    # Check arguments and fill in defaults
+    args = inspect.signature(read).bind(stream, format=format, **kwargs)
+    args.apply_defaults()
+    args = args.arguments
+
+    async def get_chunk():
+        data = stream.read(chunk_size)
+        if inspect.isawaitable(data):
+            return await data
+        else:
+            # Let other tasks run between reads from a regular file
+            await asyncio.sleep(0)
+            return data
+
+    blocks = _BlockReader(None, format, args['model_class'],
+                          args['handlers'], args['warn_unknown_category'],
+                          args['warn_unknown_keyword'],
+                          args['read_starting_model_coord'],
+                          args['starting_model_class'],
+                          args['reject_old_file'], args['variant'],
+                          args['add_to_system'], None, args['profile'],
+                          args['progress'], args['progress_interval'])
+    r = blocks.reader
+
+    def feed(chunk):
+        while r.feed(chunk):
+            # Parse any remaining data as part of the next block
+            blocks.end_block()
+            blocks.start_block()
+            chunk = chunk[:0]
+
+    def finish():
+        while r.finish():
+            blocks.end_block()
+            blocks.start_block()
+        blocks.end_block()
+        blocks.end_file()
+
+    # Parse each chunk (and make each System) in a separate thread, so that
+    # the event loop is not blocked while a large category is decoded or
+    # handled. Only one chunk is parsed at a time, so the handlers never
+    # run concurrently.
+    loop = asyncio.get_running_loop()
+    await loop.run_in_executor(None, blocks.start_block)
+    while True:
+        chunk = await get_chunk()
+        if not chunk:
             break
+        await loop.run_in_executor(None, feed, chunk)
+    await loop.run_in_executor(None, finish)
+    return blocks.systems
+
+
+def _read_many_file(fname, format, kwargs):
+    """Read a single file for read_many (this usually runs in
+       a worker process)"""
+    if format is None:
+        format = 'BCIF' if fname.endswith('.bcif') else 'mmCIF'
+    if format == 'BCIF':
+        with open(fname, 'rb') as fh:
+            return read(fh, format=format, **kwargs)
+    try:
+        with open(fname, encoding='utf-8') as fh:
+            return read(fh, format=format, **kwargs)
+    except UnicodeDecodeError:
+        with open(fname, encoding='latin-1') as fh:
+            return read(fh, format=format, **kwargs)
+
+
+def read_many(filenames, workers=None, format=None, **kwargs):
+    """Read data from many files in parallel.
+
+       Each file is read with :func:`read` in a pool of worker processes,
+       and the resulting :class:`ihm.System` objects are passed back to
+       this process (by pickling). This is much faster than reading the
+       files one by one when there are many files to read, e.g.::
+
+           for fname, systems in ihm.reader.read_many(glob.glob('*.cif')):
+               check(fname, systems)
+
+       Note that warnings emitted while reading a file (e.g. with
+       `warn_unknown_category`) are raised in the worker process, not here.
+
+       :param filenames: The names of the files to read.
+       :param int workers: The number of worker processes to use (by
+              default, the number of processors). If 1, all files are read
+              in this process instead.
+       :param str format: The format of the files, 'mmCIF' or 'BCIF'. By
+              default, files ending in '.bcif' are read as BinaryCIF and
+              all others as mmCIF. mmCIF files are read as UTF-8, or as
+              latin-1 if they are not valid UTF-8.
+       :param kwargs: Any other arguments are passed to :func:`read`,
+              except for `add_to_system`, which is not supported. Any
+              classes given (e.g. `model_class` or `handlers`) must be
+              importable by the worker processes.
+       :return: Yields a (filename, systems) tuple for each file once it
+                has been read, where `systems` is the list of
+                :class:`ihm.System` objects returned by :func:`read`.
+                Files are yielded in the order they finish, which is not
+                necessarily the order given. Only a few files (twice the
+                number of workers) are read ahead of the caller, so
+                memory use does not grow with the number of files.
+                If a file cannot be read, the exception is raised when
+                its result is reached. If the caller stops early (e.g. by
+                breaking out of a loop), files not yet started are
+                cancelled, and any still being read are left to finish
+                in the background rather than waited for.
+    """
+    if kwargs.get('add_to_system'):
+        raise ValueError("add_to_system is not supported by read_many")
+    if kwargs.get('profile') is not None:
+        raise ValueError("profile is not supported by read_many")
+    if workers == 1:
+        for fname in filenames:
+            yield fname, _read_many_file(fname, format, kwargs)
+        return
+    ex = concurrent.futures.ProcessPoolExecutor(max_workers=workers)
+    # Only keep a few files in flight at once, so that results are not
+    # held in memory until the caller gets to them
+    max_pending = 2 * (workers or os.cpu_count() or 1)
+    filenames = iter(filenames)
+    futures = {}
+    try:
+        while True:
+            for fname in itertools.islice(filenames,
+                                          max_pending - len(futures)):
+                futures[ex.submit(_read_many_file, fname, format,
+                                  kwargs)] = fname
+            if not futures:
+                break
+            done, _ = concurrent.futures.wait(
+                futures, return_when=concurrent.futures.FIRST_COMPLETED)
+            while done:
+                f = done.pop()
+                yield futures.pop(f), f.result()
+    finally:
+        # Don't wait for any remaining files if the caller stopped early
+        # (any that have already started are left to finish in the
+        # background)
+        for f in futures:
+            f.cancel()
+        ex.shutdown(wait=False)
+
+
+class _StopModelIteration(Exception):
+    """Raised in the reader thread if the caller stops iter_models early"""
+    pass
 
-    return systems
+
+class _ModelIterator:
+    """Read a file in a separate thread, passing each model back to the
+       caller as soon as it has been read (used by iter_models)"""
+
+    def __init__(self, fh, kwargs):
+        self._fh, self._kwargs = fh, kwargs
+        self._to_caller = queue.Queue(maxsize=1)
+        self._from_caller = queue.Queue(maxsize=1)
+        self._seen = set()
+
+    def _model_done(self, model):
+        self._seen.add(id(model))
+        self._to_caller.put(('model', model))
+        # Wait until the caller asks for the next model, then discard
+        # this model's coordinates
+        if not self._from_caller.get():
+            raise _StopModelIteration()
+        model._atoms = type(model._atoms)()
+
+    def run(self):
+        try:
+            kwargs = dict(self._kwargs)
+            kwargs['handlers'] = list(kwargs.get('handlers', [])) + [
+                functools.partial(_ModelIterAtomSiteHandler,
+                                  model_done=self._model_done)]
+            for s in read(self._fh, **kwargs):
+                # Return any models that had no atoms
+                for group, model in s._all_models():
+                    if id(model) not in self._seen:
+                        self._model_done(model)
+            self._to_caller.put(('done', None))
+        except _StopModelIteration:
+            pass
+        except BaseException as exc:
+            self._to_caller.put(('error', exc))
+
+
+def iter_models(fh, **kwargs):
+    """Read models from the file handle `fh` one at a time.
+
+       This reads the file in the same way as :func:`read`, but rather than
+       returning all of the data at once, yields each
+       :class:`ihm.model.Model` as soon as all of its atoms have been read
+       from the ``_atom_site`` table. Once the next model is requested,
+       the atoms of the previous model are discarded, so memory use is
+       bounded by the size of the largest model rather than the whole
+       file, e.g.::
+
+           with open('ensemble.cif') as fh:
+               for model in ihm.reader.iter_models(fh):
+                   process(model.get_atoms())
+
+       Atoms must be grouped by model in the file (as they are in files
+       written by this library); if a model's atoms are split between
+       several places in the file, the model is yielded once for each
+       place, with only those atoms. Other information about each model
+       (such as its name, assembly or representation) is available only if
+       it precedes ``_atom_site`` in the file, as it does in files written
+       by this library. Models with no atoms (e.g. those containing only
+       spheres) are yielded once the whole file has been read.
+
+       The file is read in a separate thread while the caller processes
+       each model.
+
+       :param file fh: The file handle to read from.
+       :param kwargs: Any other arguments are passed to :func:`read`.
+       :return: Yields :class:`ihm.model.Model` objects.
+    """
+    if kwargs.get('lazy_coordinates'):
+        raise ValueError("lazy_coordinates is not supported by iter_models")
+    it = _ModelIterator(fh, kwargs)
+    thread = threading.Thread(target=it.run, daemon=True)
+    thread.start()
+    waiting = False
+    try:
+        while True:
+            kind, obj = it._to_caller.get()
+            if kind == 'done':
+                break
+            elif kind == 'error':
+                raise obj
+            waiting = True
+            yield obj
+            waiting = False
+            it._from_caller.put(True)
+    finally:
+        # If the caller stopped early, stop the reader thread too
+        if waiting:
+            it._from_caller.put(False)
+        thread.join()
@@ -17,11 +17,13 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <math.h>
 #if defined(_WIN32) || defined(_WIN64)
 # include <windows.h>
 # include <io.h>
 #else
 # include <unistd.h>
+# include <time.h>
 #endif
 #include <errno.h>
 #include <assert.h>
@@ -35,6 +37,22 @@
 # define usleep Sleep
 #endif
 
+/* Get the current time in seconds, from an arbitrary starting point.
+   This is only used to measure elapsed times (see ihm_reader_timing_set) */
+static double ihm_time(void)
+{
+#if defined(_WIN32) || defined(_WIN64)
+  LARGE_INTEGER freq, count;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+#endif
+}
+
 /* Allocate memory; unlike malloc() this never returns NULL (a failure will
    terminate the program) */
 static void *ihm_malloc(size_t size)
@@ -243,6 +261,255 @@ static void ihm_string_append(struct ihm_string *s, const char *str)
   memcpy(s->str + oldlen, str, len);
 }
 
+/* Pairs of decimal digits, used to convert integers to strings */
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "6869707172737475767778798081828384858687888990919293949596979899";
+
+/* Write the decimal representation of an unsigned integer into buffer
+   (without a null terminator); return the number of characters written */
+static size_t ihm_utoa_raw(char *buffer, unsigned long long value)
+{
+  char tmp[20];
+  char *pt = tmp + sizeof(tmp);
+  size_t len;
+  while (value >= 100) {
+    unsigned i = (unsigned)(value % 100) * 2;
+    value /= 100;
+    *--pt = digit_pairs[i + 1];
+    *--pt = digit_pairs[i];
+  }
+  if (value >= 10) {
+    unsigned i = (unsigned)value * 2;
+    *--pt = digit_pairs[i + 1];
+    *--pt = digit_pairs[i];
+  } else {
+    *--pt = '0' + (char)value;
+  }
+  len = tmp + sizeof(tmp) - pt;
+  memcpy(buffer, pt, len);
+  return len;
+}
+
+/* Write the decimal representation of an integer (as printf's "%lld") into
+   buffer, which must be at least 21 bytes long. Return the length of
+   the resulting null-terminated string. This is considerably faster than
+   sprintf. */
+size_t ihm_itoa(char *buffer, long long value)
+{
+  size_t len;
+  if (value < 0) {
+    buffer[0] = '-';
+    len = 1 + ihm_utoa_raw(buffer + 1, 0ULL - (unsigned long long)value);
+  } else {
+    len = ihm_utoa_raw(buffer, (unsigned long long)value);
+  }
+  buffer[len] = '\0';
+  return len;
+}
+
+/* Exact powers of ten representable as doubles */
+static const double exact_pow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Return true iff the decimal number given by the null-terminated string
+   of digits, times 10^(decpt - ndigits), reads back as value */
+static bool decimal_round_trips(const char *digits, int decpt, double value,
+                                bool single)
+{
+  char buf[40];
+  sprintf(buf, "0.%se%d", digits, decpt);
+  if (single) {
+    return strtof(buf, NULL) == (float)value;
+  } else {
+    return strtod(buf, NULL) == value;
+  }
+}
+
+/* Round the string of digits to n digits (with ties going to even, as
+   for Python's repr), putting the result in out. *decpt is incremented if
+   the rounding carries into a new digit. */
+static void round_digits(const char *digits, int n, char *out, int *decpt)
+{
+  int i;
+  bool round_up = digits[n] > '5';
+  memcpy(out, digits, n);
+  out[n] = '\0';
+  if (digits[n] == '5') {
+    round_up = n > 0 && (digits[n - 1] - '0') % 2 == 1;
+    for (i = n + 1; digits[i] && !round_up; ++i) {
+      round_up = digits[i] != '0';
+    }
+  }
+  if (round_up) {
+    for (i = n - 1; i >= 0 && out[i] == '9'; --i) {
+      out[i] = '0';
+    }
+    if (i >= 0) {
+      out[i]++;
+    } else {
+      out[0] = '1';
+      (*decpt)++;
+    }
+  }
+}
+
+/* Get the shortest string of decimal digits that reads back as the given
+   (finite, positive) value, such that value = 0.DIGITS * 10^decpt. If
+   `single` is true, the digits need only read back as the same single
+   precision value. Return the number of digits. */
+static int shortest_digits(double value, bool single, char *digits,
+                           int *decpt)
+{
+  int k, ndigits, lo, hi;
+  char full[48], rounded[32];
+  double limit = single ? 4194304. /* 2^22 */
+                        : 1125899906842624.; /* 2^50 */
+
+  /* Fast path: most values in practice (e.g. coordinates) have only a
+     few decimal places; find the smallest number of decimal places k
+     such that round(value * 10^k) / 10^k gives back value exactly. Since
+     both the integer and the power of ten are exact, the division is
+     correctly rounded, just like conversion from the decimal string.
+     This is only done while the spacing of k-place decimals is several
+     times that of neighboring floating point values, so that if such a
+     decimal reads back correctly it is unique (and thus the nearest), it
+     is found by rounding (despite the error in value * 10^k), and
+     rounding to tens, hundreds, etc. would not give fewer digits. */
+  for (k = 0; k <= 17; ++k) {
+    double scaled = value * exact_pow10[k], m;
+    if (scaled >= limit) {
+      break;
+    }
+    m = floor(scaled + 0.5);
+    if (single ? (float)(m / exact_pow10[k]) == (float)value
+               : m / exact_pow10[k] == value) {
+      ndigits = (int)ihm_utoa_raw(digits, (unsigned long long)m);
+      *decpt = ndigits - k;
+      /* Remove trailing zeros (only possible if k == 0) */
+      while (ndigits > 1 && digits[ndigits - 1] == '0') {
+        ndigits--;
+      }
+      digits[ndigits] = '\0';
+      return ndigits;
+    }
+  }
+
+  /* Slow path: get the decimal representation to more digits than we
+     need (to avoid double rounding), then binary search for the shortest
+     rounding of it that reads back correctly (17 digits, or 9 for single
+     precision, always do) */
+  sprintf(full, "%.24e", value);
+  /* full is d.ddd...e[+-]XX; collect the digits and exponent */
+  digits[0] = full[0];
+  memcpy(digits + 1, full + 2, 24);
+  digits[25] = '\0';
+  *decpt = atoi(strchr(full, 'e') + 1) + 1;
+  ndigits = single ? 9 : 17;
+
+  lo = 1;
+  hi = ndigits;
+  while (lo < hi) {
+    /* Values that get this far usually need close to full precision,
+       so try that first */
+    int mid = (hi == ndigits && lo == 1) ? ndigits - 2 : (lo + hi) / 2;
+    int rdecpt = *decpt;
+    round_digits(digits, mid, rounded, &rdecpt);
+    if (decimal_round_trips(rounded, rdecpt, value, single)) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  round_digits(digits, hi, rounded, decpt);
+  memcpy(digits, rounded, hi + 1);
+  ndigits = hi;
+  while (ndigits > 1 && digits[ndigits - 1] == '0') {
+    ndigits--;
+  }
+  digits[ndigits] = '\0';
+  return ndigits;
+}
+
+/* Write a floating point value into buffer, which must be at least 32 bytes
+   long, using the shortest representation that reads back as the same
+   value (or, if `single` is true, the same single precision value). This
+   is laid out in the same way as Python's repr() of a float. Return the
+   length of the resulting null-terminated string. */
+static size_t ihm_dtoa(char *buffer, double value, bool single)
+{
+  char digits[32], *pt = buffer;
+  int ndigits, decpt, exp10;
+
+  if (value != value) {
+    strcpy(buffer, "nan");
+    return 3;
+  }
+  /* Check for negative values (including negative zero) */
+  if (value < 0. || (value == 0. && 1. / value < 0.)) {
+    *pt++ = '-';
+    value = -value;
+  }
+  if (value - value != 0.) {
+    strcpy(pt, "inf");
+    return pt - buffer + 3;
+  } else if (value == 0.) {
+    strcpy(pt, "0.0");
+    return pt - buffer + 3;
+  }
+
+  ndigits = shortest_digits(value, single, digits, &decpt);
+  exp10 = decpt - 1;
+  if (exp10 >= -4 && exp10 < 16) {
+    /* Fixed point notation */
+    if (decpt <= 0) {
+      *pt++ = '0';
+      *pt++ = '.';
+      memset(pt, '0', -decpt);
+      pt += -decpt;
+      memcpy(pt, digits, ndigits);
+      pt += ndigits;
+    } else if (decpt >= ndigits) {
+      memcpy(pt, digits, ndigits);
+      pt += ndigits;
+      memset(pt, '0', decpt - ndigits);
+      pt += decpt - ndigits;
+      *pt++ = '.';
+      *pt++ = '0';
+    } else {
+      memcpy(pt, digits, decpt);
+      pt += decpt;
+      *pt++ = '.';
+      memcpy(pt, digits + decpt, ndigits - decpt);
+      pt += ndigits - decpt;
+    }
+  } else {
+    /* Scientific notation, with at least two exponent digits */
+    *pt++ = digits[0];
+    if (ndigits > 1) {
+      *pt++ = '.';
+      memcpy(pt, digits + 1, ndigits - 1);
+      pt += ndigits - 1;
+    }
+    *pt++ = 'e';
+    if (exp10 < 0) {
+      *pt++ = '-';
+      exp10 = -exp10;
+    } else {
+      *pt++ = '+';
+    }
+    if (exp10 < 10) {
+      *pt++ = '0';
+    }
+    pt += ihm_utoa_raw(pt, (unsigned long long)exp10);
+  }
+  *pt = '\0';
+  return pt - buffer;
+}
+
 struct ihm_key_value {
   char *key;
   void *value;
@@ -369,6 +636,16 @@ static void ihm_keyword_free(void *value)
   free(key);
 }
 
+/* Statistics for a category, kept by the reader even after the category
+   itself is removed */
+struct ihm_category_stats {
+  char *name;
+  /* Number of rows passed to the data callback */
+  size_t num_rows;
+  /* Time spent in all of the category's callbacks */
+  double callback_time;
+};
+
 /* A category in an mmCIF file. */
 struct ihm_category {
   char *name;
@@ -384,8 +661,20 @@ struct ihm_category {
   void *data;
   /* Function to release data */
   ihm_free_callback free_func;
+  /* Statistics for this category (owned by the reader) */
+  struct ihm_category_stats *stats;
 };
 
+/* The construct the mmCIF parser is part way through reading. This allows
+   parsing to be suspended when a push file runs out of data, and resumed
+   when more is added. */
+typedef enum {
+  MMCIF_STATE_TOP = 0,       /* Not within any construct */
+  MMCIF_STATE_VALUE,         /* Waiting for the value of a keyword */
+  MMCIF_STATE_LOOP_KEYWORDS, /* Reading the keywords of a loop_ */
+  MMCIF_STATE_LOOP_DATA      /* Reading the data of a loop_ */
+} ihm_mmcif_state;
+
 /* Keep track of data used while reading an mmCIF or BinaryCIF file. */
 struct ihm_reader {
   /* The file handle to read from */
@@ -401,6 +690,27 @@ struct ihm_reader {
   struct ihm_array *tokens;
   /* The next token to be returned */
   unsigned token_index;
+  /* Line number on which the mmCIF multiline token currently being read
+     started (its contents so far are in tmp_str), or 0 */
+  int multiline_start;
+  /* The mmCIF construct currently being read */
+  ihm_mmcif_state mmcif_state;
+  /* Number of mmCIF data blocks seen by the current read */
+  int ndata;
+  /* true iff the current read is within an mmCIF save frame */
+  bool in_save;
+  /* The category (and keyword) for the construct currently being read,
+     or NULL if it is not handled */
+  struct ihm_category *state_category;
+  struct ihm_keyword *state_keyword;
+  /* Keywords of the loop_ currently being read, as an array of
+     ihm_keyword*, in the order the values should be given. Any NULL
+     pointers correspond to keywords we're not interested in. */
+  struct ihm_array *loop_keywords;
+  /* Index of the next value to be read in the current row of the loop_ */
+  unsigned loop_index;
+  /* true iff the current row of the loop_ is contained in a single line */
+  bool loop_oneline;
   /* All categories that we want to extract from the file */
   struct ihm_mapping *category_map;
 
@@ -423,8 +733,52 @@ struct ihm_reader {
   /* Number of BinaryCIF data blocks left to read, or -1 if header
      not read yet */
   int num_blocks_left;
+  /* Total number of BinaryCIF data blocks in the file */
+  int num_blocks;
+  /* Number of map entries (keys) left to read in the current BinaryCIF
+     data block, or -1 if we are not part way through reading a block */
+  long block_keys_left;
+  /* true iff the "categories" key of the current BinaryCIF data block
+     has been read, but not its value */
+  bool block_categories_pending;
+  /* Number of categories left to read in the "categories" array of the
+     current BinaryCIF data block, if we are part way through it */
+  uint32_t categories_left;
+  /* Header (name) of the current BinaryCIF data block, or NULL if
+     not (yet) known */
+  char *block_header;
   /* Any errors raised in the CMP read callback */
   struct ihm_error *cmp_read_err;
+  /* Serial number of the last BinaryCIF string dictionary read */
+  unsigned long dict_serial;
+  /* If nonzero, decode BinaryCIF categories with more rows than this
+     in chunks of this many rows */
+  size_t bcif_chunk_size;
+
+  /* If true, measure time spent reading (see ihm_reader_timing_set) */
+  bool timing;
+  /* Number of mmCIF tokens read */
+  size_t num_tokens;
+  /* Total time spent reading, and in callbacks */
+  double total_time, callback_time;
+  /* Statistics for every category handled, as ihm_category_stats* */
+  struct ihm_array *category_stats;
+  /* Total number of rows passed to category data callbacks */
+  size_t num_rows;
+  /* Statistics for the category whose data callback was most recently
+     called, or NULL */
+  struct ihm_category_stats *last_category;
+
+  /* Handler for progress reports */
+  ihm_progress_callback progress_callback;
+  /* Data passed to progress callback */
+  void *progress_data;
+  /* Function to release progress data */
+  ihm_free_callback progress_free_func;
+  /* Minimum number of bytes read between progress reports */
+  size_t progress_interval;
+  /* Number of bytes that must be read before the next progress report */
+  size_t progress_next;
 };
 
 typedef enum {
@@ -456,6 +810,27 @@ static void ihm_category_free(void *value)
   free(cat);
 }
 
+/* Get the statistics for the named category, adding them if needed */
+static struct ihm_category_stats *get_category_stats(struct ihm_reader *reader,
+                                                     const char *name)
+{
+  size_t i;
+  struct ihm_category_stats *st, **all;
+  all = (struct ihm_category_stats **)reader->category_stats->data;
+  for (i = 0; i < reader->category_stats->len; ++i) {
+    if (strcmp(all[i]->name, name) == 0) {
+      return all[i];
+    }
+  }
+  st = (struct ihm_category_stats *)ihm_malloc(
+                                 sizeof(struct ihm_category_stats));
+  st->name = strdup(name);
+  st->num_rows = 0;
+  st->callback_time = 0.;
+  ihm_array_append(reader->category_stats, &st);
+  return st;
+}
+
 /* Make a new struct ihm_category */
 struct ihm_category *ihm_category_new(struct ihm_reader *reader,
                                       const char *name,
@@ -473,6 +848,7 @@ struct ihm_category *ihm_category_new(struct ihm_reader *reader,
   category->data = data;
   category->free_func = free_func;
   category->keyword_map = ihm_mapping_new(ihm_keyword_free);
+  category->stats = get_category_stats(reader, name);
   ihm_mapping_insert(reader->category_map, category->name, category);
   return category;
 }
@@ -486,6 +862,8 @@ static struct ihm_keyword *ihm_keyword_new(struct ihm_category *category,
   key->name = strdup(name);
   key->own_data = false;
   key->in_file = false;
+  key->dict = NULL;
+  key->dict_index = -1;
   ihm_mapping_insert(category->keyword_map, key->name, key);
   key->own_data = false;
   return key;
@@ -533,6 +911,8 @@ static void set_keyword_to_default(struct ihm_keyword *key)
     key->data.str = NULL;
   }
   key->own_data = false;
+  key->dict = NULL;
+  key->dict_index = -1;
 }
 
 /* Set the value of a given keyword from the given string */
@@ -632,6 +1012,11 @@ struct ihm_file *ihm_file_new(ihm_file_read_callback read_callback,
   file->read_callback = read_callback;
   file->data = data;
   file->free_func = free_func;
+  file->bytes_read = 0;
+  file->buffer_max = file->buffer_grows = 0;
+  file->timing = false;
+  file->read_time = 0.;
+  file->reader = NULL;
   return file;
 }
 
@@ -668,6 +1053,77 @@ static ssize_t fd_read_callback(char *buffer, size_t buffer_len, void *data,
   return readlen;
 }
 
+/* Get the time at the start of a callback, if timing is turned on */
+static double callback_start(struct ihm_reader *reader)
+{
+  return reader->timing ? ihm_time() : 0.;
+}
+
+/* Record the time spent in a callback, and in the given category's
+   callbacks (if category is not NULL) */
+static void callback_end(struct ihm_reader *reader, double start,
+                         struct ihm_category *category)
+{
+  if (reader->timing) {
+    double elapsed = ihm_time() - start;
+    reader->callback_time += elapsed;
+    if (category) {
+      category->stats->callback_time += elapsed;
+    }
+  }
+}
+
+/* Call the reader's progress callback, if it is time to do so */
+static void report_progress(struct ihm_file *fh, struct ihm_error **err)
+{
+  struct ihm_reader *reader = fh->reader;
+  if (reader && reader->progress_callback
+      && fh->bytes_read >= reader->progress_next) {
+    double start = callback_start(reader);
+    reader->progress_next = fh->bytes_read + reader->progress_interval;
+    (*reader->progress_callback)(reader, fh->bytes_read, reader->num_rows,
+                                 reader->last_category
+                                   ? reader->last_category->name : NULL,
+                                 reader->progress_data, err);
+    callback_end(reader, start, NULL);
+  }
+}
+
+/* Note the current size of the file buffer, for statistics */
+static void update_buffer_stats(struct ihm_file *fh)
+{
+  /* The buffer never shrinks, so any increase in its capacity means it was
+     reallocated */
+  if (fh->buffer->capacity > fh->buffer_max) {
+    fh->buffer_max = fh->buffer->capacity;
+    fh->buffer_grows++;
+  }
+}
+
+/* Read up to len bytes of data from the file into the buffer at offset,
+   which must already be large enough. Returns the number of bytes read
+   (0 on EOF), or -1 (and sets err) on error. */
+static ssize_t ihm_file_read_data(struct ihm_file *fh, size_t offset,
+                                  size_t len, struct ihm_error **err)
+{
+  ssize_t readlen;
+  double start = fh->timing ? ihm_time() : 0.;
+  update_buffer_stats(fh);
+  readlen = (*fh->read_callback)(fh->buffer->str + offset, len,
+                                 fh->data, err);
+  if (fh->timing) {
+    fh->read_time += ihm_time() - start;
+  }
+  if (readlen > 0) {
+    fh->bytes_read += readlen;
+    report_progress(fh, err);
+    if (*err) {
+      return -1;
+    }
+  }
+  return readlen;
+}
+
 /* Read data from file to expand the in-memory buffer.
    Returns the number of bytes read (0 on EOF), or -1 (and sets err) on error
  */
@@ -687,8 +1143,7 @@ static ssize_t expand_buffer(struct ihm_file *fh, struct ihm_error **err)
 
   current_size = fh->buffer->len;
   ihm_string_set_size(fh->buffer, current_size + READ_SIZE);
-  readlen = (*fh->read_callback)(fh->buffer->str + current_size, READ_SIZE,
-                                 fh->data, err);
+  readlen = ihm_file_read_data(fh, current_size, READ_SIZE, err);
   ihm_string_set_size(fh->buffer, current_size + (readlen == -1 ? 0 : readlen));
   return readlen;
 }
@@ -715,14 +1170,23 @@ static bool ihm_file_read_line(struct ihm_file *fh, int *eof,
 
   /* Line is only definitely terminated if there are characters after it
      (embedded NULL, or \r followed by a possible \n) */
-  while((line_end = fh->line_start
-           + strcspn(fh->buffer->str + fh->line_start, "\r\n"))
-         == fh->buffer->len) {
-    ssize_t num_added = expand_buffer(fh, err);
+  while(1) {
+    ssize_t num_added;
+    line_end = fh->line_start
+               + strcspn(fh->buffer->str + fh->line_start, "\r\n");
+    if (line_end < fh->buffer->len
+        && (fh->buffer->str[line_end] != '\r'
+            || line_end + 1 < fh->buffer->len)) {
+      break;
+    }
+    num_added = expand_buffer(fh, err);
     if (num_added < 0) {
       return false; /* error occurred */
     } else if (num_added == 0) {
-      *eof = true; /* end of file */
+      /* end of file; buffer may have moved, so find the line end again */
+      line_end = fh->line_start
+                 + strcspn(fh->buffer->str + fh->line_start, "\r\n");
+      *eof = (line_end == fh->buffer->len);
       break;
     }
   }
@@ -742,6 +1206,40 @@ struct ihm_file *ihm_file_new_from_fd(int fd)
   return ihm_file_new(fd_read_callback, INT_TO_POINTER(fd), NULL);
 }
 
+/* State of an ihm_file created with ihm_file_new_push */
+struct push_file_data {
+  /* true once ihm_reader_finish has been called */
+  bool eof;
+  /* true iff the parser ran out of data before the end of the file */
+  bool need_data;
+};
+
+/* "Read" data for a push file. All data has already been added to the
+   buffer by ihm_reader_feed, so either signal end of file, or abort the
+   parse (with an error that is caught by ihm_reader_feed) until more data
+   is added. */
+static ssize_t push_read_callback(char *buffer, size_t buffer_len, void *data,
+                                  struct ihm_error **err)
+{
+  struct push_file_data *pd = (struct push_file_data *)data;
+  if (pd->eof) {
+    return 0;
+  } else {
+    pd->need_data = true;
+    ihm_error_set(err, IHM_ERROR_IO, "More data needed");
+    return -1;
+  }
+}
+
+/* Make a new ihm_file that is given data with ihm_reader_feed */
+struct ihm_file *ihm_file_new_push(void)
+{
+  struct push_file_data *pd = (struct push_file_data *)ihm_malloc(
+                                           sizeof(struct push_file_data));
+  pd->eof = pd->need_data = false;
+  return ihm_file_new(push_read_callback, pd, free);
+}
+
 /* Make a new struct ihm_reader */
 struct ihm_reader *ihm_reader_new(struct ihm_file *fh, bool binary)
 {
@@ -753,6 +1251,15 @@ struct ihm_reader *ihm_reader_new(struct ihm_file *fh, bool binary)
   reader->tmp_str = ihm_string_new();
   reader->tokens = ihm_array_new(sizeof(struct ihm_token));
   reader->token_index = 0;
+  reader->multiline_start = 0;
+  reader->mmcif_state = MMCIF_STATE_TOP;
+  reader->ndata = 0;
+  reader->in_save = false;
+  reader->state_category = NULL;
+  reader->state_keyword = NULL;
+  reader->loop_keywords = ihm_array_new(sizeof(struct ihm_keyword*));
+  reader->loop_index = 0;
+  reader->loop_oneline = false;
   reader->category_map = ihm_mapping_new(ihm_category_free);
 
   reader->unknown_category_callback = NULL;
@@ -764,15 +1271,46 @@ struct ihm_reader *ihm_reader_new(struct ihm_file *fh, bool binary)
   reader->unknown_keyword_free_func = NULL;
 
   reader->num_blocks_left = -1;
+  reader->num_blocks = 0;
+  reader->block_keys_left = -1;
+  reader->block_categories_pending = false;
+  reader->categories_left = 0;
+  reader->block_header = NULL;
+  reader->dict_serial = 0;
+  reader->bcif_chunk_size = 0;
   reader->cmp_read_err = NULL;
+  reader->timing = false;
+  reader->num_tokens = 0;
+  reader->total_time = reader->callback_time = 0.;
+  reader->category_stats = ihm_array_new(sizeof(struct ihm_category_stats *));
+  reader->num_rows = 0;
+  reader->last_category = NULL;
+  reader->progress_callback = NULL;
+  reader->progress_data = NULL;
+  reader->progress_free_func = NULL;
+  reader->progress_interval = reader->progress_next = 0;
+  fh->reader = reader;
   return reader;
 }
 
+/* Free memory used by an array of ihm_category_stats* */
+static void free_category_stats(struct ihm_array *a)
+{
+  size_t i;
+  struct ihm_category_stats **all = (struct ihm_category_stats **)a->data;
+  for (i = 0; i < a->len; ++i) {
+    free(all[i]->name);
+    free(all[i]);
+  }
+  ihm_array_free(a);
+}
+
 /* Free memory used by a struct ihm_reader */
 void ihm_reader_free(struct ihm_reader *reader)
 {
   ihm_string_free(reader->tmp_str);
   ihm_array_free(reader->tokens);
+  ihm_array_free(reader->loop_keywords);
   ihm_mapping_free(reader->category_map);
   ihm_file_free(reader->fh);
   if (reader->unknown_category_free_func) {
@@ -781,12 +1319,81 @@ void ihm_reader_free(struct ihm_reader *reader)
   if (reader->unknown_keyword_free_func) {
     (*reader->unknown_keyword_free_func) (reader->unknown_keyword_data);
   }
+  if (reader->progress_free_func) {
+    (*reader->progress_free_func) (reader->progress_data);
+  }
   if (reader->cmp_read_err) {
     ihm_error_free(reader->cmp_read_err);
   }
+  free(reader->block_header);
+  free_category_stats(reader->category_stats);
   free(reader);
 }
 
+/* Set the chunk size for decoding BinaryCIF data */
+void ihm_reader_bcif_chunk_size_set(struct ihm_reader *reader,
+                                    size_t chunk_size)
+{
+  reader->bcif_chunk_size = chunk_size;
+}
+
+/* Set a callback to report progress while reading */
+void ihm_reader_progress_callback_set(struct ihm_reader *reader,
+                                      ihm_progress_callback callback,
+                                      void *data, ihm_free_callback free_func,
+                                      size_t interval)
+{
+  if (reader->progress_free_func) {
+    (*reader->progress_free_func) (reader->progress_data);
+  }
+  reader->progress_callback = callback;
+  reader->progress_data = data;
+  reader->progress_free_func = free_func;
+  reader->progress_interval = interval;
+  reader->progress_next = reader->fh->bytes_read + interval;
+}
+
+/* Turn on or off timing of each part of reading */
+void ihm_reader_timing_set(struct ihm_reader *reader, bool timing)
+{
+  reader->timing = timing;
+  reader->fh->timing = timing;
+}
+
+/* Get statistics for everything read by this reader so far */
+void ihm_reader_get_stats(struct ihm_reader *reader,
+                          struct ihm_reader_stats *stats)
+{
+  struct ihm_file *fh = reader->fh;
+  stats->bytes_read = fh->bytes_read;
+  stats->lines = reader->binary ? 0 : reader->linenum;
+  stats->tokens = reader->num_tokens;
+  stats->buffer_max = fh->buffer_max;
+  stats->buffer_grows = fh->buffer_grows;
+  stats->total_time = reader->total_time;
+  stats->io_time = fh->read_time;
+  stats->callback_time = reader->callback_time;
+  stats->parse_time = stats->total_time - stats->io_time
+                      - stats->callback_time;
+  /* Guard against rounding error (or reads outside of ihm_read_file) */
+  if (stats->parse_time < 0.) {
+    stats->parse_time = 0.;
+  }
+}
+
+/* Call the given function with statistics for each category */
+void ihm_reader_category_stats_foreach(struct ihm_reader *reader,
+                                       ihm_category_stats_callback callback,
+                                       void *data)
+{
+  size_t i;
+  struct ihm_category_stats **all;
+  all = (struct ihm_category_stats **)reader->category_stats->data;
+  for (i = 0; i < reader->category_stats->len; ++i) {
+    (*callback)(all[i]->name, all[i]->num_rows, all[i]->callback_time, data);
+  }
+}
+
 /* Set a callback for unknown categories.
    The given callback is called whenever a category is encountered in the
    file that is not handled (by ihm_category_new).
@@ -933,6 +1540,7 @@ static void tokenize(struct ihm_reader *reader, char *line,
   if (*err) {
     ihm_array_clear(reader->tokens);
   }
+  reader->num_tokens += reader->tokens->len;
 }
 
 /* Return a pointer to the current line */
@@ -946,10 +1554,11 @@ static void read_multiline_token(struct ihm_reader *reader,
                                  int ignore_multiline, struct ihm_error **err)
 {
   int eof = 0;
-  int start_linenum = reader->linenum;
   while (!eof) {
     reader->linenum++;
     if (!ihm_file_read_line(reader->fh, &eof, err)) {
+      /* Don't count this line twice if we try again with more data */
+      reader->linenum--;
       return;
     } else if (line_pt(reader)[0] == ';') {
       struct ihm_token t;
@@ -958,6 +1567,8 @@ static void read_multiline_token(struct ihm_reader *reader,
       ihm_array_clear(reader->tokens);
       ihm_array_append(reader->tokens, &t);
       reader->token_index = 0;
+      reader->multiline_start = 0;
+      reader->num_tokens++;
       return;
     } else if (!ignore_multiline) {
       ihm_string_append(reader->tmp_str, "\n");
@@ -966,7 +1577,7 @@ static void read_multiline_token(struct ihm_reader *reader,
   }
   ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
                 "End of file while reading multiline string "
-                "which started on line %d", start_linenum);
+                "which started on line %d", reader->multiline_start);
 }
 
 /* Return the number of tokens still available in the current line. */
@@ -995,15 +1606,26 @@ static struct ihm_token *get_token(struct ihm_reader *reader,
   int eof = 0;
   if (reader->tokens->len <= reader->token_index) {
     do {
+      if (reader->multiline_start) {
+        /* Continue a multiline token that was interrupted by lack of data */
+        read_multiline_token(reader, ignore_multiline, err);
+        if (*err) {
+          return NULL;
+        }
+        continue;
+      }
       /* No tokens left - read the next non-blank line in */
       reader->linenum++;
       if (!ihm_file_read_line(reader->fh, &eof, err)) {
+        /* Don't count this line twice if we try again with more data */
+        reader->linenum--;
         return NULL;
       } else if (line_pt(reader)[0] == ';') {
         if (!ignore_multiline) {
           /* Skip initial semicolon */
           ihm_string_assign(reader->tmp_str, line_pt(reader) + 1);
         }
+        reader->multiline_start = reader->linenum;
         read_multiline_token(reader, ignore_multiline, err);
         if (*err) {
           return NULL;
@@ -1047,6 +1669,29 @@ static void parse_category_keyword(struct ihm_reader *reader,
   *keyword = dot + 1;
 }
 
+/* Read the value of the keyword given by the last token (state_keyword) */
+static void read_value_data(struct ihm_reader *reader, struct ihm_error **err)
+{
+  struct ihm_category *category = reader->state_category;
+  struct ihm_keyword *key = reader->state_keyword;
+  struct ihm_token *val_token = get_token(reader, false, err);
+  if (*err) {
+    return;
+  }
+  reader->mmcif_state = MMCIF_STATE_TOP;
+  if (val_token && val_token->type == MMCIF_TOKEN_VALUE) {
+    set_value_from_string(reader, category, key, val_token->str, true, err);
+  } else if (val_token && val_token->type == MMCIF_TOKEN_OMITTED) {
+    set_omitted_value(key);
+  } else if (val_token && val_token->type == MMCIF_TOKEN_UNKNOWN) {
+    set_unknown_value(key);
+  } else {
+    ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
+                  "No valid value found for %s.%s in file, line %d",
+                  category->name, key->name, reader->linenum);
+  }
+}
+
 /* Read a line that sets a single value, e.g. _entry.id   1YTI */
 static void read_value(struct ihm_reader *reader,
                        struct ihm_token *key_token, struct ihm_error **err)
@@ -1065,27 +1710,23 @@ static void read_value(struct ihm_reader *reader,
     key = (struct ihm_keyword *)ihm_mapping_lookup(category->keyword_map,
                                                    keyword_name);
     if (key) {
-      struct ihm_token *val_token = get_token(reader, false, err);
-      if (val_token && val_token->type == MMCIF_TOKEN_VALUE) {
-        set_value_from_string(reader, category, key, val_token->str, true, err);
-      } else if (val_token && val_token->type == MMCIF_TOKEN_OMITTED) {
-        set_omitted_value(key);
-      } else if (val_token && val_token->type == MMCIF_TOKEN_UNKNOWN) {
-        set_unknown_value(key);
-      } else if (!*err) {
-        ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
-                      "No valid value found for %s.%s in file, line %d",
-                      category->name, key->name, reader->linenum);
-      }
+      reader->mmcif_state = MMCIF_STATE_VALUE;
+      reader->state_category = category;
+      reader->state_keyword = key;
+      read_value_data(reader, err);
     } else if (reader->unknown_keyword_callback) {
+      double start = callback_start(reader);
       (*reader->unknown_keyword_callback)(reader, category_name, keyword_name,
                                           reader->linenum,
                                           reader->unknown_keyword_data, err);
+      callback_end(reader, start, NULL);
     }
   } else if (reader->unknown_category_callback) {
+    double start = callback_start(reader);
     (*reader->unknown_category_callback)(reader, category_name,
                                          reader->linenum,
                                          reader->unknown_category_data, err);
+    callback_end(reader, start, NULL);
   }
 }
 
@@ -1110,9 +1751,11 @@ static struct ihm_keyword *handle_loop_index(struct ihm_reader *reader,
   if (first_loop) {
     *catpt = category;
     if (!category && reader->unknown_category_callback) {
+      double start = callback_start(reader);
       (*reader->unknown_category_callback)(reader, category_name,
                                            reader->linenum,
                                            reader->unknown_category_data, err);
+      callback_end(reader, start, NULL);
       if (*err) {
         return NULL;
       }
@@ -1130,9 +1773,11 @@ static struct ihm_keyword *handle_loop_index(struct ihm_reader *reader,
     if (key) {
       return key;
     } else if (reader->unknown_keyword_callback) {
+      double start = callback_start(reader);
       (*reader->unknown_keyword_callback)(reader, category_name, keyword_name,
                                           reader->linenum,
                                           reader->unknown_keyword_data, err);
+      callback_end(reader, start, NULL);
       if (*err) {
         return NULL;
       }
@@ -1171,7 +1816,12 @@ static void call_category(struct ihm_reader *reader,
                           &force);
     }
     if (force) {
+      double start = callback_start(reader);
+      category->stats->num_rows++;
+      reader->num_rows++;
+      reader->last_category = category->stats;
       (*category->data_callback) (reader, reader->linenum, category->data, err);
+      callback_end(reader, start, category);
     }
   }
   /* Clear out keyword values, ready for the next set of data */
@@ -1179,23 +1829,17 @@ static void call_category(struct ihm_reader *reader,
 }
 
 /* Read the list of keywords from a loop_ construct. */
-static struct ihm_array *read_loop_keywords(struct ihm_reader *reader,
-                                            struct ihm_category **category,
-                                            struct ihm_error **err)
+static void read_loop_keywords(struct ihm_reader *reader,
+                               struct ihm_error **err)
 {
-  bool first_loop = true;
   struct ihm_token *token;
-  /* An array of ihm_keyword*, in the order the values should be given.
-     Any NULL pointers correspond to keywords we're not interested in. */
-  struct ihm_array *keywords = ihm_array_new(sizeof(struct ihm_keyword*));
-  *category = NULL;
 
   while (!*err && (token = get_token(reader, false, err))) {
     if (token->type == MMCIF_TOKEN_VARIABLE) {
-      struct ihm_keyword *k = handle_loop_index(reader, category,
-                                                token, first_loop, err);
-      ihm_array_append(keywords, &k);
-      first_loop = false;
+      struct ihm_keyword *k = handle_loop_index(
+                     reader, &reader->state_category, token,
+                     reader->loop_keywords->len == 0, err);
+      ihm_array_append(reader->loop_keywords, &k);
     } else if (token->type == MMCIF_TOKEN_VALUE
                || token->type == MMCIF_TOKEN_UNKNOWN
                || token->type == MMCIF_TOKEN_OMITTED) {
@@ -1208,32 +1852,36 @@ static struct ihm_array *read_loop_keywords(struct ihm_reader *reader,
                     reader->linenum);
     }
   }
-  if (*err) {
-    ihm_array_free(keywords);
-    return NULL;
-  } else {
-    return keywords;
+  if (!*err) {
+    reader->loop_index = 0;
+    reader->mmcif_state = reader->state_category ? MMCIF_STATE_LOOP_DATA
+                                                 : MMCIF_STATE_TOP;
   }
 }
 
 /* Read data for a loop_ construct */
-static void read_loop_data(struct ihm_reader *reader,
-                           struct ihm_category *category, unsigned len,
-                           struct ihm_keyword **keywords,
-                           struct ihm_error **err)
+static void read_loop_data(struct ihm_reader *reader, struct ihm_error **err)
 {
+  struct ihm_category *category = reader->state_category;
+  unsigned len = reader->loop_keywords->len;
+  struct ihm_keyword **keywords =
+                      (struct ihm_keyword **)reader->loop_keywords->data;
   while (!*err) {
-    /* Does the current line contain an entire row in the loop? */
-    int oneline = get_num_line_tokens(reader) >= len;
     unsigned i;
-    for (i = 0; !*err && i < len; ++i) {
+    if (reader->loop_index == 0) {
+      /* Does the current line contain an entire row in the loop? */
+      reader->loop_oneline = get_num_line_tokens(reader) >= len;
+    }
+    for (i = reader->loop_index; !*err && i < len; ++i) {
       struct ihm_token *token = get_token(reader, false, err);
       if (*err) {
-        break;
+        /* Carry on from this value if we get more data */
+        reader->loop_index = i;
+        return;
       } else if (token && token->type == MMCIF_TOKEN_VALUE) {
         if (keywords[i]) {
           set_value_from_string(reader, category, keywords[i], token->str,
-                                !oneline, err);
+                                !reader->loop_oneline, err);
         }
       } else if (token && token->type == MMCIF_TOKEN_OMITTED) {
         if (keywords[i]) {
@@ -1248,6 +1896,7 @@ static void read_loop_data(struct ihm_reader *reader,
         if (token) {
           unget_token(reader);
         }
+        reader->mmcif_state = MMCIF_STATE_TOP;
         return;
       } else {
         ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
@@ -1256,27 +1905,34 @@ static void read_loop_data(struct ihm_reader *reader,
                       reader->linenum);
       }
     }
+    reader->loop_index = 0;
     if (!*err) {
       call_category(reader, category, true, err);
     }
   }
 }
 
-/* Read a loop_ construct from the file. */
-static void read_loop(struct ihm_reader *reader, struct ihm_error **err)
+/* Read (the rest of) the construct given by reader->mmcif_state */
+static void read_construct(struct ihm_reader *reader, struct ihm_error **err)
 {
-  struct ihm_array *keywords;
-  struct ihm_category *category;
-
-  keywords = read_loop_keywords(reader, &category, err);
-  if (*err) {
-    return;
+  if (reader->mmcif_state == MMCIF_STATE_VALUE) {
+    read_value_data(reader, err);
   }
-  if (category) {
-    read_loop_data(reader, category, keywords->len,
-                   (struct ihm_keyword **)keywords->data, err);
+  if (reader->mmcif_state == MMCIF_STATE_LOOP_KEYWORDS) {
+    read_loop_keywords(reader, err);
   }
-  ihm_array_free(keywords);
+  if (!*err && reader->mmcif_state == MMCIF_STATE_LOOP_DATA) {
+    read_loop_data(reader, err);
+  }
+}
+
+/* Read a loop_ construct from the file. */
+static void read_loop(struct ihm_reader *reader, struct ihm_error **err)
+{
+  ihm_array_clear(reader->loop_keywords);
+  reader->state_category = NULL;
+  reader->mmcif_state = MMCIF_STATE_LOOP_KEYWORDS;
+  read_construct(reader, err);
 }
 
 struct category_foreach_data {
@@ -1308,8 +1964,10 @@ static void finalize_category_foreach(void *key, void *value, void *user_data)
   struct category_foreach_data *d = (struct category_foreach_data *)user_data;
   struct ihm_category *category = (struct ihm_category *)value;
   if (!*(d->err) && category->finalize_callback) {
+    double start = callback_start(d->reader);
     (*category->finalize_callback)(d->reader, d->reader->linenum,
                                    category->data, d->err);
+    callback_end(d->reader, start, category);
   }
 }
 
@@ -1328,8 +1986,10 @@ static void end_frame_category_foreach(void *key, void *value, void *user_data)
   struct category_foreach_data *d = (struct category_foreach_data *)user_data;
   struct ihm_category *category = (struct ihm_category *)value;
   if (!*(d->err) && category->end_frame_callback) {
+    double start = callback_start(d->reader);
     (*category->end_frame_callback)(d->reader, d->reader->linenum,
                                     category->data, d->err);
+    callback_end(d->reader, start, category);
   }
 }
 
@@ -1356,20 +2016,35 @@ static void sort_mappings(struct ihm_reader *reader)
   ihm_mapping_foreach(reader->category_map, sort_category_foreach, NULL);
 }
 
-/* Read an entire mmCIF file. */
-static bool read_mmcif_file(struct ihm_reader *reader, bool *more_data,
-                            struct ihm_error **err)
+/* Forget any partially-read mmCIF construct, ready for the next read */
+static void reset_mmcif_state(struct ihm_reader *reader)
+{
+  reader->mmcif_state = MMCIF_STATE_TOP;
+  reader->ndata = 0;
+  reader->in_save = false;
+  reader->multiline_start = 0;
+  reader->state_category = NULL;
+  reader->state_keyword = NULL;
+  ihm_array_clear(reader->loop_keywords);
+}
+
+/* Parse mmCIF data up to the end of the current data block (or the end of
+   the file). Parsing starts from wherever the last call left off, so
+   can be continued if it previously stopped early because a push file
+   ran out of data. Return false and set err on error (or lack of data). */
+static bool read_mmcif_block(struct ihm_reader *reader,
+                             struct ihm_error **err)
 {
-  int ndata = 0, in_save = 0;
   struct ihm_token *token;
   sort_mappings(reader);
+  read_construct(reader, err);
   while (!*err && (token = get_token(reader, true, err))) {
     if (token->type == MMCIF_TOKEN_VARIABLE) {
       read_value(reader, token, err);
     } else if (token->type == MMCIF_TOKEN_DATA) {
-      ndata++;
+      reader->ndata++;
       /* Only read the first data block */
-      if (ndata > 1) {
+      if (reader->ndata > 1) {
         /* Allow reading the next data block */
         unget_token(reader);
         break;
@@ -1377,23 +2052,39 @@ static bool read_mmcif_file(struct ihm_reader *reader, bool *more_data,
     } else if (token->type == MMCIF_TOKEN_LOOP) {
       read_loop(reader, err);
     } else if (token->type == MMCIF_TOKEN_SAVE) {
-      in_save = !in_save;
-      if (!in_save) {
+      reader->in_save = !reader->in_save;
+      if (!reader->in_save) {
         call_all_categories(reader, err);
         end_frame_all_categories(reader, err);
       }
     }
   }
+  return !*err;
+}
+
+/* Handle the end of an mmCIF data block */
+static bool end_mmcif_block(struct ihm_reader *reader, bool *more_data,
+                            struct ihm_error **err)
+{
+  call_all_categories(reader, err);
   if (!*err) {
-    call_all_categories(reader, err);
     finalize_all_categories(reader, err);
   }
-  if (*err) {
+  *more_data = !*err && reader->ndata > 1;
+  reset_mmcif_state(reader);
+  return !*err;
+}
+
+/* Read an entire mmCIF file. */
+static bool read_mmcif_file(struct ihm_reader *reader, bool *more_data,
+                            struct ihm_error **err)
+{
+  if (read_mmcif_block(reader, err)) {
+    return end_mmcif_block(reader, more_data, err);
+  } else {
     *more_data = false;
+    reset_mmcif_state(reader);
     return false;
-  } else {
-    *more_data = (ndata > 1);
-    return true;
   }
 }
 
@@ -1409,26 +2100,30 @@ static bool ihm_file_read_bytes(struct ihm_file *fh, char **buf, size_t sz,
     size_t current_size, to_read;
     ssize_t readlen, needed;
     /* Move any existing data to the start of the buffer, so it doesn't
-       grow to the full size of the file */
-    if (fh->line_start) {
+       grow to the full size of the file. Push files are instead trimmed
+       by ihm_reader_feed, as they may need to go back to an earlier
+       position in the buffer if they run out of data. */
+    if (fh->line_start && fh->read_callback != push_read_callback) {
       ihm_string_erase(fh->buffer, 0, fh->line_start);
       fh->line_start = 0;
     }
     /* Fill buffer with new data, at least sz long (but could be more) */
     current_size = fh->buffer->len;
-    needed = sz - current_size;
-    to_read = READ_SIZE > needed ? READ_SIZE : needed;
+    needed = fh->line_start + sz - current_size;
+    /* Push files never supply more data here, so don't read ahead */
+    to_read = READ_SIZE > needed && fh->read_callback != push_read_callback
+              ? READ_SIZE : needed;
     /* Expand buffer as needed */
     ihm_string_set_size(fh->buffer, current_size + to_read);
-    readlen = (*fh->read_callback)(
-          fh->buffer->str + current_size, to_read, fh->data, err);
+    readlen = ihm_file_read_data(fh, current_size, to_read, err);
+    /* Set buffer size to match data actually read */
+    ihm_string_set_size(fh->buffer,
+                        current_size + (readlen > 0 ? readlen : 0));
     if (*err) return false;
     if (readlen < needed) {
       ihm_error_set(err, IHM_ERROR_IO, "Less data read than requested");
       return false;
     }
-    /* Set buffer size to match data actually read */
-    ihm_string_set_size(fh->buffer, current_size + readlen);
   }
   *buf = fh->buffer->str + fh->line_start;
   fh->line_start += sz;
@@ -1719,13 +2414,13 @@ static bool read_bcif_header(struct ihm_reader *reader, struct ihm_error **err)
     if (match) {
       uint32_t array_size;
       if (!read_bcif_array(reader, &array_size, err)) return false;
-      reader->num_blocks_left = array_size;
+      reader->num_blocks_left = reader->num_blocks = array_size;
       return true;
     } else {
       if (!skip_bcif_object(reader, err)) return false;
     }
   }
-  reader->num_blocks_left = 0;
+  reader->num_blocks_left = reader->num_blocks = 0;
   return true;
 }
 
@@ -1741,7 +2436,7 @@ typedef enum {
   BCIF_DATA_UINT32, /* Array of unsigned 32-bit integers */
   BCIF_DATA_FLOAT,  /* Array of single-precision floating point values */
   BCIF_DATA_DOUBLE, /* Array of double-precision floating point values */
-  BCIF_DATA_STRING  /* Array of char* null-terminated strings */
+  BCIF_DATA_STRING  /* Array of int32 indices into a string dictionary */
 } bcif_data_type;
 
 /* All possible C types stored in bcif_data */
@@ -1755,7 +2450,6 @@ union bcif_data_c {
   uint32_t *uint32;
   float *float32;
   double *float64;
-  char **string;
 };
 
 /* Data stored in BinaryCIF for a column, mask, or StringArray offsets.
@@ -1767,6 +2461,10 @@ struct bcif_data {
   union bcif_data_c data;
   /* The size of the data (e.g. array dimension) */
   size_t size;
+  /* For BCIF_DATA_STRING, the dictionary of distinct strings that the
+     data (in data.int32) indexes into (index -1 is used for missing
+     strings). This is owned by the StringArray encoding, not by us. */
+  struct ihm_string_dict *dict;
 };
 
 /* Initialize a new bcif_data */
@@ -1774,6 +2472,7 @@ static void bcif_data_init(struct bcif_data *d)
 {
   d->type = BCIF_DATA_NULL;
   d->size = 0;
+  d->dict = NULL;
 }
 
 /* Free memory used by a bcif_data */
@@ -1810,7 +2509,7 @@ static void bcif_data_free(struct bcif_data *d)
     free(d->data.float64);
     break;
   case BCIF_DATA_STRING:
-    free(d->data.string);
+    free(d->data.int32);
     break;
   }
 }
@@ -1852,18 +2551,80 @@ struct bcif_encoding {
   int32_t numsteps;
   /* ByteArray type */
   int32_t type;
+  /* Type of the original data, before encoding (or -1 if not given) */
+  int32_t srctype;
   /* Encoding of StringArray data */
   struct bcif_encoding *first_data_encoding;
   /* Encoding of StringArray offset */
   struct bcif_encoding *first_offset_encoding;
   /* String data for StringArray encoding */
   char *string_data;
+  /* Dictionary of distinct strings in string_data, once decoded */
+  struct ihm_string_dict dict;
   /* Data for offsets for StringArray encoding */
   struct bcif_data offsets;
   /* Next encoding, or NULL */
   struct bcif_encoding *next;
 };
 
+/* A single value passed between the stages of a bcif_stream */
+union bcif_value {
+  /* Integer value (wide enough for any ByteArray integer type) */
+  int64_t i;
+  /* Floating point value */
+  double f;
+};
+
+/* The kind of values produced by a bcif_stream */
+typedef enum {
+  BCIF_STREAM_NONE,   /* Encodings cannot be decoded as a stream */
+  BCIF_STREAM_INT,    /* Integers that fit in int32 */
+  BCIF_STREAM_UINT32, /* Unsigned 32-bit integers */
+  BCIF_STREAM_FLOAT,  /* Single precision floating point */
+  BCIF_STREAM_DOUBLE, /* Double precision floating point */
+  BCIF_STREAM_STRING  /* Indices into a StringArray dictionary */
+} bcif_stream_kind;
+
+/* Number of values buffered by bcif_stream stages that do not map
+   input to output one-to-one (IntegerPacking and RunLength) */
+#define BCIF_STREAM_BUFFER_SIZE 4096
+
+/* One stage in decoding BinaryCIF data a piece at a time, rather than
+   decoding the entire array in one go. Each stage corresponds to a
+   single encoding, and pulls values as needed from the previous stage
+   (its input), carrying any state (e.g. the current delta or run length)
+   between calls. */
+struct bcif_stream {
+  /* The encoding this stage decodes */
+  struct bcif_encoding *enc;
+  /* The previous stage, or NULL for ByteArray (which reads raw data) */
+  struct bcif_stream *input;
+  /* Raw data, for ByteArray */
+  struct bcif_data raw;
+  /* Index of the next raw element to read, for ByteArray */
+  size_t raw_pos;
+  /* Values read from the input but not yet used */
+  union bcif_value *buf;
+  /* Index of next value in buf, and number of values in buf */
+  size_t buf_pos, buf_len;
+  /* Running total (Delta, IntegerPacking) */
+  int32_t value;
+  /* Current value and number of remaining repeats (RunLength) */
+  int32_t run_value, run_left;
+};
+
+/* Free memory used by a bcif_stream and all of its inputs */
+static void bcif_stream_free(struct bcif_stream *s)
+{
+  while (s) {
+    struct bcif_stream *input = s->input;
+    bcif_data_free(&s->raw);
+    free(s->buf);
+    free(s);
+    s = input;
+  }
+}
+
 /* A single column in a BinaryCIF category */
 struct bcif_column {
   /* Keyword name */
@@ -1876,6 +2637,14 @@ struct bcif_column {
   struct bcif_encoding *first_encoding;
   /* Singly-linked list of mask encodings */
   struct bcif_encoding *first_mask_encoding;
+  /* If the data is being decoded a window at a time, the decoder for the
+     data, and the row number of the first element in `data` */
+  struct bcif_stream *stream;
+  size_t data_start;
+  /* Decoder for the mask, and the row number of the first element in
+     `mask_data`, if decoding a window at a time */
+  struct bcif_stream *mask_stream;
+  size_t mask_start;
   /* The corresponding ihm_keyword, if any */
   struct ihm_keyword *keyword;
   /* Temporary buffer for keyword value as a string */
@@ -1890,6 +2659,8 @@ struct bcif_category {
   char *name;
   /* Singly-linked list of column (keyword) information */
   struct bcif_column *first_column;
+  /* Number of rows, or -1 if not given in the file */
+  int32_t row_count;
 };
 
 /* Create and return a new bcif_encoding */
@@ -1904,9 +2675,13 @@ static struct bcif_encoding *bcif_encoding_new()
   enc->maxval = 0.;
   enc->numsteps = 1;
   enc->type = -1;
+  enc->srctype = -1;
   enc->first_data_encoding = NULL;
   enc->first_offset_encoding = NULL;
   enc->string_data = NULL;
+  enc->dict.serial = 0;
+  enc->dict.size = 0;
+  enc->dict.strings = NULL;
   bcif_data_init(&enc->offsets);
   enc->next = NULL;
   return enc;
@@ -1926,6 +2701,7 @@ static void bcif_encoding_free(struct bcif_encoding *enc)
     bcif_encoding_free(inenc);
   }
   free(enc->string_data);
+  free(enc->dict.strings);
   bcif_data_free(&enc->offsets);
   free(enc);
 }
@@ -1940,6 +2716,10 @@ static struct bcif_column *bcif_column_new()
   bcif_data_init(&c->mask_data);
   c->first_encoding = NULL;
   c->first_mask_encoding = NULL;
+  c->stream = NULL;
+  c->data_start = 0;
+  c->mask_stream = NULL;
+  c->mask_start = 0;
   c->keyword = NULL;
   c->str = NULL;
   c->next = NULL;
@@ -1950,8 +2730,10 @@ static struct bcif_column *bcif_column_new()
 static void bcif_column_free(struct bcif_column *col)
 {
   free(col->name);
-  bcif_data_init(&col->data);
-  bcif_data_init(&col->mask_data);
+  bcif_data_free(&col->data);
+  bcif_data_free(&col->mask_data);
+  bcif_stream_free(col->stream);
+  bcif_stream_free(col->mask_stream);
 
   while(col->first_encoding) {
     struct bcif_encoding *enc = col->first_encoding;
@@ -1972,6 +2754,7 @@ static void bcif_category_init(struct bcif_category *cat)
 {
   cat->name = NULL;
   cat->first_column = NULL;
+  cat->row_count = -1;
 }
 
 /* Free memory used by a bcif_category */
@@ -2045,6 +2828,8 @@ static bool read_bcif_encoding(struct ihm_reader *reader,
       if (!read_bcif_int(reader, &enc->factor, err)) return false;
     } else if (strcmp(str, "type") == 0) {
       if (!read_bcif_int(reader, &enc->type, err)) return false;
+    } else if (strcmp(str, "srcType") == 0) {
+      if (!read_bcif_int(reader, &enc->srctype, err)) return false;
     } else if (strcmp(str, "min") == 0) {
       if (!read_bcif_any_double(reader, &enc->minval, err)) return false;
     } else if (strcmp(str, "max") == 0) {
@@ -2208,6 +2993,8 @@ static bool read_bcif_category(struct ihm_reader *reader,
       }
     } else if (!skip && strcmp(str, "columns") == 0) {
       if (!read_bcif_columns(reader, cat, *ihm_cat, err)) return false;
+    } else if (!skip && strcmp(str, "rowCount") == 0) {
+      if (!read_bcif_int(reader, &cat->row_count, err)) return false;
     } else {
       if (!skip_bcif_object_no_limit(reader, err)) return false;
     }
@@ -2312,17 +3099,134 @@ static bool decode_bcif_byte_array(struct bcif_data *d,
   return true;
 }
 
+/* Get the narrowest integer type that can hold all values in the given
+   range. Unsigned types are preferred if no values are negative. */
+static bcif_data_type get_narrowest_int_type(int32_t minval, int32_t maxval)
+{
+  if (minval >= 0) {
+    if (maxval <= 0xFF) {
+      return BCIF_DATA_UINT8;
+    } else if (maxval <= 0xFFFF) {
+      return BCIF_DATA_UINT16;
+    }
+  } else {
+    if (minval >= -0x80 && maxval <= 0x7F) {
+      return BCIF_DATA_INT8;
+    } else if (minval >= -0x8000 && maxval <= 0x7FFF) {
+      return BCIF_DATA_INT16;
+    }
+  }
+  return BCIF_DATA_INT32;
+}
+
+/* Get the type to use to store the output of an integer decoder, given
+   the srcType of the encoding. If the original data was an integer type
+   narrower than 32 bits, use that; otherwise, use int32. */
+static bcif_data_type get_int_output_type(struct bcif_encoding *enc)
+{
+  switch(enc->srctype) {
+  case BYTE_ARRAY_INT8:
+    return BCIF_DATA_INT8;
+  case BYTE_ARRAY_UINT8:
+    return BCIF_DATA_UINT8;
+  case BYTE_ARRAY_INT16:
+    return BCIF_DATA_INT16;
+  case BYTE_ARRAY_UINT16:
+    return BCIF_DATA_UINT16;
+  default:
+    return BCIF_DATA_INT32;
+  }
+}
+
+/* Return true iff the given value can be stored in the given integer type */
+static bool int_fits_type(int32_t value, bcif_data_type type)
+{
+  switch(type) {
+  case BCIF_DATA_INT8:
+    return value >= -0x80 && value <= 0x7F;
+  case BCIF_DATA_UINT8:
+    return value >= 0 && value <= 0xFF;
+  case BCIF_DATA_INT16:
+    return value >= -0x8000 && value <= 0x7FFF;
+  case BCIF_DATA_UINT16:
+    return value >= 0 && value <= 0xFFFF;
+  default:
+    return true;
+  }
+}
+
+/* Return the size in bytes of a single element of integer data */
+static size_t get_int_type_size(bcif_data_type type)
+{
+  switch(type) {
+  case BCIF_DATA_INT8:
+  case BCIF_DATA_UINT8:
+    return 1;
+  case BCIF_DATA_INT16:
+  case BCIF_DATA_UINT16:
+    return 2;
+  default:
+    return 4;
+  }
+}
+
+/* Store a value in an array of the given integer type (which must be large
+   enough to hold it; see int_fits_type) */
+#define SET_BCIF_INT_DATA(out, outtype, i, value)     \
+  switch(outtype) {                                   \
+  case BCIF_DATA_INT8:                                \
+    ((int8_t *)(out))[i] = (int8_t)(value);           \
+    break;                                            \
+  case BCIF_DATA_UINT8:                               \
+    ((uint8_t *)(out))[i] = (uint8_t)(value);         \
+    break;                                            \
+  case BCIF_DATA_INT16:                               \
+    ((int16_t *)(out))[i] = (int16_t)(value);         \
+    break;                                            \
+  case BCIF_DATA_UINT16:                              \
+    ((uint16_t *)(out))[i] = (uint16_t)(value);       \
+    break;                                            \
+  default:                                            \
+    ((int32_t *)(out))[i] = (value);                  \
+    break;                                            \
+  }
+
+/* Replace the data in d with a new integer array */
+static void bcif_data_assign_int(struct bcif_data *d, bcif_data_type type,
+                                 void *data, size_t size)
+{
+  bcif_data_free(d);
+  d->type = type;
+  d->data.raw = (char *)data;
+  d->size = size;
+}
+
 #define DECODE_BCIF_INT_PACK(limit_check, datapt, datatyp) \
   {                                                                      \
-  int32_t *outdata, value;                                               \
+  void *outdata;                                                         \
+  bcif_data_type outtype;                                                \
+  int32_t value, minval = 0, maxval = 0;                                 \
   size_t i, j;                                                           \
   size_t outsz = 0;                                                      \
-  /* Get the size of the decoded array. Limit values don't count. */     \
+  /* Get the size and range of the decoded array.                        \
+     Limit values don't count. */                                        \
+  value = 0;                                                             \
   for (i = 0; i < d->size; ++i) {                                        \
     datatyp t = datapt[i];                                               \
-    if (!(limit_check)) { outsz++; }                                     \
+    if (limit_check) {                                                   \
+      value += t;                                                        \
+    } else {                                                             \
+      value += t;                                                        \
+      if (outsz == 0 || value < minval) minval = value;                  \
+      if (outsz == 0 || value > maxval) maxval = value;                  \
+      outsz++;                                                           \
+      value = 0;                                                         \
+    }                                                                    \
   }                                                                      \
-  outdata = (int32_t *)ihm_malloc(outsz * sizeof(int32_t));              \
+  /* Store the output in the narrowest type that can hold it, since      \
+     IntegerPacking does not record the original type */                \
+  outtype = get_narrowest_int_type(minval, maxval);                      \
+  outdata = ihm_malloc(outsz * get_int_type_size(outtype));              \
   j = 0;                                                                 \
   value = 0;                                                             \
   for (i = 0; i < d->size; ++i) {                                        \
@@ -2330,15 +3234,12 @@ static bool decode_bcif_byte_array(struct bcif_data *d,
     if (limit_check) {                                                   \
       value += t;                                                        \
     } else {                                                             \
-      outdata[j++] = value + t;                                          \
+      SET_BCIF_INT_DATA(outdata, outtype, j, value + t);                 \
+      j++;                                                               \
       value = 0;                                                         \
     }                                                                    \
   }                                                                      \
-  bcif_data_free(d);                                                     \
-  /* todo: can the output be unsigned 32-bit ? */                        \
-  d->type = BCIF_DATA_INT32;                                             \
-  d->size = outsz;                                                       \
-  d->data.int32 = outdata;                                               \
+  bcif_data_assign_int(d, outtype, outdata, outsz);                      \
   }
 
 /* Decode data using BinaryCIF IntegerPacking encoding */
@@ -2369,6 +3270,23 @@ static bool decode_bcif_integer_packing(struct bcif_data *d,
   return true;
 }
 
+/* Delta-decode the data into a new array of the given output type. If any
+   value is out of range for the output type, stop early and set fits=false */
+#define DECODE_BCIF_DELTA_NARROW(datapt)                                 \
+  {                                                                      \
+    int32_t value;                                                       \
+    size_t i;                                                            \
+    value = enc->origin;                                                 \
+    for (i = 0; i < d->size; ++i) {                                      \
+      value += datapt[i];                                                \
+      if (!int_fits_type(value, outtype)) {                              \
+        fits = false;                                                    \
+        break;                                                           \
+      }                                                                  \
+      SET_BCIF_INT_DATA(outdata, outtype, i, value);                     \
+    }                                                                    \
+  }
+
 #define DECODE_BCIF_DELTA(datapt, outpt, datatyp) \
   {                                        \
     int32_t value;                         \
@@ -2382,11 +3300,23 @@ static bool decode_bcif_integer_packing(struct bcif_data *d,
 
 #define DECODE_BCIF_DELTA_PROMOTE(datapt, datatyp)                       \
   {                                                                      \
-    int32_t *outdata = (int32_t *)ihm_malloc(d->size * sizeof(int32_t)); \
-    DECODE_BCIF_DELTA(datapt, outdata, datatyp)                          \
-    bcif_data_free(d);                                                   \
-    d->type = BCIF_DATA_INT32;                                           \
-    d->data.int32 = outdata;                                             \
+    bcif_data_type outtype = get_int_output_type(enc);                   \
+    bool fits = true;                                                    \
+    void *outdata;                                                       \
+    /* Keep the original (narrow) type of the data if we can */          \
+    if (outtype != BCIF_DATA_INT32) {                                    \
+      outdata = ihm_malloc(d->size * get_int_type_size(outtype));        \
+      DECODE_BCIF_DELTA_NARROW(datapt);                                  \
+      if (!fits) {                                                       \
+        free(outdata);                                                   \
+      }                                                                  \
+    }                                                                    \
+    if (outtype == BCIF_DATA_INT32 || !fits) {                           \
+      outtype = BCIF_DATA_INT32;                                         \
+      outdata = ihm_malloc(d->size * sizeof(int32_t));                   \
+      DECODE_BCIF_DELTA(datapt, ((int32_t *)outdata), datatyp)           \
+    }                                                                    \
+    bcif_data_assign_int(d, outtype, outdata, d->size);                  \
   }
 
 /* Decode data using BinaryCIF Delta encoding */
@@ -2408,6 +3338,7 @@ static bool decode_bcif_delta(struct bcif_data *d,
     DECODE_BCIF_DELTA_PROMOTE(d->data.uint16, uint16_t);
     break;
   case BCIF_DATA_INT32:
+    /* 32-bit data can be decoded in place */
     DECODE_BCIF_DELTA(d->data.int32, d->data.int32, int32_t);
     break;
   default:
@@ -2421,7 +3352,9 @@ static bool decode_bcif_delta(struct bcif_data *d,
 #define DECODE_BCIF_RUN_LENGTH(datapt, datatyp)                               \
   {                                                                           \
   size_t i, k;                                                                \
-  int32_t outsz, j, *outdata;                                                 \
+  int32_t outsz, j;                                                           \
+  void *outdata;                                                              \
+  bcif_data_type outtype = get_int_output_type(enc);                          \
   outsz = 0;                                                                  \
   for (i = 1; i < d->size; i += 2) {                                          \
     int32_t ts = datapt[i];                                                   \
@@ -2434,20 +3367,22 @@ static bool decode_bcif_delta(struct bcif_data *d,
       return false;                                                           \
     }                                                                         \
     outsz += ts;                                                              \
+    /* Fall back to int32 output if srcType is too narrow for the data */     \
+    if (!int_fits_type(datapt[i - 1], outtype)) {                             \
+      outtype = BCIF_DATA_INT32;                                              \
+    }                                                                         \
   }                                                                           \
   assert(outsz > 0);                                                          \
-  outdata = (int32_t *)ihm_malloc(outsz * sizeof(int32_t));                   \
+  outdata = ihm_malloc(outsz * get_int_type_size(outtype));                   \
   for (i = 0, k = 0; i < d->size; i += 2) {                                   \
     int32_t value = datapt[i];                                                \
     int32_t n_repeats = datapt[i + 1];                                        \
     for (j = 0; j < n_repeats; ++j) {                                         \
-      outdata[k++] = value;                                                   \
+      SET_BCIF_INT_DATA(outdata, outtype, k, value);                          \
+      k++;                                                                    \
     }                                                                         \
   }                                                                           \
-  bcif_data_free(d);                                                          \
-  d->type = BCIF_DATA_INT32;                                                  \
-  d->size = outsz;                                                            \
-  d->data.int32 = outdata;                                                    \
+  bcif_data_assign_int(d, outtype, outdata, outsz);                           \
 }
 
 /* Decode data using BinaryCIF RunLength encoding */
@@ -2476,6 +3411,9 @@ static bool decode_bcif_run_length(struct bcif_data *d,
   case BCIF_DATA_INT32:
     DECODE_BCIF_RUN_LENGTH(d->data.int32, int32_t);
     break;
+  case BCIF_DATA_UINT32:
+    DECODE_BCIF_RUN_LENGTH(d->data.uint32, uint32_t);
+    break;
   default:
     ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
                   "RunLength not given integers as input");
@@ -2484,19 +3422,41 @@ static bool decode_bcif_run_length(struct bcif_data *d,
   return true;
 }
 
-#define DECODE_BCIF_FIXED_POINT(datapt)                                 \
+/* Decode fixed point or quantized data to floating point, using the
+   formula `expr` (in terms of the input value `v`). If the original
+   data (srcType) was single precision, output float, otherwise double.
+   If the input and output are the same size, decode in place. */
+#define DECODE_BCIF_TO_FLOAT(datapt, datatyp, expr)                     \
   {                                                                     \
     size_t i;                                                           \
-    /* We ignore srcType and always output double (not float) */        \
-    double *outdata = (double *)ihm_malloc(d->size * sizeof(double));   \
-    for (i = 0; i < d->size; ++i) {                                     \
-      outdata[i] = (double)datapt[i] / enc->factor;                     \
+    if (enc->srctype == BYTE_ARRAY_FLOAT) {                             \
+      float *outdata = sizeof(datatyp) == sizeof(float)                 \
+                 ? (float *)d->data.raw                                 \
+                 : (float *)ihm_malloc(d->size * sizeof(float));        \
+      for (i = 0; i < d->size; ++i) {                                   \
+        double v = datapt[i];                                           \
+        outdata[i] = (float)(expr);                                     \
+      }                                                                 \
+      if ((char *)outdata != d->data.raw) {                             \
+        bcif_data_free(d);                                              \
+      }                                                                 \
+      d->type = BCIF_DATA_FLOAT;                                        \
+      d->data.float32 = outdata;                                        \
+    } else {                                                            \
+      double *outdata = (double *)ihm_malloc(d->size * sizeof(double)); \
+      for (i = 0; i < d->size; ++i) {                                   \
+        double v = datapt[i];                                           \
+        outdata[i] = (expr);                                            \
+      }                                                                 \
+      bcif_data_free(d);                                                \
+      d->type = BCIF_DATA_DOUBLE;                                       \
+      d->data.float64 = outdata;                                        \
     }                                                                   \
-    bcif_data_free(d);                                                  \
-    d->type = BCIF_DATA_DOUBLE;                                         \
-    d->data.float64 = outdata;                                          \
   }
 
+#define DECODE_BCIF_FIXED_POINT(datapt, datatyp)                        \
+  DECODE_BCIF_TO_FLOAT(datapt, datatyp, v / enc->factor)
+
 /* Decode data using BinaryCIF FixedPoint encoding */
 static bool decode_bcif_fixed_point(struct bcif_data *d,
                                     struct bcif_encoding *enc,
@@ -2504,22 +3464,22 @@ static bool decode_bcif_fixed_point(struct bcif_data *d,
 {
   switch (d->type) {
   case BCIF_DATA_INT8:
-    DECODE_BCIF_FIXED_POINT(d->data.int8);
+    DECODE_BCIF_FIXED_POINT(d->data.int8, int8_t);
     break;
   case BCIF_DATA_UINT8:
-    DECODE_BCIF_FIXED_POINT(d->data.uint8);
+    DECODE_BCIF_FIXED_POINT(d->data.uint8, uint8_t);
     break;
   case BCIF_DATA_INT16:
-    DECODE_BCIF_FIXED_POINT(d->data.int16);
+    DECODE_BCIF_FIXED_POINT(d->data.int16, int16_t);
     break;
   case BCIF_DATA_UINT16:
-    DECODE_BCIF_FIXED_POINT(d->data.uint16);
+    DECODE_BCIF_FIXED_POINT(d->data.uint16, uint16_t);
     break;
   case BCIF_DATA_INT32:
-    DECODE_BCIF_FIXED_POINT(d->data.int32);
+    DECODE_BCIF_FIXED_POINT(d->data.int32, int32_t);
     break;
   case BCIF_DATA_UINT32:
-    DECODE_BCIF_FIXED_POINT(d->data.uint32);
+    DECODE_BCIF_FIXED_POINT(d->data.uint32, uint32_t);
     break;
   default:
     ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
@@ -2529,18 +3489,10 @@ static bool decode_bcif_fixed_point(struct bcif_data *d,
   return true;
 }
 
-#define DECODE_BCIF_INTERVAL_QUANT(datapt)                              \
+#define DECODE_BCIF_INTERVAL_QUANT(datapt, datatyp)                     \
   {                                                                     \
-    size_t i;                                                           \
-    /* We ignore srcType and always output double (not float) */        \
-    double *outdata = (double *)ihm_malloc(d->size * sizeof(double));   \
     double delta = (enc->maxval - enc->minval) / (enc->numsteps - 1);   \
-    for (i = 0; i < d->size; ++i) {                                     \
-      outdata[i] = enc->minval + delta * datapt[i];                     \
-    }                                                                   \
-    bcif_data_free(d);                                                  \
-    d->type = BCIF_DATA_DOUBLE;                                         \
-    d->data.float64 = outdata;                                          \
+    DECODE_BCIF_TO_FLOAT(datapt, datatyp, enc->minval + delta * v)      \
   }
 
 /* Decode data using BinaryCIF IntervalQuantization encoding */
@@ -2556,22 +3508,22 @@ static bool decode_bcif_interval_quant(struct bcif_data *d,
   }
   switch (d->type) {
   case BCIF_DATA_INT8:
-    DECODE_BCIF_INTERVAL_QUANT(d->data.int8);
+    DECODE_BCIF_INTERVAL_QUANT(d->data.int8, int8_t);
     break;
   case BCIF_DATA_UINT8:
-    DECODE_BCIF_INTERVAL_QUANT(d->data.uint8);
+    DECODE_BCIF_INTERVAL_QUANT(d->data.uint8, uint8_t);
     break;
   case BCIF_DATA_INT16:
-    DECODE_BCIF_INTERVAL_QUANT(d->data.int16);
+    DECODE_BCIF_INTERVAL_QUANT(d->data.int16, int16_t);
     break;
   case BCIF_DATA_UINT16:
-    DECODE_BCIF_INTERVAL_QUANT(d->data.uint16);
+    DECODE_BCIF_INTERVAL_QUANT(d->data.uint16, uint16_t);
     break;
   case BCIF_DATA_INT32:
-    DECODE_BCIF_INTERVAL_QUANT(d->data.int32);
+    DECODE_BCIF_INTERVAL_QUANT(d->data.int32, int32_t);
     break;
   case BCIF_DATA_UINT32:
-    DECODE_BCIF_INTERVAL_QUANT(d->data.uint32);
+    DECODE_BCIF_INTERVAL_QUANT(d->data.uint32, uint32_t);
     break;
   default:
     ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
@@ -2617,20 +3569,15 @@ static int32_t get_int_data(struct bcif_data *d, int i)
   }
 }
 
-/* Decode data using BinaryCIF StringArray encoding */
-static bool decode_bcif_string_array(struct bcif_data *d,
-                                     struct bcif_encoding *enc,
-                                     struct ihm_error **err)
+/* Build the dictionary of distinct strings (enc->dict) for BinaryCIF
+   StringArray encoding, from the (already decoded) offsets and string data */
+static bool decode_bcif_string_dict(struct bcif_encoding *enc,
+                                    struct ihm_error **err)
 {
-  char *newstring, **strarr;
+  char *newstring;
   int32_t stringsz;
-  size_t i;
-  int *starts, start;
-  if (!require_bcif_data_is_int32(d)) {
-    ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
-                  "StringArray not given integers as input");
-    return false;
-  }
+  size_t i, nstrings;
+  int start;
   if (!require_bcif_data_is_int32(&enc->offsets)) {
     ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
                   "StringArray not given integers as offsets");
@@ -2647,41 +3594,60 @@ static bool decode_bcif_string_array(struct bcif_data *d,
       return false;
     }
   }
+  nstrings = enc->offsets.size > 0 ? enc->offsets.size - 1 : 0;
   /* Add nulls to string_data so we can point directly into it */
   stringsz = 0;
-  for (i = 0; i < enc->offsets.size - 1; ++i) {
+  for (i = 0; i < nstrings; ++i) {
     stringsz += 1 + get_int_data(&enc->offsets, i + 1)
                 - get_int_data(&enc->offsets, i);
   }
   newstring = (char *)ihm_malloc(stringsz);
-  starts = (int *)ihm_malloc((enc->offsets.size - 1) * sizeof(int));
+  free(enc->dict.strings);
+  enc->dict.strings = (char **)ihm_malloc(nstrings * sizeof(char *));
+  enc->dict.size = nstrings;
   start = 0;
-  for (i = 0; i < enc->offsets.size - 1; ++i) {
+  for (i = 0; i < nstrings; ++i) {
     stringsz = get_int_data(&enc->offsets, i + 1)
                - get_int_data(&enc->offsets, i);
     memcpy(newstring + start, enc->string_data + get_int_data(&enc->offsets, i),
            stringsz);
     newstring[start + stringsz] = '\0';
-    starts[i] = start;
+    enc->dict.strings[i] = newstring + start;
     start += stringsz + 1;
   }
   free(enc->string_data);
   enc->string_data = newstring;
-  strarr = (char **)ihm_malloc(d->size * sizeof(char *));
+  return true;
+}
+
+/* Decode data using BinaryCIF StringArray encoding. Rather than making
+   a string for every row, the output is kept in dictionary form: each
+   distinct string is stored once (in enc->dict) and the data is
+   an index into the dictionary for each row. */
+static bool decode_bcif_string_array(struct bcif_data *d,
+                                     struct bcif_encoding *enc,
+                                     struct ihm_error **err)
+{
+  int32_t *indices;
+  size_t i;
+  if (!require_bcif_data_is_int32(d)) {
+    ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
+                  "StringArray not given integers as input");
+    return false;
+  }
+  if (!decode_bcif_string_dict(enc, err)) return false;
+  indices = (int32_t *)ihm_malloc(d->size * sizeof(int32_t));
   for (i = 0; i < d->size; ++i) {
     int32_t strnum = get_int_data(d, i);
-    /* If strnum out of range, return a null string (this usually corresponds
-       to masked data) */
-    if (strnum < 0 || (size_t)strnum >= enc->offsets.size) {
-      strarr[i] = "";
-    } else {
-      strarr[i] = enc->string_data + starts[strnum];
-    }
+    /* If strnum out of range, map to -1 (a null string); this usually
+       corresponds to masked data */
+    indices[i] = (strnum < 0 || (size_t)strnum >= enc->dict.size)
+                 ? -1 : strnum;
   }
-  free(starts);
   bcif_data_free(d);
   d->type = BCIF_DATA_STRING;
-  d->data.string = strarr;
+  d->data.int32 = indices;
+  d->dict = &enc->dict;
   return true;
 }
 
@@ -2725,6 +3691,350 @@ static bool decode_bcif_data(struct bcif_data *d, struct bcif_encoding *enc,
   return true;
 }
 
+/* Determine whether data encoded with the given encodings can be decoded
+   as a stream (see bcif_stream) and if so, return the kind of the decoded
+   values. This is the case for all common encodings; anything unusual
+   returns BCIF_STREAM_NONE, and should be decoded in one go with
+   decode_bcif_data instead (which will also report any errors). */
+static bcif_stream_kind get_bcif_stream_kind(struct bcif_encoding *enc)
+{
+  bcif_stream_kind kind = BCIF_STREAM_NONE;
+  struct bcif_encoding *prev = NULL;
+  for (; enc; prev = enc, enc = enc->next) {
+    switch(enc->kind) {
+    case BCIF_ENC_BYTE_ARRAY:
+      if (prev) return BCIF_STREAM_NONE;
+      switch(enc->type) {
+      case BYTE_ARRAY_INT8:
+      case BYTE_ARRAY_UINT8:
+      case BYTE_ARRAY_INT16:
+      case BYTE_ARRAY_UINT16:
+      case BYTE_ARRAY_INT32:
+        kind = BCIF_STREAM_INT;
+        break;
+      case BYTE_ARRAY_UINT32:
+        kind = BCIF_STREAM_UINT32;
+        break;
+      case BYTE_ARRAY_FLOAT:
+        kind = BCIF_STREAM_FLOAT;
+        break;
+      case BYTE_ARRAY_DOUBLE:
+        kind = BCIF_STREAM_DOUBLE;
+        break;
+      default:
+        return BCIF_STREAM_NONE;
+      }
+      break;
+    case BCIF_ENC_INTEGER_PACKING:
+      /* Input must be 8- or 16-bit integers straight from a ByteArray */
+      if (!prev || prev->kind != BCIF_ENC_BYTE_ARRAY
+          || (prev->type != BYTE_ARRAY_INT8 && prev->type != BYTE_ARRAY_UINT8
+              && prev->type != BYTE_ARRAY_INT16
+              && prev->type != BYTE_ARRAY_UINT16)) {
+        return BCIF_STREAM_NONE;
+      }
+      break;
+    case BCIF_ENC_DELTA:
+    case BCIF_ENC_RUN_LENGTH:
+      if (kind != BCIF_STREAM_INT) return BCIF_STREAM_NONE;
+      break;
+    case BCIF_ENC_INTERVAL_QUANT:
+      if (enc->numsteps < 2) return BCIF_STREAM_NONE;
+      /* fall through */
+    case BCIF_ENC_FIXED_POINT:
+      if (kind != BCIF_STREAM_INT && kind != BCIF_STREAM_UINT32) {
+        return BCIF_STREAM_NONE;
+      }
+      kind = enc->srctype == BYTE_ARRAY_FLOAT ? BCIF_STREAM_FLOAT
+                                              : BCIF_STREAM_DOUBLE;
+      break;
+    case BCIF_ENC_STRING_ARRAY:
+      /* StringArray encodes the string indices itself, so should be the
+         only encoding */
+      if (prev || enc->next
+          || get_bcif_stream_kind(enc->first_data_encoding)
+                   != BCIF_STREAM_INT) {
+        return BCIF_STREAM_NONE;
+      }
+      kind = BCIF_STREAM_STRING;
+      break;
+    default:
+      return BCIF_STREAM_NONE;
+    }
+  }
+  return kind;
+}
+
+/* Prepare raw data for streamed ByteArray decoding */
+static bool setup_byte_array_stream(struct bcif_stream *s,
+                                    struct ihm_error **err)
+{
+  if (s->raw.type != BCIF_DATA_RAW) {
+    ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
+                  "ByteArray not given raw data as input");
+    return false;
+  }
+  switch(s->enc->type) {
+  case BYTE_ARRAY_INT16:
+  case BYTE_ARRAY_UINT16:
+    return handle_byte_array_size(&s->raw, sizeof(int16_t), err);
+  case BYTE_ARRAY_INT32:
+  case BYTE_ARRAY_UINT32:
+  case BYTE_ARRAY_FLOAT:
+    return handle_byte_array_size(&s->raw, sizeof(int32_t), err);
+  case BYTE_ARRAY_DOUBLE:
+    return handle_byte_array_size(&s->raw, sizeof(double), err);
+  default:
+    return true;
+  }
+}
+
+/* Make a new stream to decode the given encodings (which must be
+   streamable; see get_bcif_stream_kind). The stream takes ownership
+   of the raw data. */
+static struct bcif_stream *bcif_stream_new(struct bcif_encoding *enc,
+                                           struct bcif_data *raw,
+                                           struct ihm_error **err)
+{
+  struct bcif_stream *s = NULL;
+  for (; enc; enc = enc->next) {
+    struct bcif_stream *input = s;
+    if (enc->kind == BCIF_ENC_STRING_ARRAY) {
+      /* The dictionary is decoded up front; only the indices are streamed */
+      if (!decode_bcif_data(&enc->offsets, enc->first_offset_encoding, err)
+          || !decode_bcif_string_dict(enc, err)) return NULL;
+      input = bcif_stream_new(enc->first_data_encoding, raw, err);
+      if (!input) return NULL;
+    }
+    s = (struct bcif_stream *)ihm_malloc(sizeof(struct bcif_stream));
+    s->enc = enc;
+    s->input = input;
+    bcif_data_init(&s->raw);
+    s->raw_pos = 0;
+    s->buf = NULL;
+    s->buf_pos = s->buf_len = 0;
+    s->value = enc->kind == BCIF_ENC_DELTA ? enc->origin : 0;
+    s->run_value = s->run_left = 0;
+    if (enc->kind == BCIF_ENC_INTEGER_PACKING
+        || enc->kind == BCIF_ENC_RUN_LENGTH) {
+      s->buf = (union bcif_value *)ihm_malloc(BCIF_STREAM_BUFFER_SIZE
+                                              * sizeof(union bcif_value));
+    } else if (enc->kind == BCIF_ENC_BYTE_ARRAY) {
+      s->raw = *raw;
+      bcif_data_init(raw);
+      if (!setup_byte_array_stream(s, err)) {
+        bcif_stream_free(s);
+        return NULL;
+      }
+    }
+  }
+  return s;
+}
+
+static bool bcif_stream_read(struct bcif_stream *s, union bcif_value *out,
+                             size_t n, size_t *nread, struct ihm_error **err);
+
+/* Get the next value from the input of the given stream stage.
+   At the end of the input, *eof is set to true. */
+static bool bcif_stream_next(struct bcif_stream *s, union bcif_value *value,
+                             bool *eof, struct ihm_error **err)
+{
+  if (s->buf_pos == s->buf_len) {
+    s->buf_pos = 0;
+    if (!bcif_stream_read(s->input, s->buf, BCIF_STREAM_BUFFER_SIZE,
+                          &s->buf_len, err)) return false;
+    if (s->buf_len == 0) {
+      *eof = true;
+      return true;
+    }
+  }
+  *eof = false;
+  *value = s->buf[s->buf_pos++];
+  return true;
+}
+
+#define READ_BCIF_BYTE_ARRAY_STREAM(datatyp, member)               \
+  for (i = 0; i < n; ++i) {                                        \
+    out[i].member = ((datatyp *)s->raw.data.raw)[s->raw_pos + i];  \
+  }
+
+/* Read up to n values from a ByteArray stream stage */
+static void read_byte_array_stream(struct bcif_stream *s,
+                                   union bcif_value *out, size_t n,
+                                   size_t *nread)
+{
+  size_t i;
+  if (n > s->raw.size - s->raw_pos) {
+    n = s->raw.size - s->raw_pos;
+  }
+  switch(s->enc->type) {
+  case BYTE_ARRAY_INT8:
+    READ_BCIF_BYTE_ARRAY_STREAM(int8_t, i);
+    break;
+  case BYTE_ARRAY_UINT8:
+    READ_BCIF_BYTE_ARRAY_STREAM(uint8_t, i);
+    break;
+  case BYTE_ARRAY_INT16:
+    READ_BCIF_BYTE_ARRAY_STREAM(int16_t, i);
+    break;
+  case BYTE_ARRAY_UINT16:
+    READ_BCIF_BYTE_ARRAY_STREAM(uint16_t, i);
+    break;
+  case BYTE_ARRAY_INT32:
+    READ_BCIF_BYTE_ARRAY_STREAM(int32_t, i);
+    break;
+  case BYTE_ARRAY_UINT32:
+    READ_BCIF_BYTE_ARRAY_STREAM(uint32_t, i);
+    break;
+  case BYTE_ARRAY_FLOAT:
+    READ_BCIF_BYTE_ARRAY_STREAM(float, f);
+    break;
+  case BYTE_ARRAY_DOUBLE:
+    READ_BCIF_BYTE_ARRAY_STREAM(double, f);
+    break;
+  }
+  s->raw_pos += n;
+  *nread = n;
+}
+
+/* Return true iff the given IntegerPacking input value is a limit value,
+   i.e. should be added to the following value */
+static bool is_integer_packing_limit(int32_t input_type, int64_t t)
+{
+  switch(input_type) {
+  case BYTE_ARRAY_UINT8:
+    return t == 0xFF;
+  case BYTE_ARRAY_INT8:
+    return t == 0x7F || t == -0x80;
+  case BYTE_ARRAY_UINT16:
+    return t == 0xFFFF;
+  default:
+    return t == 0x7FFF || t == -0x8000;
+  }
+}
+
+/* Read up to n values from an IntegerPacking stream stage */
+static bool read_integer_packing_stream(struct bcif_stream *s,
+                                        union bcif_value *out, size_t n,
+                                        size_t *nread, struct ihm_error **err)
+{
+  size_t k = 0;
+  int32_t input_type = s->input->enc->type;
+  while (k < n) {
+    union bcif_value t;
+    bool eof;
+    if (!bcif_stream_next(s, &t, &eof, err)) return false;
+    if (eof) break;
+    s->value += t.i;
+    if (!is_integer_packing_limit(input_type, t.i)) {
+      out[k++].i = s->value;
+      s->value = 0;
+    }
+  }
+  *nread = k;
+  return true;
+}
+
+/* Read up to n values from a RunLength stream stage */
+static bool read_run_length_stream(struct bcif_stream *s,
+                                   union bcif_value *out, size_t n,
+                                   size_t *nread, struct ihm_error **err)
+{
+  size_t k = 0;
+  while (k < n) {
+    union bcif_value value, count;
+    bool eof;
+    if (s->run_left > 0) {
+      size_t nrep = n - k < (size_t)s->run_left ? n - k : (size_t)s->run_left;
+      s->run_left -= nrep;
+      while (nrep-- > 0) {
+        out[k++].i = s->run_value;
+      }
+      continue;
+    }
+    if (!bcif_stream_next(s, &value, &eof, err)) return false;
+    if (eof) break;
+    if (!bcif_stream_next(s, &count, &eof, err)) return false;
+    if (eof) {
+      ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
+                    "Run length data size is not even");
+      return false;
+    }
+    /* See DECODE_BCIF_RUN_LENGTH for the rationale for the upper limit */
+    if (count.i < 0 || count.i > 40000000) {
+      ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
+                    "Bad run length repeat count %d", (int)count.i);
+      return false;
+    }
+    s->run_value = (int32_t)value.i;
+    s->run_left = (int32_t)count.i;
+  }
+  *nread = k;
+  return true;
+}
+
+/* Read up to n decoded values from the given stream into out.
+   *nread is set to the number of values actually read, which is
+   less than n only when the end of the data is reached. */
+static bool bcif_stream_read(struct bcif_stream *s, union bcif_value *out,
+                             size_t n, size_t *nread, struct ihm_error **err)
+{
+  size_t i;
+  struct bcif_encoding *enc = s->enc;
+  switch(enc->kind) {
+  case BCIF_ENC_BYTE_ARRAY:
+    read_byte_array_stream(s, out, n, nread);
+    return true;
+  case BCIF_ENC_INTEGER_PACKING:
+    return read_integer_packing_stream(s, out, n, nread, err);
+  case BCIF_ENC_RUN_LENGTH:
+    return read_run_length_stream(s, out, n, nread, err);
+  default:
+    break;
+  }
+
+  /* All other encodings map input to output one-to-one, so can be
+     decoded in place */
+  if (!bcif_stream_read(s->input, out, n, nread, err)) return false;
+  switch(enc->kind) {
+  case BCIF_ENC_DELTA:
+    for (i = 0; i < *nread; ++i) {
+      s->value += out[i].i;
+      out[i].i = s->value;
+    }
+    break;
+  case BCIF_ENC_FIXED_POINT:
+    for (i = 0; i < *nread; ++i) {
+      double v = out[i].i;
+      out[i].f = enc->srctype == BYTE_ARRAY_FLOAT ? (float)(v / enc->factor)
+                                                  : v / enc->factor;
+    }
+    break;
+  case BCIF_ENC_INTERVAL_QUANT:
+    {
+      double delta = (enc->maxval - enc->minval) / (enc->numsteps - 1);
+      for (i = 0; i < *nread; ++i) {
+        double v = out[i].i;
+        out[i].f = enc->srctype == BYTE_ARRAY_FLOAT
+                   ? (float)(enc->minval + delta * v)
+                   : enc->minval + delta * v;
+      }
+    }
+    break;
+  case BCIF_ENC_STRING_ARRAY:
+    for (i = 0; i < *nread; ++i) {
+      int64_t strnum = out[i].i;
+      /* See decode_bcif_string_array */
+      out[i].i = (strnum < 0 || (size_t)strnum >= enc->dict.size)
+                 ? -1 : strnum;
+    }
+    break;
+  default:
+    break;
+  }
+  return true;
+}
+
 /* Map BinaryCIF columns to ihm_keywords */
 static bool check_bcif_columns(struct ihm_reader *reader,
                                struct bcif_category *cat,
@@ -2737,8 +4047,10 @@ static bool check_bcif_columns(struct ihm_reader *reader,
     col->keyword = (struct ihm_keyword *)ihm_mapping_lookup(
                                   ihm_cat->keyword_map, col->name);
     if (!col->keyword && reader->unknown_keyword_callback) {
+      double start = callback_start(reader);
       (*reader->unknown_keyword_callback)(reader, cat->name, col->name, 0,
                                           reader->unknown_keyword_data, err);
+      callback_end(reader, start, NULL);
       if (*err) return false;
     }
   }
@@ -2746,10 +4058,14 @@ static bool check_bcif_columns(struct ihm_reader *reader,
 }
 
 /* Decode and check the column's data */
-static bool process_column_data(struct bcif_column *col,
+static bool process_column_data(struct ihm_reader *reader,
+                                struct bcif_column *col,
                                 struct ihm_error **err)
 {
   if (!decode_bcif_data(&col->data, col->first_encoding, err)) return false;
+  if (col->data.type == BCIF_DATA_STRING) {
+    col->data.dict->serial = ++reader->dict_serial;
+  }
   switch(col->data.type) {
   case BCIF_DATA_INT32:
   case BCIF_DATA_INT8:
@@ -2778,18 +4094,20 @@ static bool process_column_mask(struct bcif_column *col,
   if (!decode_bcif_data(&col->mask_data, col->first_mask_encoding,
                         err)) return false;
 
-  /* Masks are supposed to be uint8 but some of our decoders return int32
-     for simplicity. If this happened, map back to uint8 */
-  if (col->mask_data.type == BCIF_DATA_INT32) {
+  /* Masks are supposed to be uint8 but our decoders may return another
+     integer type if srcType was not given. If this happened (i.e. the
+     mask is not simply a ByteArray), map back to uint8 */
+  if (col->mask_data.type != BCIF_DATA_UINT8
+      && col->first_mask_encoding && col->first_mask_encoding->next
+      && require_bcif_data_is_int32(&col->mask_data)) {
     uint8_t *newdata;
     size_t i;
     newdata = (uint8_t *)ihm_malloc(col->mask_data.size * sizeof(uint8_t));
     for (i = 0; i < col->mask_data.size; ++i) {
-      newdata[i] = (uint8_t)col->mask_data.data.int32[i];
+      newdata[i] = (uint8_t)get_int_data(&col->mask_data, i);
     }
-    free(col->mask_data.data.int32);
-    col->mask_data.data.uint8 = newdata;
-    col->mask_data.type = BCIF_DATA_UINT8;
+    bcif_data_assign_int(&col->mask_data, BCIF_DATA_UINT8, newdata,
+                         col->mask_data.size);
   }
 
   if (col->mask_data.type != BCIF_DATA_UINT8) {
@@ -2847,8 +4165,10 @@ static void set_value_from_bcif_string(struct ihm_keyword *key, char *str,
   }
 }
 
+/* Set the value of the keyword from a floating point value. If the value
+   was originally single precision, `single` should be true. */
 static void set_value_from_bcif_double(struct ihm_keyword *key, double fval,
-                                       char *buffer)
+                                       bool single, char *buffer)
 {
   key->omitted = key->unknown = false;
   key->in_file = true;
@@ -2856,7 +4176,7 @@ static void set_value_from_bcif_double(struct ihm_keyword *key, double fval,
   case IHM_STRING:
     /* We (not the keyword) own buffer */
     key->own_data = false;
-    sprintf(buffer, "%g", fval);
+    ihm_dtoa(buffer, fval, single);
     key->data.str = buffer;
     break;
   case IHM_INT:
@@ -2882,7 +4202,7 @@ static void set_value_from_bcif_int(struct ihm_keyword *key, int32_t ival,
   case IHM_STRING:
     /* We (not the keyword) own buffer */
     key->own_data = false;
-    sprintf(buffer, "%d", ival);
+    ihm_itoa(buffer, ival);
     key->data.str = buffer;
     break;
   case IHM_INT:
@@ -2909,19 +4229,32 @@ static void set_value_from_data(struct ihm_reader *reader,
     free(key->data.str);
     key->data.str = NULL;
   }
+  key->dict = NULL;
+  key->dict_index = -1;
 
   /* BinaryCIF data is typed (not always a string like mmCIF), so we may
      need to convert to the desired output type. */
   switch(data->type) {
   case BCIF_DATA_STRING:
-    set_value_from_bcif_string(key, data->data.string[irow], err);
+    {
+      int32_t strnum = data->data.int32[irow];
+      if (strnum < 0) {
+        set_value_from_bcif_string(key, "", err);
+      } else {
+        set_value_from_bcif_string(key, data->dict->strings[strnum], err);
+        if (key->type == IHM_STRING) {
+          key->dict = data->dict;
+          key->dict_index = strnum;
+        }
+      }
+    }
     break;
   case BCIF_DATA_FLOAT:
     /* promote to double */
-    set_value_from_bcif_double(key, data->data.float32[irow], buffer);
+    set_value_from_bcif_double(key, data->data.float32[irow], true, buffer);
     break;
   case BCIF_DATA_DOUBLE:
-    set_value_from_bcif_double(key, data->data.float64[irow], buffer);
+    set_value_from_bcif_double(key, data->data.float64[irow], false, buffer);
     break;
   case BCIF_DATA_INT8:
     /* promote to int32 */
@@ -2960,14 +4293,14 @@ static bool process_bcif_row(struct ihm_reader *reader,
     if (!col->keyword) continue;
 
     if (col->mask_data.type == BCIF_DATA_UINT8
-        && col->mask_data.data.uint8[irow] == 1) {
+        && col->mask_data.data.uint8[irow - col->mask_start] == 1) {
       set_omitted_value(col->keyword);
     } else if (col->mask_data.type == BCIF_DATA_UINT8
-               && col->mask_data.data.uint8[irow] == 2) {
+               && col->mask_data.data.uint8[irow - col->mask_start] == 2) {
       set_unknown_value(col->keyword);
     } else {
-      set_value_from_data(reader, ihm_cat, col->keyword, &col->data, irow,
-                          col->str, err);
+      set_value_from_data(reader, ihm_cat, col->keyword, &col->data,
+                          irow - col->data_start, col->str, err);
       if (*err) return false;
     }
   }
@@ -2978,6 +4311,184 @@ static bool process_bcif_row(struct ihm_reader *reader,
   return true;
 }
 
+/* Make a buffer to hold a window of decoded values of the given kind */
+static void make_bcif_window(struct bcif_data *d, bcif_stream_kind kind,
+                             size_t size)
+{
+  switch(kind) {
+  case BCIF_STREAM_FLOAT:
+    d->type = BCIF_DATA_FLOAT;
+    d->data.float32 = (float *)ihm_malloc(size * sizeof(float));
+    break;
+  case BCIF_STREAM_DOUBLE:
+    d->type = BCIF_DATA_DOUBLE;
+    d->data.float64 = (double *)ihm_malloc(size * sizeof(double));
+    break;
+  case BCIF_STREAM_STRING:
+    d->type = BCIF_DATA_STRING;
+    d->data.int32 = (int32_t *)ihm_malloc(size * sizeof(int32_t));
+    break;
+  default:
+    d->type = BCIF_DATA_INT32;
+    d->data.int32 = (int32_t *)ihm_malloc(size * sizeof(int32_t));
+    break;
+  }
+  d->size = 0;
+}
+
+/* Set up the column's data and mask so that they can be decoded a window
+   of `window_size` rows at a time. Any data or mask that cannot be decoded
+   this way is instead decoded in full. */
+static bool setup_column_window(struct ihm_reader *reader,
+                                struct bcif_column *col, size_t window_size,
+                                struct ihm_error **err)
+{
+  bcif_stream_kind kind = get_bcif_stream_kind(col->first_encoding);
+  if (kind == BCIF_STREAM_NONE || kind == BCIF_STREAM_UINT32) {
+    if (!process_column_data(reader, col, err)) return false;
+  } else {
+    col->stream = bcif_stream_new(col->first_encoding, &col->data, err);
+    if (!col->stream) return false;
+    make_bcif_window(&col->data, kind, window_size);
+    if (kind == BCIF_STREAM_STRING) {
+      col->data.dict = &col->first_encoding->dict;
+      col->data.dict->serial = ++reader->dict_serial;
+    }
+  }
+
+  if (col->mask_data.type == BCIF_DATA_NULL) {
+    return true;
+  }
+  kind = get_bcif_stream_kind(col->first_mask_encoding);
+  /* Masks should be uint8; as for process_column_mask, other integer
+     types are only accepted if the mask is not simply a ByteArray */
+  if (kind == BCIF_STREAM_INT
+      && (col->first_mask_encoding->next
+          || col->first_mask_encoding->type == BYTE_ARRAY_UINT8)) {
+    col->mask_stream = bcif_stream_new(col->first_mask_encoding,
+                                       &col->mask_data, err);
+    if (!col->mask_stream) return false;
+    col->mask_data.type = BCIF_DATA_UINT8;
+    col->mask_data.data.uint8 = (uint8_t *)ihm_malloc(window_size
+                                                      * sizeof(uint8_t));
+    col->mask_data.size = 0;
+    return true;
+  } else {
+    return process_column_mask(col, err);
+  }
+}
+
+/* Decode the next window of `n` rows, starting at row `start`, for a
+   column's data or mask. `values` is a buffer large enough to hold n
+   values. Return false and set err if the data contains fewer rows. */
+static bool fill_bcif_window(struct bcif_stream *s, struct bcif_data *d,
+                             size_t *data_start, size_t start, size_t n,
+                             union bcif_value *values, const char *cat_name,
+                             struct ihm_error **err)
+{
+  size_t i, nread;
+  if (!s) return true;
+  if (!bcif_stream_read(s, values, n, &nread, err)) return false;
+  if (nread != n) {
+    ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
+                  "Column size mismatch %d != %d in category %s",
+                  start + nread, start + n, cat_name);
+    return false;
+  }
+  switch(d->type) {
+  case BCIF_DATA_UINT8:
+    for (i = 0; i < n; ++i) {
+      d->data.uint8[i] = (uint8_t)values[i].i;
+    }
+    break;
+  case BCIF_DATA_FLOAT:
+    for (i = 0; i < n; ++i) {
+      d->data.float32[i] = (float)values[i].f;
+    }
+    break;
+  case BCIF_DATA_DOUBLE:
+    for (i = 0; i < n; ++i) {
+      d->data.float64[i] = values[i].f;
+    }
+    break;
+  default:
+    for (i = 0; i < n; ++i) {
+      d->data.int32[i] = (int32_t)values[i].i;
+    }
+    break;
+  }
+  d->size = n;
+  *data_start = start;
+  return true;
+}
+
+/* Send out the data for a category via callbacks, decoding it a window of
+   reader->bcif_chunk_size rows at a time. This avoids having the entire
+   decoded data for a large category in memory at once. */
+static bool process_bcif_category_windowed(struct ihm_reader *reader,
+                                           struct bcif_category *cat,
+                                           struct ihm_category *ihm_cat,
+                                           struct ihm_error **err)
+{
+  struct bcif_column *col;
+  size_t i, start, n_rows = cat->row_count;
+  size_t window_size = reader->bcif_chunk_size;
+  union bcif_value *values;
+  bool ok = true;
+
+  for (col = cat->first_column; col; col = col->next) {
+    if (!col->keyword) continue;
+    if (!setup_column_window(reader, col, window_size, err)) return false;
+    col->str = (char *)ihm_malloc(80);
+    /* Columns that were decoded in full must match the row count */
+    if (!col->stream && col->data.size != n_rows) {
+      ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
+                    "Column size mismatch %d != %d in category %s",
+                    col->data.size, n_rows, cat->name);
+      return false;
+    }
+    if (col->mask_data.type != BCIF_DATA_NULL && !col->mask_stream
+        && col->mask_data.size < n_rows) {
+      ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
+                    "Column mask size mismatch %d != %d in category %s",
+                    col->mask_data.size, n_rows, cat->name);
+      return false;
+    }
+  }
+
+  values = (union bcif_value *)ihm_malloc(window_size
+                                          * sizeof(union bcif_value));
+  for (start = 0; ok && start < n_rows; start += window_size) {
+    size_t n = n_rows - start < window_size ? n_rows - start : window_size;
+    for (col = cat->first_column; ok && col; col = col->next) {
+      if (!col->keyword) continue;
+      ok = fill_bcif_window(col->stream, &col->data, &col->data_start,
+                            start, n, values, cat->name, err)
+           && fill_bcif_window(col->mask_stream, &col->mask_data,
+                               &col->mask_start, start, n, values,
+                               cat->name, err);
+    }
+    for (i = start; ok && i < start + n; ++i) {
+      ok = process_bcif_row(reader, cat, ihm_cat, i, err);
+    }
+  }
+
+  /* Make sure there is no leftover data */
+  for (col = cat->first_column; ok && col; col = col->next) {
+    size_t nread;
+    if (!col->stream) continue;
+    ok = bcif_stream_read(col->stream, values, 1, &nread, err);
+    if (ok && nread > 0) {
+      ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
+                    "Column size mismatch %d != %d in category %s",
+                    n_rows + 1, n_rows, cat->name);
+      ok = false;
+    }
+  }
+  free(values);
+  return ok;
+}
+
 /* Check a read-in category, and send out the data via callbacks */
 static bool process_bcif_category(struct ihm_reader *reader,
                                   struct bcif_category *cat,
@@ -2988,76 +4499,210 @@ static bool process_bcif_category(struct ihm_reader *reader,
   size_t i, n_rows = 0;
   if (!ihm_cat) {
     if (reader->unknown_category_callback) {
+      double start = callback_start(reader);
       (*reader->unknown_category_callback)(
               reader, cat->name, 0, reader->unknown_category_data, err);
+      callback_end(reader, start, NULL);
       if (*err) return false;
     }
     return true;
   }
   if (!check_bcif_columns(reader, cat, ihm_cat, err)) return false;
-  for (col = cat->first_column; col; col = col->next) {
-    if (!col->keyword) continue;
-    if (!process_column_data(col, err)
-        || !process_column_mask(col, err)) return false;
-    /* Make buffer for value as a string; should be long enough to
-       store any int or double */
-    col->str = (char *)ihm_malloc(80);
-    if (n_rows == 0) {
-      n_rows = col->data.size;
-    } else if (col->data.size != n_rows) {
-      ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
-                    "Column size mismatch %d != %d in category %s",
-                    col->data.size, n_rows, cat->name);
-      return false;
+  /* Decode large categories a window at a time, if requested (this requires
+     that the number of rows is given in the file) */
+  if (reader->bcif_chunk_size > 0 && cat->row_count > 0
+      && (size_t)cat->row_count > reader->bcif_chunk_size) {
+    if (!process_bcif_category_windowed(reader, cat, ihm_cat,
+                                        err)) return false;
+  } else {
+    for (col = cat->first_column; col; col = col->next) {
+      if (!col->keyword) continue;
+      if (!process_column_data(reader, col, err)
+          || !process_column_mask(col, err)) return false;
+      /* Make buffer for value as a string; should be long enough to
+         store any int or double */
+      col->str = (char *)ihm_malloc(80);
+      if (n_rows == 0) {
+        n_rows = col->data.size;
+      } else if (col->data.size != n_rows) {
+        ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
+                      "Column size mismatch %d != %d in category %s",
+                      col->data.size, n_rows, cat->name);
+        return false;
+      }
+    }
+    for (i = 0; i < n_rows; ++i) {
+      if (!process_bcif_row(reader, cat, ihm_cat, i, err)) return false;
     }
-  }
-  for (i = 0; i < n_rows; ++i) {
-    if (!process_bcif_row(reader, cat, ihm_cat, i, err)) return false;
   }
   if (ihm_cat->finalize_callback) {
+    double start = callback_start(reader);
     (*ihm_cat->finalize_callback)(reader, reader->linenum, ihm_cat->data, err);
+    callback_end(reader, start, ihm_cat);
     if (*err) return false;
   }
   return true;
 }
 
-/* Read all categories from a BinaryCIF file */
+/* Read the start of the categories array of a BinaryCIF data block */
+static bool start_bcif_categories(struct ihm_reader *reader,
+                                  struct ihm_error **err)
+{
+  uint32_t ncat;
+  if (!read_bcif_array(reader, &ncat, err)) return false;
+  reader->categories_left = ncat;
+  return true;
+}
+
+/* Read the next category from a BinaryCIF data block, and send out its
+   data via callbacks. Nothing is sent unless the whole category can be
+   read. */
+static bool read_next_bcif_category(struct ihm_reader *reader,
+                                    struct ihm_error **err)
+{
+  struct bcif_category cat;
+  struct ihm_category *ihm_cat;
+  bool ok;
+  bcif_category_init(&cat);
+  ok = read_bcif_category(reader, &cat, &ihm_cat, err)
+       && process_bcif_category(reader, &cat, ihm_cat, err);
+  bcif_category_free(&cat);
+  if (ok) {
+    reader->categories_left--;
+  }
+  return ok;
+}
+
+/* Read all remaining categories in the categories array of a
+   BinaryCIF data block */
 static bool read_bcif_categories(struct ihm_reader *reader,
                                  struct ihm_error **err)
 {
-  uint32_t ncat, icat;
-  if (!read_bcif_array(reader, &ncat, err)) return false;
-  for (icat = 0; icat < ncat; ++icat) {
-    struct bcif_category cat;
-    struct ihm_category *ihm_cat;
-    bcif_category_init(&cat);
-    if (!read_bcif_category(reader, &cat, &ihm_cat, err)
-        || !process_bcif_category(reader, &cat, ihm_cat, err)) {
-      bcif_category_free(&cat);
-      return false;
-    } else {
-      bcif_category_free(&cat);
-    }
+  while (reader->categories_left > 0) {
+    if (!read_next_bcif_category(reader, err)) return false;
   }
   return true;
 }
 
-/* Read the next data block from a BinaryCIF file */
-static bool read_bcif_block(struct ihm_reader *reader, struct ihm_error **err)
+/* Start reading the next data block from a BinaryCIF file */
+static bool start_bcif_block(struct ihm_reader *reader, struct ihm_error **err)
 {
-  uint32_t map_size, i;
+  uint32_t map_size;
   if (!read_bcif_map(reader, &map_size, err)) return false;
-  for (i = 0; i < map_size; ++i) {
+  reader->block_keys_left = map_size;
+  reader->block_categories_pending = false;
+  reader->categories_left = 0;
+  free(reader->block_header);
+  reader->block_header = NULL;
+  return true;
+}
+
+/* Mark the current BinaryCIF data block as completely read */
+static void end_bcif_block(struct ihm_reader *reader)
+{
+  reader->block_keys_left = -1;
+  reader->block_categories_pending = false;
+  reader->categories_left = 0;
+  reader->num_blocks_left--;
+}
+
+/* Read the next data block from a BinaryCIF file (or the rest of the
+   current block, if we are part way through it) */
+static bool read_bcif_block(struct ihm_reader *reader, struct ihm_error **err)
+{
+  if (reader->block_keys_left < 0
+      && !start_bcif_block(reader, err)) return false;
+  /* Finish any categories that ihm_reader_feed started on */
+  if (!read_bcif_categories(reader, err)) return false;
+  if (reader->block_categories_pending) {
+    reader->block_categories_pending = false;
+    if (!start_bcif_categories(reader, err)
+        || !read_bcif_categories(reader, err)) return false;
+  }
+  while (reader->block_keys_left > 0) {
     bool match;
+    reader->block_keys_left--;
     if (!read_bcif_exact_string(reader, "categories", &match,
                                 err)) return false;
     if (match) {
-      if (!read_bcif_categories(reader, err)) return false;
+      if (!start_bcif_categories(reader, err)
+          || !read_bcif_categories(reader, err)) return false;
     } else {
       if (!skip_bcif_object(reader, err)) return false;
     }
   }
-  reader->num_blocks_left--;
+  end_bcif_block(reader);
+  return true;
+}
+
+/* Read the start of the next BinaryCIF data block, up to and including
+   its header (name), and store the name in reader->block_header.
+   If the categories come before the header in the file, stop at the
+   categories; the name will not be known in this case. */
+static bool read_bcif_block_header(struct ihm_reader *reader,
+                                   struct ihm_error **err)
+{
+  if (!start_bcif_block(reader, err)) return false;
+  while (reader->block_keys_left > 0) {
+    char *str;
+    reader->block_keys_left--;
+    if (!read_bcif_string(reader, &str, err)) return false;
+    if (strcmp(str, "header") == 0) {
+      return read_bcif_string_dup(reader, &reader->block_header, err);
+    } else if (strcmp(str, "categories") == 0) {
+      reader->block_categories_pending = true;
+      return true;
+    } else {
+      if (!skip_bcif_object_no_limit(reader, err)) return false;
+    }
+  }
+  return true;
+}
+
+/* Skip the next BinaryCIF data block (or the rest of the current block,
+   if we are part way through it) without decoding anything */
+static bool skip_bcif_block(struct ihm_reader *reader, struct ihm_error **err)
+{
+  if (reader->block_keys_left < 0) {
+    if (!skip_bcif_object_no_limit(reader, err)) return false;
+  } else {
+    while (reader->categories_left > 0) {
+      if (!skip_bcif_object_no_limit(reader, err)) return false;
+      reader->categories_left--;
+    }
+    if (reader->block_categories_pending) {
+      reader->block_categories_pending = false;
+      if (!skip_bcif_object_no_limit(reader, err)) return false;
+    }
+    while (reader->block_keys_left > 0) {
+      char *str;
+      reader->block_keys_left--;
+      if (!read_bcif_string(reader, &str, err)) return false;
+      /* Record the block name, in case it comes after the categories */
+      if (strcmp(str, "header") == 0) {
+        if (!read_bcif_string_dup(reader, &reader->block_header,
+                                  err)) return false;
+      } else {
+        if (!skip_bcif_object_no_limit(reader, err)) return false;
+      }
+    }
+  }
+  end_bcif_block(reader);
+  return true;
+}
+
+/* Prepare to read a BinaryCIF file, if we haven't already */
+static bool start_bcif_file(struct ihm_reader *reader, struct ihm_error **err)
+{
+  if (!reader->binary) {
+    ihm_error_set(err, IHM_ERROR_VALUE,
+                  "Data blocks can only be skipped in BinaryCIF files");
+    return false;
+  }
+  if (reader->num_blocks_left == -1) {
+    cmp_init(&reader->cmp, reader, bcif_cmp_read, bcif_cmp_skip, NULL);
+    if (!read_bcif_header(reader, err)) return false;
+  }
   return true;
 }
 
@@ -3067,10 +4712,7 @@ static bool read_bcif_file(struct ihm_reader *reader, bool *more_data,
 {
   *more_data = false;
   sort_mappings(reader);
-  if (reader->num_blocks_left == -1) {
-    cmp_init(&reader->cmp, reader, bcif_cmp_read, bcif_cmp_skip, NULL);
-    if (!read_bcif_header(reader, err)) return false;
-  }
+  if (!start_bcif_file(reader, err)) return false;
 
   if (reader->num_blocks_left > 0) {
     if (!read_bcif_block(reader, err)) return false;
@@ -3079,13 +4721,314 @@ static bool read_bcif_file(struct ihm_reader *reader, bool *more_data,
   return true;
 }
 
+/* Skip BinaryCIF data blocks so that the next read is of the given block */
+bool ihm_reader_bcif_skip_to_block(struct ihm_reader *reader, int index,
+                                   bool *found, struct ihm_error **err)
+{
+  *found = false;
+  if (!start_bcif_file(reader, err)) return false;
+  if (index < reader->num_blocks - reader->num_blocks_left) {
+    ihm_error_set(err, IHM_ERROR_VALUE,
+                  "Cannot skip back to data block %d; the next block is %d",
+                  index, reader->num_blocks - reader->num_blocks_left);
+    return false;
+  }
+  while (reader->num_blocks_left > 0
+         && index > reader->num_blocks - reader->num_blocks_left) {
+    if (!skip_bcif_block(reader, err)) return false;
+  }
+  *found = (reader->num_blocks_left > 0);
+  return true;
+}
+
+/* Skip BinaryCIF data blocks so that the next read is of the named block */
+bool ihm_reader_bcif_skip_to_named_block(struct ihm_reader *reader,
+                                         const char *name, bool *found,
+                                         struct ihm_error **err)
+{
+  *found = false;
+  if (!start_bcif_file(reader, err)) return false;
+  while (reader->num_blocks_left > 0) {
+    if (reader->block_keys_left < 0
+        && !read_bcif_block_header(reader, err)) return false;
+    if (reader->block_header && strcmp(reader->block_header, name) == 0) {
+      *found = true;
+      return true;
+    }
+    if (!skip_bcif_block(reader, err)) return false;
+    /* We cannot go back to the start of the block if it turns out to be
+       the one we want, so complain */
+    if (reader->block_header && strcmp(reader->block_header, name) == 0) {
+      ihm_error_set(err, IHM_ERROR_FILE_FORMAT,
+                    "Cannot skip to data block %s, as its header follows "
+                    "its categories in the file", name);
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Read the names of all categories in a BinaryCIF data block */
+static bool read_bcif_category_names(struct ihm_reader *reader,
+                                     struct ihm_array *names,
+                                     struct ihm_error **err)
+{
+  uint32_t ncat, icat;
+  if (!read_bcif_array(reader, &ncat, err)) return false;
+  for (icat = 0; icat < ncat; ++icat) {
+    uint32_t map_size, i;
+    if (!read_bcif_map(reader, &map_size, err)) return false;
+    for (i = 0; i < map_size; ++i) {
+      char *str;
+      if (!read_bcif_string(reader, &str, err)) return false;
+      if (strcmp(str, "name") == 0) {
+        char *name = NULL;
+        if (!read_bcif_string_dup(reader, &name, err)) return false;
+        ihm_array_append(names, &name);
+      } else {
+        if (!skip_bcif_object_no_limit(reader, err)) return false;
+      }
+    }
+  }
+  return true;
+}
+
+/* Free all category names in the given array */
+static void clear_category_names(struct ihm_array *names)
+{
+  size_t i;
+  for (i = 0; i < names->len; ++i) {
+    free(ihm_array_index(names, char *, i));
+  }
+  ihm_array_clear(names);
+}
+
+/* Get the names of all remaining BinaryCIF data blocks and categories */
+static bool read_bcif_contents(struct ihm_reader *reader,
+                               ihm_bcif_contents_callback callback,
+                               void *data, struct ihm_array *names,
+                               struct ihm_error **err)
+{
+  while (reader->num_blocks_left > 0) {
+    int index = reader->num_blocks - reader->num_blocks_left;
+    if (reader->block_keys_left < 0
+        && !start_bcif_block(reader, err)) return false;
+    if (reader->block_categories_pending) {
+      reader->block_categories_pending = false;
+      if (!read_bcif_category_names(reader, names, err)) return false;
+    }
+    while (reader->block_keys_left > 0) {
+      char *str;
+      reader->block_keys_left--;
+      if (!read_bcif_string(reader, &str, err)) return false;
+      if (strcmp(str, "header") == 0) {
+        if (!read_bcif_string_dup(reader, &reader->block_header,
+                                  err)) return false;
+      } else if (strcmp(str, "categories") == 0) {
+        if (!read_bcif_category_names(reader, names, err)) return false;
+      } else {
+        if (!skip_bcif_object_no_limit(reader, err)) return false;
+      }
+    }
+    end_bcif_block(reader);
+    (*callback)(index, reader->block_header, names->len,
+                (char **)names->data, data, err);
+    if (*err) return false;
+    clear_category_names(names);
+  }
+  return true;
+}
+
+/* Get the names of all remaining BinaryCIF data blocks and categories */
+bool ihm_reader_bcif_contents(struct ihm_reader *reader,
+                              ihm_bcif_contents_callback callback,
+                              void *data, struct ihm_error **err)
+{
+  bool ret;
+  struct ihm_array *names;
+  if (!start_bcif_file(reader, err)) return false;
+  names = ihm_array_new(sizeof(char *));
+  ret = read_bcif_contents(reader, callback, data, names, err);
+  clear_category_names(names);
+  ihm_array_free(names);
+  return ret;
+}
+
 /* Read an entire mmCIF or BinaryCIF file. */
 bool ihm_read_file(struct ihm_reader *reader, bool *more_data,
                    struct ihm_error **err)
 {
+  bool ret;
+  double start = reader->timing ? ihm_time() : 0.;
+  if (reader->binary) {
+    ret = read_bcif_file(reader, more_data, err);
+  } else {
+    ret = read_mmcif_file(reader, more_data, err);
+  }
+  if (reader->timing) {
+    reader->total_time += ihm_time() - start;
+  }
+  return ret;
+}
+
+/* Parse as much as possible of the mmCIF data fed to a push file */
+static bool parse_fed_mmcif(struct ihm_reader *reader, bool *block_done,
+                            struct ihm_error **err)
+{
+  struct push_file_data *pd = (struct push_file_data *)reader->fh->data;
+  bool more_data;
+  if (read_mmcif_block(reader, err)) {
+    /* With no end of file, a block can only be ended by another block */
+    *block_done = true;
+    return end_mmcif_block(reader, &more_data, err);
+  } else if (pd->need_data) {
+    /* Not an error; we'll continue when more data is added */
+    pd->need_data = false;
+    ihm_error_free(*err);
+    *err = NULL;
+    return true;
+  } else {
+    reset_mmcif_state(reader);
+    return false;
+  }
+}
+
+/* Decode the next piece of a BinaryCIF file: the file header, the start
+   of a data block, a single category, or some other key in a data block.
+   A piece is only consumed if it is decoded successfully, so that a push
+   file that runs out of data part way through can go back and try
+   again later. */
+static bool read_bcif_piece(struct ihm_reader *reader, struct ihm_error **err)
+{
+  if (reader->num_blocks_left == -1) {
+    return start_bcif_file(reader, err);
+  } else if (reader->block_keys_left < 0) {
+    return start_bcif_block(reader, err);
+  } else if (reader->categories_left > 0) {
+    /* Make sure all of the category's data are available before decoding
+       it. Skipping the category only reads the msgpack headers, so is
+       cheap to repeat each time more data is fed, whereas decoding it
+       again would copy all of its column data read so far. */
+    size_t start = reader->fh->line_start;
+    if (!skip_bcif_object_no_limit(reader, err)) return false;
+    reader->fh->line_start = start;
+    return read_next_bcif_category(reader, err);
+  } else if (reader->block_categories_pending) {
+    if (!start_bcif_categories(reader, err)) return false;
+    reader->block_categories_pending = false;
+    return true;
+  } else {
+    bool match;
+    if (!read_bcif_exact_string(reader, "categories", &match,
+                                err)) return false;
+    if (match) {
+      if (!start_bcif_categories(reader, err)) return false;
+    } else {
+      if (!skip_bcif_object(reader, err)) return false;
+    }
+    reader->block_keys_left--;
+    return true;
+  }
+}
+
+/* Decode as much as possible of the BinaryCIF data fed to a push file,
+   one category at a time */
+static bool parse_fed_bcif(struct ihm_reader *reader, bool *block_done,
+                           struct ihm_error **err)
+{
+  struct ihm_file *fh = reader->fh;
+  struct push_file_data *pd = (struct push_file_data *)fh->data;
+  sort_mappings(reader);
+  while (reader->num_blocks_left != 0) {
+    size_t piece_start = fh->line_start;
+    if (reader->block_keys_left == 0 && reader->categories_left == 0) {
+      /* As for mmCIF, the end of the last block is only handled by
+         ihm_reader_finish */
+      if (reader->num_blocks_left > 1) {
+        end_bcif_block(reader);
+        *block_done = true;
+      }
+      return true;
+    }
+    if (!read_bcif_piece(reader, err)) {
+      if (pd->need_data) {
+        /* Not an error; go back to the start of this piece, and try
+           again when more data is added */
+        pd->need_data = false;
+        ihm_error_free(*err);
+        *err = NULL;
+        if (reader->cmp_read_err) {
+          ihm_error_free(reader->cmp_read_err);
+          reader->cmp_read_err = NULL;
+        }
+        fh->line_start = piece_start;
+        return true;
+      }
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Add data to a push file and parse as much of it as possible */
+bool ihm_reader_feed(struct ihm_reader *reader, const char *buf, size_t len,
+                     bool *block_done, struct ihm_error **err)
+{
+  struct ihm_file *fh = reader->fh;
+  struct push_file_data *pd = (struct push_file_data *)fh->data;
+  size_t oldlen = fh->buffer->len;
+  bool ret;
+  double start;
+
+  *block_done = false;
+  if (fh->read_callback != push_read_callback) {
+    ihm_error_set(err, IHM_ERROR_VALUE,
+                  "Data can only be fed to a reader made with "
+                  "ihm_file_new_push");
+    return false;
+  } else if (pd->eof) {
+    ihm_error_set(err, IHM_ERROR_VALUE,
+                  "Cannot feed more data after ihm_reader_finish");
+    return false;
+  }
+  /* Discard BinaryCIF data that has already been decoded */
+  if (reader->binary && fh->line_start) {
+    ihm_string_erase(fh->buffer, 0, fh->line_start);
+    fh->line_start = 0;
+    oldlen = fh->buffer->len;
+  }
+  ihm_string_set_size(fh->buffer, oldlen + len);
+  memcpy(fh->buffer->str + oldlen, buf, len);
+  fh->bytes_read += len;
+  update_buffer_stats(fh);
+  report_progress(fh, err);
+  if (*err) {
+    return false;
+  }
+
+  start = reader->timing ? ihm_time() : 0.;
   if (reader->binary) {
-    return read_bcif_file(reader, more_data, err);
+    ret = parse_fed_bcif(reader, block_done, err);
   } else {
-    return read_mmcif_file(reader, more_data, err);
+    ret = parse_fed_mmcif(reader, block_done, err);
+  }
+  if (reader->timing) {
+    reader->total_time += ihm_time() - start;
+  }
+  return ret;
+}
+
+/* Read the rest of the current data block from a push file */
+bool ihm_reader_finish(struct ihm_reader *reader, bool *more_data,
+                       struct ihm_error **err)
+{
+  struct ihm_file *fh = reader->fh;
+  if (fh->read_callback != push_read_callback) {
+    ihm_error_set(err, IHM_ERROR_VALUE,
+                  "Only a reader made with ihm_file_new_push can be finished");
+    *more_data = false;
+    return false;
   }
+  ((struct push_file_data *)fh->data)->eof = true;
+  return ihm_read_file(reader, more_data, err);
 }
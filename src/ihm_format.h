@@ -16,6 +16,7 @@
 #define IHM_FORMAT_H
 
 #include <stdlib.h> /* For size_t */
+#include <stdint.h> /* For int64_t */
 #if defined(_MSC_VER)
 #include <BaseTsd.h>
 typedef SSIZE_T ssize_t;
@@ -66,6 +67,20 @@ typedef enum {
   IHM_BOOL
 } ihm_keyword_type;
 
+/* A dictionary of all distinct strings in a BinaryCIF StringArray-encoded
+   column. Each dictionary read from the file is given a new serial number,
+   so that consumers can cache per-string data (e.g. converted values)
+   and can tell when the dictionary has changed. The dictionary is only
+   valid while the category that contains it is being processed. */
+struct ihm_string_dict {
+  /* Serial number, unique within a given ihm_reader */
+  unsigned long serial;
+  /* Number of strings */
+  size_t size;
+  /* Array of null-terminated strings */
+  char **strings;
+};
+
 /* A keyword in an mmCIF or BinaryCIF file. Holds a description of its
    format and any value read from the file. */
 struct ihm_keyword {
@@ -87,6 +102,11 @@ struct ihm_keyword {
   bool omitted;
   /* true iff the keyword is in the file but the value is unknown ('?') */
   bool unknown;
+  /* If the string value was read from a BinaryCIF StringArray-encoded
+     column, the column's dictionary and the index of the value in it;
+     otherwise, NULL and -1. data.str is set in either case. */
+  struct ihm_string_dict *dict;
+  int dict_index;
 };
 #endif
 
@@ -111,6 +131,15 @@ typedef void (*ihm_unknown_keyword_callback)(struct ihm_reader *reader,
                                              void *data,
                                              struct ihm_error **err);
 
+/* Callback to report progress while reading a file, given the number of
+   bytes read so far, the number of rows passed to category callbacks so
+   far, and the name of the category most recently read (or NULL).
+   Should set err on failure (which will abort the read) */
+typedef void (*ihm_progress_callback)(struct ihm_reader *reader,
+                                      size_t bytes_read, size_t num_rows,
+                                      const char *category, void *data,
+                                      struct ihm_error **err);
+
 /* Callback to free arbitrary data */
 typedef void (*ihm_free_callback)(void *data);
 
@@ -139,6 +168,27 @@ void ihm_reader_unknown_keyword_callback_set(struct ihm_reader *reader,
                                      ihm_unknown_keyword_callback callback,
                                      void *data, ihm_free_callback free_func);
 
+/* Set a callback to report progress while reading.
+   The callback is called whenever data is read from the file (or fed to
+   the reader) and at least `interval` bytes have been read since it was
+   last called. Note that data are read from the file in 4MiB chunks.
+   Unlike the unknown category and keyword callbacks, this is not removed
+   by ihm_reader_remove_all_categories.
+ */
+void ihm_reader_progress_callback_set(struct ihm_reader *reader,
+                                      ihm_progress_callback callback,
+                                      void *data, ihm_free_callback free_func,
+                                      size_t interval);
+
+/* Set the chunk size (number of rows) for decoding BinaryCIF data.
+   Normally each category is decoded in full before any rows are passed
+   to callbacks. If chunk_size is nonzero, categories with more rows than
+   this are instead decoded chunk_size rows at a time, which reduces peak
+   memory usage for very large categories. This has no effect on mmCIF.
+ */
+void ihm_reader_bcif_chunk_size_set(struct ihm_reader *reader,
+                                    size_t chunk_size);
+
 /* Remove all categories from the reader.
    This also removes any unknown category or keyword callbacks.
  */
@@ -184,6 +234,16 @@ struct ihm_file {
   void *data;
   /* Function to free callback_data (or NULL) */
   ihm_free_callback free_func;
+  /* Total number of bytes read from the file */
+  size_t bytes_read;
+  /* Largest size the buffer has reached, and the number of times it
+     has been enlarged */
+  size_t buffer_max, buffer_grows;
+  /* If true, measure the time spent in read_callback, in read_time */
+  bool timing;
+  double read_time;
+  /* The reader using this file, if any, to report progress to */
+  struct ihm_reader *reader;
 };
 
 /* Make a new ihm_file, used to handle reading data from a file.
@@ -197,6 +257,11 @@ struct ihm_file *ihm_file_new(ihm_file_read_callback read_callback,
 /* Make a new ihm_file that will read data from the given file descriptor */
 struct ihm_file *ihm_file_new_from_fd(int fd);
 
+/* Make a new ihm_file that does not read data itself; instead, the caller
+   supplies the data piece by piece with ihm_reader_feed, and signals the
+   end of the data with ihm_reader_finish. */
+struct ihm_file *ihm_file_new_push(void);
+
 /* Make a new struct ihm_reader.
    To read an mmCIF file, set binary=false; to read BinaryCIF, set binary=true.
  */
@@ -207,12 +272,117 @@ struct ihm_reader *ihm_reader_new(struct ihm_file *fh, bool binary);
    underlying file descriptor or object that is wrapped by ihm_file. */
 void ihm_reader_free(struct ihm_reader *reader);
 
+/* Callback for ihm_reader_bcif_contents; called once for each BinaryCIF
+   data block with the block's index, its header (name, or NULL if not
+   given), and the names of all of its categories. */
+typedef void (*ihm_bcif_contents_callback)(int index, const char *header,
+                                           size_t num_categories,
+                                           char **categories, void *data,
+                                           struct ihm_error **err);
+
+/* Skip BinaryCIF data blocks, without decoding them, so that the next
+   call to ihm_read_file reads the block with the given (zero-based) index.
+   Blocks can only be skipped forwards, not backwards.
+   *found is set true iff the block exists in the file.
+   Return false and set err on error. */
+bool ihm_reader_bcif_skip_to_block(struct ihm_reader *reader, int index,
+                                   bool *found, struct ihm_error **err);
+
+/* Skip BinaryCIF data blocks, without decoding them, so that the next
+   call to ihm_read_file reads the next block with the given header (name).
+   *found is set true iff such a block exists in the file.
+   Return false and set err on error. */
+bool ihm_reader_bcif_skip_to_named_block(struct ihm_reader *reader,
+                                         const char *name, bool *found,
+                                         struct ihm_error **err);
+
+/* Get the header (name) and category names of each remaining BinaryCIF
+   data block, without decoding any data. The given callback is called for
+   each block. This reads to the end of the file, so no further data can
+   be read with ihm_read_file afterwards.
+   Return false and set err on error. */
+bool ihm_reader_bcif_contents(struct ihm_reader *reader,
+                              ihm_bcif_contents_callback callback,
+                              void *data, struct ihm_error **err);
+
 /* Read a data block from an mmCIF or BinaryCIF file.
    *more_data is set true iff more data blocks are available after this one.
    Return false and set err on error. */
 bool ihm_read_file(struct ihm_reader *reader, bool *more_data,
                    struct ihm_error **err);
 
+/* Add data to a reader created with ihm_file_new_push and parse as much of
+   it as possible, calling category callbacks as rows are completed. Any
+   incomplete line is kept until more data is added. *block_done is set true
+   iff the end of a data block was reached (i.e. the start of the next block
+   was seen); the rest of the data is kept, and is parsed by the next call
+   (which may add no new data, len=0) after any handlers are changed.
+   BinaryCIF data are decoded a category at a time, as soon as all of the
+   data for each category has been added.
+   Return false and set err on error. */
+bool ihm_reader_feed(struct ihm_reader *reader, const char *buf, size_t len,
+                     bool *block_done, struct ihm_error **err);
+
+/* Signal that all data has been given to a reader created with
+   ihm_file_new_push, and read the rest of the current data block. This
+   otherwise behaves identically to ihm_read_file, and can be called
+   repeatedly while *more_data is true to read subsequent blocks.
+   Return false and set err on error. */
+bool ihm_reader_finish(struct ihm_reader *reader, bool *more_data,
+                       struct ihm_error **err);
+
+/* Statistics about the data read so far by a reader; see
+   ihm_reader_get_stats. Times are in seconds, and are zero unless
+   timing was turned on with ihm_reader_timing_set. */
+struct ihm_reader_stats {
+  /* Number of bytes read from the file (or fed to the reader) */
+  size_t bytes_read;
+  /* Number of mmCIF lines and tokens read (zero for BinaryCIF) */
+  size_t lines, tokens;
+  /* Largest size of the file buffer, in bytes */
+  size_t buffer_max;
+  /* Number of times the file buffer had to be reallocated to grow */
+  size_t buffer_grows;
+  /* Total time spent reading */
+  double total_time;
+  /* Time spent reading data from the underlying file */
+  double io_time;
+  /* Time spent in category and unknown category/keyword callbacks */
+  double callback_time;
+  /* Time spent tokenizing mmCIF or decoding BinaryCIF; this is
+     total_time minus io_time and callback_time */
+  double parse_time;
+};
+
+/* Callback for ihm_reader_category_stats_foreach, given the name of a
+   category, the number of rows passed to its data callback, and the time
+   spent in all of its callbacks */
+typedef void (*ihm_category_stats_callback)(const char *name,
+                                            size_t num_rows,
+                                            double callback_time, void *data);
+
+/* Turn on or off measuring of the time spent in each part of reading.
+   This adds a small overhead to each row read, so is off by default.
+   Counts (of bytes, lines, rows etc.) are always kept. */
+void ihm_reader_timing_set(struct ihm_reader *reader, bool timing);
+
+/* Get statistics for everything read by this reader so far */
+void ihm_reader_get_stats(struct ihm_reader *reader,
+                          struct ihm_reader_stats *stats);
+
+/* Call the given function once for each category that has been handled
+   by this reader, with statistics for that category. Statistics are kept
+   even if the category is later removed, and are combined for categories
+   that are handled more than once (e.g. for multiple data blocks). */
+void ihm_reader_category_stats_foreach(struct ihm_reader *reader,
+                                       ihm_category_stats_callback callback,
+                                       void *data);
+
+/* Write the decimal representation of an integer (as printf's "%lld") into
+   buffer, which must be at least 21 bytes long. Return the length of
+   the resulting null-terminated string. */
+size_t ihm_itoa(char *buffer, long long value);
+
 #ifdef  __cplusplus
 }
 #endif
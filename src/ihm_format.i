@@ -2,6 +2,9 @@
 
 %{
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
 #include "ihm_format.h"
 %}
 
@@ -10,6 +13,28 @@
 
 %ignore ihm_keyword;
 %ignore ihm_error_set;
+%ignore ihm_itoa;
+
+/* Use our own versions of the functions that read the file, which release
+   the GIL */
+%ignore ihm_read_file;
+%rename(ihm_read_file) read_file_release_gil;
+%ignore ihm_reader_finish;
+%rename(ihm_reader_finish) reader_finish_release_gil;
+%ignore ihm_reader_bcif_skip_to_block;
+%rename(ihm_reader_bcif_skip_to_block) bcif_skip_to_block_release_gil;
+%ignore ihm_reader_bcif_skip_to_named_block;
+%rename(ihm_reader_bcif_skip_to_named_block) bcif_skip_to_named_block_release_gil;
+
+/* Use our own version of ihm_reader_feed, which takes a Python object */
+%ignore ihm_reader_feed;
+%rename(ihm_reader_feed) reader_feed_python;
+
+/* Return reader statistics as a Python dict */
+%ignore ihm_reader_stats;
+%ignore ihm_reader_get_stats;
+%ignore ihm_reader_category_stats_foreach;
+%rename(ihm_reader_get_stats) reader_get_stats_python;
 
 /* Convert ihm_error to a Python exception */
 
@@ -42,6 +67,53 @@ static void handle_error(struct ihm_error *err)
   }
   ihm_error_free(err);
 }
+
+/* While reading a file, the GIL is released, and is only reacquired when
+   we need to call back into Python. To avoid the cost of switching for
+   every row in tables handled in Python, once reacquired the GIL is held
+   until GIL_RELEASE_INTERVAL more callbacks have been made, or until we
+   go back to pure C work (e.g. after reading a chunk of the file). */
+#define GIL_RELEASE_INTERVAL 1000
+
+struct gil_state {
+  /* Saved thread state if the GIL is currently released, or NULL */
+  PyThreadState *saved;
+  /* Number of callbacks since the GIL was reacquired */
+  unsigned ncallbacks;
+};
+
+/* The gil_state of the read in progress in this thread, if any */
+static Py_tss_t gil_state_key = Py_tss_NEEDS_INIT;
+
+/* Make sure we hold the GIL before calling into Python */
+static void python_enter(void)
+{
+  struct gil_state *st = PyThread_tss_get(&gil_state_key);
+  if (st && st->saved) {
+    PyEval_RestoreThread(st->saved);
+    st->saved = NULL;
+    st->ncallbacks = 0;
+  }
+}
+
+/* Release the GIL (if we are inside a read that allows it) */
+static void python_release(void)
+{
+  struct gil_state *st = PyThread_tss_get(&gil_state_key);
+  if (st && !st->saved) {
+    st->saved = PyEval_SaveThread();
+  }
+}
+
+/* Note that a callback has finished; release the GIL if we have held it
+   for a while */
+static void python_leave(void)
+{
+  struct gil_state *st = PyThread_tss_get(&gil_state_key);
+  if (st && !st->saved && ++st->ncallbacks >= GIL_RELEASE_INTERVAL) {
+    st->saved = PyEval_SaveThread();
+  }
+}
 %}
 
 %typemap(in, numinputs=0) struct ihm_error **err (struct ihm_error *temp) {
@@ -59,8 +131,8 @@ static void handle_error(struct ihm_error *err)
 %{
 
 /* Read data from a Python filelike object, in text mode */
-static ssize_t pyfile_text_read_callback(char *buffer, size_t buffer_len,
-                                         void *data, struct ihm_error **err)
+static ssize_t pyfile_text_read(char *buffer, size_t buffer_len,
+                                void *data, struct ihm_error **err)
 {
   Py_ssize_t read_len;
   char *read_str;
@@ -127,8 +199,8 @@ static ssize_t pyfile_text_read_callback(char *buffer, size_t buffer_len,
 }
 
 /* Read data from a Python filelike object, in binary mode */
-static ssize_t pyfile_binary_read_callback(char *buffer, size_t buffer_len,
-                                           void *data, struct ihm_error **err)
+static ssize_t pyfile_binary_read(char *buffer, size_t buffer_len,
+                                  void *data, struct ihm_error **err)
 {
   Py_ssize_t read_len;
   char *read_str;
@@ -164,9 +236,8 @@ static ssize_t pyfile_binary_read_callback(char *buffer, size_t buffer_len,
 }
 
 /* Read data from a Python filelike object directly into the buffer */
-static ssize_t pyfile_binary_readinto_callback(
-                    char *buffer, size_t buffer_len,
-                    void *data, struct ihm_error **err)
+static ssize_t pyfile_binary_readinto(char *buffer, size_t buffer_len,
+                                      void *data, struct ihm_error **err)
 {
   PyObject *readinto_method = data;
   PyObject *memview, *result;
@@ -202,6 +273,23 @@ static ssize_t pyfile_binary_readinto_callback(
   }
 }
 
+/* Wrap a Python read function so that it holds the GIL; the GIL is
+   released again afterwards, as the data will be parsed in C */
+#define PYFILE_READ_CALLBACK(name) \
+static ssize_t name##_callback(char *buffer, size_t buffer_len,              \
+                               void *data, struct ihm_error **err)           \
+{                                                                            \
+  ssize_t ret;                                                               \
+  python_enter();                                                            \
+  ret = name(buffer, buffer_len, data, err);                                 \
+  python_release();                                                          \
+  return ret;                                                                \
+}
+
+PYFILE_READ_CALLBACK(pyfile_text_read)
+PYFILE_READ_CALLBACK(pyfile_binary_read)
+PYFILE_READ_CALLBACK(pyfile_binary_readinto)
+
 static void pyfile_free(void *data)
 {
   PyObject *read_method = data;
@@ -246,9 +334,211 @@ struct ihm_file *ihm_file_new_from_python(PyObject *pyfile, bool binary,
 %}
 
 %{
+/* Python strings made from the entries in a BinaryCIF string dictionary,
+   so that each distinct value in a column is converted only once */
+struct dict_string_cache {
+  /* Serial number of the dictionary that the strings were made from */
+  unsigned long serial;
+  /* Number of entries in the dictionary */
+  size_t size;
+  /* Python string for each entry, or NULL if not made yet */
+  PyObject **strings;
+};
+
+static void dict_string_cache_clear(struct dict_string_cache *c)
+{
+  size_t i;
+  for (i = 0; i < c->size; ++i) {
+    Py_XDECREF(c->strings[i]);
+  }
+  free(c->strings);
+  c->strings = NULL;
+  c->size = 0;
+  c->serial = 0;
+}
+
+/* Get a Python string for the given keyword's value, which must be
+   from a string dictionary. Returns a new reference, or NULL on error. */
+static PyObject *dict_string_cache_get(struct dict_string_cache *c,
+                                       struct ihm_keyword *key)
+{
+  PyObject *val;
+  if (c->serial != key->dict->serial || !c->strings) {
+    dict_string_cache_clear(c);
+    c->serial = key->dict->serial;
+    c->size = key->dict->size;
+    c->strings = calloc(c->size, sizeof(PyObject *));
+    if (!c->strings) {
+      c->size = 0;
+      return NULL;
+    }
+  }
+  val = c->strings[key->dict_index];
+  if (!val) {
+    val = PyUnicode_FromString(key->data.str);
+    if (!val) {
+      return NULL;
+    }
+    c->strings[key->dict_index] = val;
+  }
+  Py_INCREF(val);
+  return val;
+}
+
+/* A set of distinct strings, each with an index, plus the Python object
+   for each (made on demand) */
+struct string_table {
+  char **strings;
+  PyObject **objs;
+  size_t num_strings, alloc_strings;
+  /* Open-addressing hash table of string index + 1 (0 for empty slots) */
+  size_t *hash;
+  size_t hash_size;
+};
+
+static void string_table_clear(struct string_table *t)
+{
+  size_t i;
+  for (i = 0; i < t->num_strings; ++i) {
+    free(t->strings[i]);
+    Py_XDECREF(t->objs[i]);
+  }
+  free(t->strings);
+  free(t->objs);
+  free(t->hash);
+  memset(t, 0, sizeof(struct string_table));
+}
+
+static size_t string_table_hash(const char *str)
+{
+  /* FNV-1a */
+  size_t h = 2166136261u;
+  for (; *str; ++str) {
+    h = (h ^ (unsigned char)*str) * 16777619u;
+  }
+  return h;
+}
+
+/* Rebuild the hash table with twice as many slots */
+static bool string_table_rehash(struct string_table *t)
+{
+  size_t i, hash_size = t->hash_size ? t->hash_size * 2 : 64;
+  size_t *hash = calloc(hash_size, sizeof(size_t));
+  if (!hash) {
+    return false;
+  }
+  for (i = 0; i < t->num_strings; ++i) {
+    size_t slot = string_table_hash(t->strings[i]) & (hash_size - 1);
+    while (hash[slot]) {
+      slot = (slot + 1) & (hash_size - 1);
+    }
+    hash[slot] = i + 1;
+  }
+  free(t->hash);
+  t->hash = hash;
+  t->hash_size = hash_size;
+  return true;
+}
+
+/* Look up the given string. Return true and set index if it is in the
+   table; otherwise, return false and set slot to the place in the hash
+   table where it should go. */
+static bool string_table_find(struct string_table *t, const char *str,
+                              size_t *index, size_t *slot)
+{
+  size_t s = string_table_hash(str) & (t->hash_size - 1);
+  while (t->hash[s]) {
+    size_t i = t->hash[s] - 1;
+    if (strcmp(t->strings[i], str) == 0) {
+      *index = i;
+      return true;
+    }
+    s = (s + 1) & (t->hash_size - 1);
+  }
+  *slot = s;
+  return false;
+}
+
+/* Get the index of the given string in the table, adding it if necessary.
+   Return false on failure. */
+static bool string_table_index(struct string_table *t, const char *str,
+                               size_t *index)
+{
+  size_t slot;
+  if (t->num_strings * 2 >= t->hash_size && !string_table_rehash(t)) {
+    return false;
+  }
+  if (string_table_find(t, str, index, &slot)) {
+    return true;
+  }
+  if (t->num_strings == t->alloc_strings) {
+    size_t alloc = t->alloc_strings ? t->alloc_strings * 2 : 16;
+    char **strings = realloc(t->strings, alloc * sizeof(char *));
+    PyObject **objs;
+    if (!strings) {
+      return false;
+    }
+    t->strings = strings;
+    objs = realloc(t->objs, alloc * sizeof(PyObject *));
+    if (!objs) {
+      return false;
+    }
+    t->objs = objs;
+    t->alloc_strings = alloc;
+  }
+  if (!(t->strings[t->num_strings] = strdup(str))) {
+    return false;
+  }
+  t->objs[t->num_strings] = NULL;
+  t->hash[slot] = t->num_strings + 1;
+  *index = t->num_strings++;
+  return true;
+}
+
+/* Get a new reference to the Python string for the given entry in the
+   table, or NULL on error */
+static PyObject *string_table_object(struct string_table *t, size_t index)
+{
+  PyObject *val = t->objs[index];
+  if (!val) {
+    val = t->objs[index] = PyUnicode_FromString(t->strings[index]);
+  }
+  Py_XINCREF(val);
+  return val;
+}
+
+/* Maximum number of distinct values cached for each keyword by
+   string_cache_get; keywords with more values than this are usually
+   unique per row (e.g. IDs or descriptions) and not worth caching */
+#define STRING_CACHE_MAX 256
+
+/* Maximum length of each cached value */
+#define STRING_CACHE_MAX_LEN 32
+
+/* Get a Python string for the given value. Short values that repeat
+   (such as atom or residue names, or chain IDs) share the same object.
+   Returns a new reference, or NULL on error. */
+static PyObject *string_cache_get(struct string_table *t, const char *str)
+{
+  size_t index, slot;
+  if (t->hash_size > 0 && string_table_find(t, str, &index, &slot)) {
+    return string_table_object(t, index);
+  } else if (t->num_strings < STRING_CACHE_MAX
+             && strlen(str) <= STRING_CACHE_MAX_LEN
+             && string_table_index(t, str, &index)) {
+    return string_table_object(t, index);
+  } else {
+    return PyUnicode_FromString(str);
+  }
+}
+
 struct category_handler_data {
   /* The Python callable object that is given the data */
   PyObject *callable;
+  /* What to actually call for each row: usually callable itself, but the
+     bound __call__ method if that supports vectorcall and callable does
+     not */
+  PyObject *call;
   /* Python value used for keywords not in the file (usually None) */
   PyObject *not_in_file;
   /* Python value used for keywords marked as omitted, '.' (usually None) */
@@ -259,21 +549,54 @@ struct category_handler_data {
   int num_keywords;
   /* Array of the keywords */
   struct ihm_keyword **keywords;
+  /* Python strings for BinaryCIF dictionary-encoded values, per keyword */
+  struct dict_string_cache *dict_caches;
+  /* Python strings for commonly-repeated values, per keyword */
+  struct string_table *string_caches;
+  /* Space for the arguments passed to the callable for each row (plus one
+     extra slot at the start, for vectorcall) */
+  PyObject **args;
+  /* Buffered rows, for handlers added with add_columnar_category_handler;
+     otherwise NULL */
+  struct column_buffers *columns;
 };
 
+static void column_buffers_free(struct column_buffers *cb);
+
 static void category_handler_data_free(void *data)
 {
+  int i;
   struct category_handler_data *hd = data;
   Py_DECREF(hd->callable);
+  Py_XDECREF(hd->call);
   Py_XDECREF(hd->not_in_file);
   Py_XDECREF(hd->omitted);
   Py_XDECREF(hd->unknown);
   /* Don't need to free each hd->keywords[i] as the ihm_reader owns
      these pointers */
   free(hd->keywords);
+  for (i = 0; i < hd->num_keywords; ++i) {
+    dict_string_cache_clear(&hd->dict_caches[i]);
+    string_table_clear(&hd->string_caches[i]);
+  }
+  free(hd->dict_caches);
+  free(hd->string_caches);
+  free(hd->args);
+  if (hd->columns) {
+    column_buffers_free(hd->columns);
+  }
   free(hd);
 }
 
+/* Release the first n Python objects in an argument array */
+static void clear_category_args(PyObject **args, int n)
+{
+  int i;
+  for (i = 0; i < n; ++i) {
+    Py_DECREF(args[i]);
+  }
+}
+
 /* Called for each category (or loop construct data line) with data */
 static void handle_category_data(struct ihm_reader *reader, int linenum,
                                  void *data, struct ihm_error **err)
@@ -281,15 +604,12 @@ static void handle_category_data(struct ihm_reader *reader, int linenum,
   int i;
   struct category_handler_data *hd = data;
   struct ihm_keyword **keys;
-  PyObject *ret, *tuple;
-
-  /* make a tuple of the data */
-  tuple = PyTuple_New(hd->num_keywords);
-  if (!tuple) {
-    ihm_error_set(err, IHM_ERROR_VALUE, "tuple creation failed");
-    return;
-  }
+  /* The first slot is reserved for the callee (see
+     PY_VECTORCALL_ARGUMENTS_OFFSET) */
+  PyObject **args = hd->args + 1;
+  PyObject *ret;
 
+  python_enter();
   for (i = 0, keys = hd->keywords; i < hd->num_keywords; ++i, ++keys) {
     PyObject *val;
     if (!(*keys)->in_file) {
@@ -304,10 +624,15 @@ static void handle_category_data(struct ihm_reader *reader, int linenum,
     } else {
       switch((*keys)->type) {
       case IHM_STRING:
-        val = PyUnicode_FromString((*keys)->data.str);
+        if ((*keys)->dict) {
+          /* Reuse strings from BinaryCIF dictionary-encoded columns */
+          val = dict_string_cache_get(&hd->dict_caches[i], *keys);
+        } else {
+          val = string_cache_get(&hd->string_caches[i], (*keys)->data.str);
+        }
         if (!val) {
           ihm_error_set(err, IHM_ERROR_VALUE, "string creation failed");
-          Py_DECREF(tuple);
+          clear_category_args(args, i);
           return;
         }
         break;
@@ -318,23 +643,44 @@ static void handle_category_data(struct ihm_reader *reader, int linenum,
         val = PyFloat_FromDouble((*keys)->data.fval);
         break;
       case IHM_BOOL:
+      default:
         val = (*keys)->data.bval ? Py_True : Py_False;
+        Py_INCREF(val);
         break;
       }
     }
-    /* Steals ref to val */
-    PyTuple_SET_ITEM(tuple, i, val);
+    args[i] = val;
   }
 
-  /* pass the data to Python */
-  ret = PyObject_CallObject(hd->callable, tuple);
-  Py_DECREF(tuple);
+  /* pass the data to Python without making a tuple, if we can */
+#if PY_VERSION_HEX >= 0x03090000
+  ret = PyObject_Vectorcall(hd->call, args,
+                            hd->num_keywords | PY_VECTORCALL_ARGUMENTS_OFFSET,
+                            NULL);
+#else
+  {
+    PyObject *tuple = PyTuple_New(hd->num_keywords);
+    if (!tuple) {
+      clear_category_args(args, hd->num_keywords);
+      ihm_error_set(err, IHM_ERROR_VALUE, "tuple creation failed");
+      return;
+    }
+    for (i = 0; i < hd->num_keywords; ++i) {
+      Py_INCREF(args[i]);
+      PyTuple_SET_ITEM(tuple, i, args[i]);
+    }
+    ret = PyObject_CallObject(hd->call, tuple);
+    Py_DECREF(tuple);
+  }
+#endif
+  clear_category_args(args, hd->num_keywords);
   if (ret) {
     Py_DECREF(ret); /* discard return value */
   } else {
     /* Pass Python exception back to the original caller */
     ihm_error_set(err, IHM_ERROR_VALUE, "Python error");
   }
+  python_leave();
 }
 
 /* Called at the end of each save frame for each category */
@@ -344,6 +690,7 @@ static void end_frame_category(struct ihm_reader *reader, int linenum,
   PyObject *ret;
   struct category_handler_data *hd = data;
 
+  python_enter();
   ret = PyObject_CallMethod(hd->callable, "end_save_frame", NULL);
   if (ret) {
     Py_DECREF(ret); /* discard return value */
@@ -351,6 +698,27 @@ static void end_frame_category(struct ihm_reader *reader, int linenum,
     /* Pass Python exception back to the original caller */
     ihm_error_set(err, IHM_ERROR_VALUE, "Python error");
   }
+  python_leave();
+}
+
+/* Get the object to call for each row of data for the given callable
+   (new reference). Instances of Python classes (which all reader handlers
+   are) don't support vectorcall, so calling them would build an argument
+   tuple for every row; their bound __call__ method does support it. */
+static PyObject *get_row_callable(PyObject *callable)
+{
+#if PY_VERSION_HEX >= 0x03090000
+  if (!PyVectorcall_Function(callable)) {
+    PyObject *call = PyObject_GetAttrString(callable, "__call__");
+    if (call && PyVectorcall_Function(call)) {
+      return call;
+    }
+    Py_XDECREF(call);
+    PyErr_Clear();
+  }
+#endif
+  Py_INCREF(callable);
+  return callable;
 }
 
 static struct category_handler_data *do_add_handler(
@@ -361,6 +729,7 @@ static struct category_handler_data *do_add_handler(
                         ihm_category_callback data_callback,
                         ihm_category_callback end_frame_callback,
                         ihm_category_callback finalize_callback,
+                        struct column_buffers *columns,
                         struct ihm_error **err)
 {
   Py_ssize_t seqlen, i;
@@ -369,34 +738,56 @@ static struct category_handler_data *do_add_handler(
 
   if (!PySequence_Check(keywords)) {
     ihm_error_set(err, IHM_ERROR_VALUE, "'keywords' should be a sequence");
-    return NULL;
+    goto free_columns;
   }
   if (!PyAnySet_Check(int_keywords)) {
     ihm_error_set(err, IHM_ERROR_VALUE, "'int_keywords' should be a set");
-    return NULL;
+    goto free_columns;
   }
   if (!PyAnySet_Check(float_keywords)) {
     ihm_error_set(err, IHM_ERROR_VALUE, "'float_keywords' should be a set");
-    return NULL;
+    goto free_columns;
   }
   if (!PyAnySet_Check(bool_keywords)) {
     ihm_error_set(err, IHM_ERROR_VALUE, "'bool_keywords' should be a set");
-    return NULL;
+    goto free_columns;
   }
   if (!PyCallable_Check(callable)) {
     ihm_error_set(err, IHM_ERROR_VALUE,
                   "'callable' should be a callable object");
-    return NULL;
+    goto free_columns;
   }
   seqlen = PySequence_Length(keywords);
-  hd = malloc(sizeof(struct category_handler_data));
+  if (seqlen < 0) {
+    ihm_error_set(err, IHM_ERROR_VALUE, "'keywords' should be a sequence");
+    goto free_columns;
+  }
+  /* Allocate everything up front, so that the per-row callbacks never see
+     a partially-constructed handler */
+  hd = calloc(1, sizeof(struct category_handler_data));
+  if (!hd) {
+    ihm_error_set(err, IHM_ERROR_VALUE, "Out of memory");
+    goto free_columns;
+  }
+  hd->keywords = malloc(sizeof(struct ihm_keyword *) * (seqlen + 1));
+  hd->dict_caches = calloc(seqlen + 1, sizeof(struct dict_string_cache));
+  hd->string_caches = calloc(seqlen + 1, sizeof(struct string_table));
+  hd->args = malloc(sizeof(PyObject *) * (seqlen + 1));
+  if (!hd->keywords || !hd->dict_caches || !hd->string_caches || !hd->args) {
+    free(hd->keywords);
+    free(hd->dict_caches);
+    free(hd->string_caches);
+    free(hd->args);
+    free(hd);
+    ihm_error_set(err, IHM_ERROR_VALUE, "Out of memory");
+    goto free_columns;
+  }
   Py_INCREF(callable);
   hd->callable = callable;
-  hd->not_in_file = NULL;
-  hd->omitted = NULL;
-  hd->unknown = NULL;
+  hd->call = get_row_callable(callable);
   hd->num_keywords = seqlen;
-  hd->keywords = malloc(sizeof(struct ihm_keyword *) * seqlen);
+  /* hd now owns the column buffers, if any */
+  hd->columns = columns;
   category = ihm_category_new(reader, name, data_callback, end_frame_callback,
                               finalize_callback, hd,
                               category_handler_data_free);
@@ -429,6 +820,12 @@ static struct category_handler_data *do_add_handler(
     }
   }
   return hd;
+
+free_columns:
+  if (columns) {
+    column_buffers_free(columns);
+  }
+  return NULL;
 }
 
 /* Pass unknown category info to a Python callable */
@@ -437,13 +834,15 @@ static void unknown_category_python(struct ihm_reader *reader,
                                     void *data, struct ihm_error **err)
 {
   static char fmt[] = "(si)";
-  PyObject *callable = data;
-  PyObject *result = PyObject_CallFunction(callable, fmt, category, linenum);
+  PyObject *callable = data, *result;
+  python_enter();
+  result = PyObject_CallFunction(callable, fmt, category, linenum);
   if (!result) {
     ihm_error_set(err, IHM_ERROR_VALUE, "Python error");
   } else {
     Py_DECREF(result);
   }
+  python_leave();
 }
 
 /* Pass unknown keyword info to a Python callable */
@@ -453,14 +852,86 @@ static void unknown_keyword_python(struct ihm_reader *reader,
                                    struct ihm_error **err)
 {
   static char fmt[] = "(ssi)";
-  PyObject *callable = data;
-  PyObject *result = PyObject_CallFunction(callable, fmt, category, keyword,
-                                           linenum);
+  PyObject *callable = data, *result;
+  python_enter();
+  result = PyObject_CallFunction(callable, fmt, category, keyword, linenum);
+  if (!result) {
+    ihm_error_set(err, IHM_ERROR_VALUE, "Python error");
+  } else {
+    Py_DECREF(result);
+  }
+  python_leave();
+}
+
+/* Pass progress info to a Python callable */
+static void progress_python(struct ihm_reader *reader, size_t bytes_read,
+                            size_t num_rows, const char *category,
+                            void *data, struct ihm_error **err)
+{
+  static char fmt[] = "(nnz)";
+  PyObject *callable = data, *result;
+  python_enter();
+  result = PyObject_CallFunction(callable, fmt, (Py_ssize_t)bytes_read,
+                                 (Py_ssize_t)num_rows, category);
   if (!result) {
     ihm_error_set(err, IHM_ERROR_VALUE, "Python error");
   } else {
     Py_DECREF(result);
   }
+  python_leave();
+}
+
+/* Add the name and category names of a BinaryCIF data block, as a
+   (header, [categories]) tuple, to a Python list */
+static void bcif_contents_python(int index, const char *header,
+                                 size_t num_categories, char **categories,
+                                 void *data, struct ihm_error **err)
+{
+  static char fmt[] = "(zN)";
+  size_t i;
+  PyObject *contents = data, *item;
+  PyObject *cats;
+
+  python_enter();
+  cats = PyList_New(num_categories);
+  if (!cats) {
+    ihm_error_set(err, IHM_ERROR_VALUE, "list creation failed");
+    python_leave();
+    return;
+  }
+  for (i = 0; i < num_categories; ++i) {
+    PyObject *name = PyUnicode_FromString(categories[i]);
+    if (!name) {
+      Py_DECREF(cats);
+      ihm_error_set(err, IHM_ERROR_VALUE, "string creation failed");
+      python_leave();
+      return;
+    }
+    PyList_SET_ITEM(cats, i, name);
+  }
+  /* item takes ownership of cats */
+  item = Py_BuildValue(fmt, header, cats);
+  if (!item || PyList_Append(contents, item) < 0) {
+    ihm_error_set(err, IHM_ERROR_VALUE, "Python error");
+  }
+  Py_XDECREF(item);
+  python_leave();
+}
+
+/* Add the statistics for a single category, as a (num_rows, callback_time)
+   tuple, to a Python dict. On error, a Python exception is left set. */
+static void category_stats_python(const char *name, size_t num_rows,
+                                  double callback_time, void *data)
+{
+  PyObject *cats = data, *item;
+  if (PyErr_Occurred()) {
+    return;
+  }
+  item = Py_BuildValue("(nd)", (Py_ssize_t)num_rows, callback_time);
+  if (item) {
+    PyDict_SetItemString(cats, name, item);
+    Py_DECREF(item);
+  }
 }
 
 /* Treat data as a Python object, and decrease its refcount */
@@ -470,9 +941,167 @@ static void free_python_callable(void *data)
   Py_DECREF(obj);
 }
 
+/* Release the GIL at the start of a read, storing the state of any read
+   in progress (e.g. one whose Python callback triggered this read) in prev.
+   Return false if GIL state can't be tracked, in which case the GIL
+   must be held throughout. */
+static bool begin_release_gil(struct gil_state *st, struct gil_state **prev)
+{
+  if (!PyThread_tss_is_created(&gil_state_key)
+      && PyThread_tss_create(&gil_state_key) != 0) {
+    return false;
+  }
+  *prev = PyThread_tss_get(&gil_state_key);
+  st->saved = NULL;
+  st->ncallbacks = 0;
+  PyThread_tss_set(&gil_state_key, st);
+  python_release();
+  return true;
+}
+
+/* Reacquire the GIL at the end of a read started with begin_release_gil */
+static void end_release_gil(struct gil_state *prev)
+{
+  python_enter();
+  PyThread_tss_set(&gil_state_key, prev);
+}
+
 %}
 
 %inline %{
+/* Read a file, as for ihm_read_file, but without holding the GIL except
+   while calling back into Python. This allows other Python threads to
+   run while we tokenize the file or decode BinaryCIF data. */
+bool read_file_release_gil(struct ihm_reader *reader, bool *more_data,
+                           struct ihm_error **err)
+{
+  bool ret;
+  struct gil_state st, *prev;
+  if (!begin_release_gil(&st, &prev)) {
+    return ihm_read_file(reader, more_data, err);
+  }
+  ret = ihm_read_file(reader, more_data, err);
+  end_release_gil(prev);
+  return ret;
+}
+
+/* Finish reading pushed data, as for ihm_reader_finish, but without
+   holding the GIL except while calling back into Python */
+bool reader_finish_release_gil(struct ihm_reader *reader, bool *more_data,
+                               struct ihm_error **err)
+{
+  bool ret;
+  struct gil_state st, *prev;
+  if (!begin_release_gil(&st, &prev)) {
+    return ihm_reader_finish(reader, more_data, err);
+  }
+  ret = ihm_reader_finish(reader, more_data, err);
+  end_release_gil(prev);
+  return ret;
+}
+
+/* Skip BinaryCIF data blocks, as for ihm_reader_bcif_skip_to_block, but
+   without holding the GIL */
+bool bcif_skip_to_block_release_gil(struct ihm_reader *reader, int index,
+                                    bool *found, struct ihm_error **err)
+{
+  bool ret;
+  struct gil_state st, *prev;
+  if (!begin_release_gil(&st, &prev)) {
+    return ihm_reader_bcif_skip_to_block(reader, index, found, err);
+  }
+  ret = ihm_reader_bcif_skip_to_block(reader, index, found, err);
+  end_release_gil(prev);
+  return ret;
+}
+
+/* Skip BinaryCIF data blocks, as for ihm_reader_bcif_skip_to_named_block,
+   but without holding the GIL */
+bool bcif_skip_to_named_block_release_gil(struct ihm_reader *reader,
+                                          const char *name, bool *found,
+                                          struct ihm_error **err)
+{
+  bool ret;
+  struct gil_state st, *prev;
+  if (!begin_release_gil(&st, &prev)) {
+    return ihm_reader_bcif_skip_to_named_block(reader, name, found, err);
+  }
+  ret = ihm_reader_bcif_skip_to_named_block(reader, name, found, err);
+  end_release_gil(prev);
+  return ret;
+}
+
+/* Add data to a push reader, as for ihm_reader_feed. The data can be
+   given as a str (for mmCIF) or any object supporting the buffer
+   protocol, such as bytes. As for reading, the GIL is released while
+   the data is parsed. */
+bool reader_feed_python(struct ihm_reader *reader, PyObject *data,
+                        bool *block_done, struct ihm_error **err)
+{
+  bool ret;
+  struct gil_state st, *prev;
+  Py_buffer view;
+  const char *buf;
+  Py_ssize_t len;
+  if (PyUnicode_Check(data)) {
+    if (!(buf = PyUnicode_AsUTF8AndSize(data, &len))) {
+      ihm_error_set(err, IHM_ERROR_VALUE, "string creation failed");
+      return false;
+    }
+    view.obj = NULL;
+  } else if (PyObject_GetBuffer(data, &view, PyBUF_SIMPLE) == 0) {
+    buf = view.buf;
+    len = view.len;
+  } else {
+    PyErr_Clear();
+    ihm_error_set(err, IHM_ERROR_VALUE,
+                  "data should be a string or a bytes-like object");
+    return false;
+  }
+  if (begin_release_gil(&st, &prev)) {
+    ret = ihm_reader_feed(reader, buf, len, block_done, err);
+    end_release_gil(prev);
+  } else {
+    ret = ihm_reader_feed(reader, buf, len, block_done, err);
+  }
+  if (view.obj) {
+    PyBuffer_Release(&view);
+  }
+  return ret;
+}
+
+/* Get statistics for a reader, as for ihm_reader_get_stats, as a dict.
+   Per-category statistics are given as a dict, 'categories', of
+   (num_rows, callback_time) tuples keyed by category name.
+   Return NULL (with a Python exception set) on error. */
+PyObject *reader_get_stats_python(struct ihm_reader *reader)
+{
+  struct ihm_reader_stats st;
+  PyObject *cats, *ret;
+  if (!(cats = PyDict_New())) {
+    return NULL;
+  }
+  ihm_reader_category_stats_foreach(reader, category_stats_python, cats);
+  if (PyErr_Occurred()) {
+    Py_DECREF(cats);
+    return NULL;
+  }
+  ihm_reader_get_stats(reader, &st);
+  /* ret takes ownership of cats */
+  ret = Py_BuildValue("{snsnsnsnsnsdsdsdsdsN}",
+                      "bytes_read", (Py_ssize_t)st.bytes_read,
+                      "lines", (Py_ssize_t)st.lines,
+                      "tokens", (Py_ssize_t)st.tokens,
+                      "buffer_max", (Py_ssize_t)st.buffer_max,
+                      "buffer_grows", (Py_ssize_t)st.buffer_grows,
+                      "total_time", st.total_time,
+                      "io_time", st.io_time,
+                      "callback_time", st.callback_time,
+                      "parse_time", st.parse_time,
+                      "categories", cats);
+  return ret;
+}
+
 /* Add a handler for unknown categories */
 void add_unknown_category_handler(struct ihm_reader *reader,
                                   PyObject *callable, struct ihm_error **err)
@@ -501,6 +1130,38 @@ void add_unknown_keyword_handler(struct ihm_reader *reader,
                                           callable, free_python_callable);
 }
 
+/* Add a handler for progress reports */
+void add_progress_handler(struct ihm_reader *reader, PyObject *callable,
+                          size_t interval, struct ihm_error **err)
+{
+  if (!PyCallable_Check(callable)) {
+    ihm_error_set(err, IHM_ERROR_VALUE,
+                  "'callable' should be a callable object");
+    return;
+  }
+  Py_INCREF(callable);
+  ihm_reader_progress_callback_set(reader, progress_python, callable,
+                                   free_python_callable, interval);
+}
+
+/* Append a (header, [categories]) tuple to the given Python list for
+   each remaining data block in a BinaryCIF file */
+void bcif_contents(struct ihm_reader *reader, PyObject *contents,
+                   struct ihm_error **err)
+{
+  struct gil_state st, *prev;
+  if (!PyList_Check(contents)) {
+    ihm_error_set(err, IHM_ERROR_VALUE, "'contents' should be a list");
+    return;
+  }
+  if (begin_release_gil(&st, &prev)) {
+    ihm_reader_bcif_contents(reader, bcif_contents_python, contents, err);
+    end_release_gil(prev);
+  } else {
+    ihm_reader_bcif_contents(reader, bcif_contents_python, contents, err);
+  }
+}
+
 /* Add a generic category handler which collects all specified keywords for
    the given category and passes them to a Python callable */
 void add_category_handler(struct ihm_reader *reader, char *name,
@@ -510,7 +1171,7 @@ void add_category_handler(struct ihm_reader *reader, char *name,
 {
   do_add_handler(reader, name, keywords, int_keywords, float_keywords,
                  bool_keywords, callable, handle_category_data,
-                 end_frame_category, NULL, err);
+                 end_frame_category, NULL, NULL, err);
 }
 %}
 
@@ -554,6 +1215,7 @@ static void handle_poly_seq_scheme_data(struct ihm_reader *reader, int linenum,
       && seq_id == pdb_seq_num && seq_id == auth_seq_num
       && (!hd->keywords[4]->in_file || hd->keywords[4]->omitted
           || hd->keywords[4]->unknown)) {
+    python_leave();
     return;
   } else {
     /* Otherwise, call the normal handler */
@@ -576,7 +1238,7 @@ void add_poly_seq_scheme_handler(struct ihm_reader *reader, char *name,
   struct category_handler_data *hd;
   hd = do_add_handler(reader, name, keywords, int_keywords, float_keywords,
                       bool_keywords, callable, handle_poly_seq_scheme_data,
-                      NULL, NULL, err);
+                      NULL, NULL, NULL, err);
   if (hd) {
     /* Make sure the Python handler and the C handler agree on the order
        of the keywords */
@@ -597,9 +1259,1372 @@ void _test_finalize_callback(struct ihm_reader *reader, char *name,
 {
   do_add_handler(reader, name, keywords, int_keywords, float_keywords,
                  bool_keywords, callable, handle_category_data, NULL,
-                 handle_category_data, err);
+                 handle_category_data, NULL, err);
+}
+
+%}
+
+%{
+/* Maximum number of rows to buffer before passing them to Python, so that
+   memory use does not grow with the size of the category */
+#define COLUMN_FLUSH_ROWS 65536
+
+/* State of each value in a columnar handler's buffer */
+enum {
+  COLUMN_VALUE = 0, COLUMN_NOT_IN_FILE, COLUMN_OMITTED, COLUMN_UNKNOWN
+};
+
+/* All values read so far for a single keyword. Strings are stored as
+   indices into a table of distinct values, so that repeated values
+   (such as asym or model IDs) are only converted to Python once. */
+struct column_buffer {
+  /* COLUMN_* state of each row */
+  unsigned char *state;
+  union {
+    double *fval;
+    int *ival;
+    size_t *sval;
+  } data;
+  /* Distinct strings seen so far */
+  struct string_table strings;
+};
+
+/* Growable typed buffers for all keywords in a category */
+struct column_buffers {
+  int num_columns;
+  size_t num_rows, alloc_rows;
+  struct column_buffer *columns;
+  /* If true, pass buffered rows to Python every time the value of the
+     first keyword changes */
+  bool group_by_first;
+  /* If true, pass int and float keywords to Python as bytes containing
+     the raw values, rather than as lists (see column_buffer_to_bytes) */
+  bool raw_numeric;
+};
+
+static void column_buffers_free(struct column_buffers *cb)
+{
+  int i;
+  for (i = 0; i < cb->num_columns; ++i) {
+    struct column_buffer *col = &cb->columns[i];
+    string_table_clear(&col->strings);
+    free(col->state);
+    free(col->data.fval);
+  }
+  free(cb->columns);
+  free(cb);
+}
+
+/* Make room for more rows in every column. Return false on failure. */
+static bool column_buffers_grow(struct column_buffers *cb,
+                                struct ihm_keyword **keys)
+{
+  int i;
+  size_t alloc_rows = cb->alloc_rows ? cb->alloc_rows * 2 : 1024;
+  for (i = 0; i < cb->num_columns; ++i) {
+    struct column_buffer *col = &cb->columns[i];
+    size_t elsize;
+    void *state, *data;
+    switch(keys[i]->type) {
+    case IHM_FLOAT:
+      elsize = sizeof(double);
+      break;
+    case IHM_STRING:
+      elsize = sizeof(size_t);
+      break;
+    default:
+      elsize = sizeof(int);
+      break;
+    }
+    if (!(state = realloc(col->state, alloc_rows))) {
+      return false;
+    }
+    col->state = state;
+    if (!(data = realloc(col->data.fval, alloc_rows * elsize))) {
+      return false;
+    }
+    col->data.fval = data;
+  }
+  cb->alloc_rows = alloc_rows;
+  return true;
+}
+
+/* Return true iff the given two rows have the same value for the
+   given column */
+static bool column_buffer_rows_equal(struct column_buffer *col,
+                                     ihm_keyword_type type, size_t i,
+                                     size_t j)
+{
+  if (col->state[i] != col->state[j]) {
+    return false;
+  } else if (col->state[i] != COLUMN_VALUE) {
+    return true;
+  }
+  switch(type) {
+  case IHM_STRING:
+    return col->data.sval[i] == col->data.sval[j];
+  case IHM_FLOAT:
+    return col->data.fval[i] == col->data.fval[j];
+  default:
+    return col->data.ival[i] == col->data.ival[j];
+  }
 }
 
+/* Copy one row of the buffers to another */
+static void column_buffers_copy_row(struct column_buffers *cb,
+                                    struct ihm_keyword **keys, size_t from,
+                                    size_t to)
+{
+  int i;
+  for (i = 0; i < cb->num_columns; ++i) {
+    struct column_buffer *col = &cb->columns[i];
+    col->state[to] = col->state[from];
+    switch(keys[i]->type) {
+    case IHM_STRING:
+      col->data.sval[to] = col->data.sval[from];
+      break;
+    case IHM_FLOAT:
+      col->data.fval[to] = col->data.fval[from];
+      break;
+    default:
+      col->data.ival[to] = col->data.ival[from];
+      break;
+    }
+  }
+}
+
+static void flush_columnar_data(struct ihm_reader *reader, int linenum,
+                                void *data, struct ihm_error **err);
+
+/* Called for each line of a category read with a columnar handler;
+   just append the values to the buffers */
+static void handle_columnar_data(struct ihm_reader *reader, int linenum,
+                                 void *data, struct ihm_error **err)
+{
+  int i;
+  struct category_handler_data *hd = data;
+  struct column_buffers *cb = hd->columns;
+  struct ihm_keyword **keys;
+  size_t row = cb->num_rows;
+
+  if (row == cb->alloc_rows && !column_buffers_grow(cb, hd->keywords)) {
+    ihm_error_set(err, IHM_ERROR_VALUE, "Out of memory");
+    return;
+  }
+  for (i = 0, keys = hd->keywords; i < hd->num_keywords; ++i, ++keys) {
+    struct column_buffer *col = &cb->columns[i];
+    if (!(*keys)->in_file) {
+      col->state[row] = COLUMN_NOT_IN_FILE;
+    } else if ((*keys)->omitted) {
+      col->state[row] = COLUMN_OMITTED;
+    } else if ((*keys)->unknown) {
+      col->state[row] = COLUMN_UNKNOWN;
+    } else {
+      col->state[row] = COLUMN_VALUE;
+      switch((*keys)->type) {
+      case IHM_STRING:
+        if (!string_table_index(&col->strings, (*keys)->data.str,
+                                &col->data.sval[row])) {
+          ihm_error_set(err, IHM_ERROR_VALUE, "Out of memory");
+          return;
+        }
+        break;
+      case IHM_INT:
+        col->data.ival[row] = (*keys)->data.ival;
+        break;
+      case IHM_FLOAT:
+        col->data.fval[row] = (*keys)->data.fval;
+        break;
+      case IHM_BOOL:
+        col->data.ival[row] = (*keys)->data.bval;
+        break;
+      }
+    }
+  }
+  /* If this row starts a new group, pass the previous rows to Python */
+  if (cb->group_by_first && row > 0
+      && !column_buffer_rows_equal(&cb->columns[0], hd->keywords[0]->type,
+                                   row - 1, row)) {
+    cb->num_rows = row;
+    flush_columnar_data(reader, linenum, data, err);
+    if (*err) {
+      return;
+    }
+    column_buffers_copy_row(cb, hd->keywords, row, 0);
+    row = 0;
+  }
+  cb->num_rows = row + 1;
+  if (cb->num_rows >= COLUMN_FLUSH_ROWS) {
+    flush_columnar_data(reader, linenum, data, err);
+  }
+  python_leave();
+}
+
+/* Make a Python list of all buffered values for a single keyword.
+   Return a new reference, or NULL (with a Python exception set) on error. */
+static PyObject *column_buffer_to_list(struct category_handler_data *hd,
+                                       struct column_buffer *col,
+                                       ihm_keyword_type type, size_t num_rows)
+{
+  size_t i;
+  PyObject *last_int = NULL;
+  PyObject *list = PyList_New(num_rows);
+  if (!list) {
+    return NULL;
+  }
+  for (i = 0; i < num_rows; ++i) {
+    PyObject *val;
+    switch(col->state[i]) {
+    case COLUMN_NOT_IN_FILE:
+      val = hd->not_in_file;
+      Py_INCREF(val);
+      break;
+    case COLUMN_OMITTED:
+      val = hd->omitted;
+      Py_INCREF(val);
+      break;
+    case COLUMN_UNKNOWN:
+      val = hd->unknown;
+      Py_INCREF(val);
+      break;
+    default:
+      switch(type) {
+      case IHM_STRING:
+        val = string_table_object(&col->strings, col->data.sval[i]);
+        break;
+      case IHM_INT:
+        /* Runs of the same int (e.g. seq_id) share a Python object */
+        if (last_int && PyLong_AsLong(last_int) == col->data.ival[i]) {
+          val = last_int;
+          Py_INCREF(val);
+        } else {
+          val = last_int = PyLong_FromLong(col->data.ival[i]);
+        }
+        break;
+      case IHM_FLOAT:
+        val = PyFloat_FromDouble(col->data.fval[i]);
+        break;
+      case IHM_BOOL:
+        val = col->data.ival[i] ? Py_True : Py_False;
+        Py_INCREF(val);
+        break;
+      default:
+        val = NULL;
+        PyErr_SetString(PyExc_ValueError, "Unknown keyword type");
+        break;
+      }
+      if (!val) {
+        Py_DECREF(list);
+        return NULL;
+      }
+    }
+    /* Steals ref to val */
+    PyList_SET_ITEM(list, i, val);
+  }
+  return list;
+}
+
+/* Make a Python bytes object containing all buffered values for a single
+   int or float keyword, as native doubles or 64-bit ints, suitable for
+   array.array.frombytes. Values not in the file, omitted, or unknown are
+   stored as NaN for floats or LLONG_MIN for ints.
+   Return a new reference, or NULL (with a Python exception set) on error. */
+static PyObject *column_buffer_to_bytes(struct column_buffer *col,
+                                        ihm_keyword_type type,
+                                        size_t num_rows)
+{
+  size_t i;
+  PyObject *bytes;
+  if (type == IHM_FLOAT) {
+    double *d;
+    bytes = PyBytes_FromStringAndSize(NULL, num_rows * sizeof(double));
+    if (!bytes) {
+      return NULL;
+    }
+    d = (double *)PyBytes_AS_STRING(bytes);
+    for (i = 0; i < num_rows; ++i) {
+      d[i] = col->state[i] == COLUMN_VALUE ? col->data.fval[i] : NAN;
+    }
+  } else {
+    long long *d;
+    bytes = PyBytes_FromStringAndSize(NULL, num_rows * sizeof(long long));
+    if (!bytes) {
+      return NULL;
+    }
+    d = (long long *)PyBytes_AS_STRING(bytes);
+    for (i = 0; i < num_rows; ++i) {
+      d[i] = col->state[i] == COLUMN_VALUE ? col->data.ival[i] : LLONG_MIN;
+    }
+  }
+  return bytes;
+}
+
+/* Pass all buffered rows to the Python handler's _add_columns method,
+   as one list (or bytes object, if raw_numeric is set) per keyword,
+   and empty the buffers */
+static void flush_columnar_data(struct ihm_reader *reader, int linenum,
+                                void *data, struct ihm_error **err)
+{
+  int i;
+  struct category_handler_data *hd = data;
+  struct column_buffers *cb = hd->columns;
+  PyObject *meth, *ret, *tuple;
+
+  if (cb->num_rows == 0) {
+    return;
+  }
+  python_enter();
+  tuple = PyTuple_New(cb->num_columns);
+  if (!tuple) {
+    ihm_error_set(err, IHM_ERROR_VALUE, "tuple creation failed");
+    return;
+  }
+  for (i = 0; i < cb->num_columns; ++i) {
+    ihm_keyword_type type = hd->keywords[i]->type;
+    PyObject *list;
+    if (cb->raw_numeric && (type == IHM_INT || type == IHM_FLOAT)) {
+      list = column_buffer_to_bytes(&cb->columns[i], type, cb->num_rows);
+    } else {
+      list = column_buffer_to_list(hd, &cb->columns[i], type, cb->num_rows);
+    }
+    if (!list) {
+      Py_DECREF(tuple);
+      ihm_error_set(err, IHM_ERROR_VALUE, "Python error");
+      return;
+    }
+    /* Steals ref to list */
+    PyTuple_SET_ITEM(tuple, i, list);
+  }
+  cb->num_rows = 0;
+
+  meth = PyObject_GetAttrString(hd->callable, "_add_columns");
+  ret = meth ? PyObject_CallObject(meth, tuple) : NULL;
+  Py_XDECREF(meth);
+  Py_DECREF(tuple);
+  if (ret) {
+    Py_DECREF(ret); /* discard return value */
+  } else {
+    /* Pass Python exception back to the original caller */
+    ihm_error_set(err, IHM_ERROR_VALUE, "Python error");
+  }
+  python_release();
+}
+
+/* Called at the end of each save frame for a columnar handler */
+static void end_frame_columnar(struct ihm_reader *reader, int linenum,
+                               void *data, struct ihm_error **err)
+{
+  flush_columnar_data(reader, linenum, data, err);
+  if (!*err) {
+    end_frame_category(reader, linenum, data, err);
+  }
+}
+
+static struct category_handler_data *do_add_columnar_handler(
+                        struct ihm_reader *reader, char *name,
+                        PyObject *keywords, PyObject *int_keywords,
+                        PyObject *float_keywords, PyObject *bool_keywords,
+                        PyObject *callable, bool group_by_first,
+                        struct ihm_error **err)
+{
+  Py_ssize_t seqlen;
+  struct column_buffers *cb;
+  PyObject *raw;
+
+  if (!PySequence_Check(keywords)
+      || (seqlen = PySequence_Length(keywords)) < 0) {
+    ihm_error_set(err, IHM_ERROR_VALUE, "'keywords' should be a sequence");
+    return NULL;
+  }
+  cb = calloc(1, sizeof(struct column_buffers));
+  if (!cb || !(cb->columns = calloc(seqlen + 1,
+                                    sizeof(struct column_buffer)))) {
+    free(cb);
+    ihm_error_set(err, IHM_ERROR_VALUE, "Out of memory");
+    return NULL;
+  }
+  cb->num_columns = seqlen;
+  cb->group_by_first = group_by_first && seqlen > 0;
+  /* Handlers can ask for raw numeric columns by setting
+     _raw_numeric_columns to True */
+  if ((raw = PyObject_GetAttrString(callable, "_raw_numeric_columns"))) {
+    cb->raw_numeric = PyObject_IsTrue(raw) == 1;
+    Py_DECREF(raw);
+  } else {
+    PyErr_Clear();
+  }
+  /* do_add_handler takes ownership of the buffers, so that the category
+     is never registered without them */
+  return do_add_handler(reader, name, keywords, int_keywords, float_keywords,
+                        bool_keywords, callable, handle_columnar_data,
+                        end_frame_columnar, flush_columnar_data, cb, err);
+}
+%}
+
+%inline %{
+/* Add a handler which buffers rows of the given category in typed
+   arrays, and passes them to the Python object's _add_columns method
+   (as a list of values per keyword) when the category is finished, or
+   every COLUMN_FLUSH_ROWS rows. This is much faster than
+   add_category_handler for large tables such as _atom_site, as no
+   per-row tuple or Python call is needed. */
+void add_columnar_category_handler(struct ihm_reader *reader, char *name,
+                                   PyObject *keywords, PyObject *int_keywords,
+                                   PyObject *float_keywords,
+                                   PyObject *bool_keywords,
+                                   PyObject *callable, struct ihm_error **err)
+{
+  do_add_columnar_handler(reader, name, keywords, int_keywords,
+                          float_keywords, bool_keywords, callable, false, err);
+}
+
+/* Add a columnar handler, as for add_columnar_category_handler, which
+   also passes the buffered rows to Python each time the value of the
+   first keyword changes (e.g. at the end of each model in _atom_site) */
+void add_grouped_columnar_category_handler(
+                 struct ihm_reader *reader, char *name, PyObject *keywords,
+                 PyObject *int_keywords, PyObject *float_keywords,
+                 PyObject *bool_keywords, PyObject *callable,
+                 struct ihm_error **err)
+{
+  do_add_columnar_handler(reader, name, keywords, int_keywords,
+                          float_keywords, bool_keywords, callable, true, err);
+}
+%}
+
+%{
+/* BinaryCIF ByteArray data types */
+#define BCIF_INT8 1
+#define BCIF_INT16 2
+#define BCIF_INT32 3
+#define BCIF_UINT8 4
+#define BCIF_UINT16 5
+#define BCIF_UINT32 6
+#define BCIF_FLOAT32 32
+#define BCIF_FLOAT64 33
+
+/* Get the narrowest BinaryCIF ByteArray type that can represent all of
+   the given integers, or -1 if no type can */
+static int bcif_int_type(const int64_t *data, size_t n)
+{
+  size_t i;
+  int64_t minval, maxval;
+  if (n == 0) {
+    return BCIF_UINT8;
+  }
+  minval = maxval = data[0];
+  for (i = 1; i < n; ++i) {
+    if (data[i] < minval) minval = data[i];
+    if (data[i] > maxval) maxval = data[i];
+  }
+  if (minval >= 0) {
+    if (maxval <= 0xFF) {
+      return BCIF_UINT8;
+    } else if (maxval <= 0xFFFF) {
+      return BCIF_UINT16;
+    } else if (maxval <= 0xFFFFFFFFLL) {
+      return BCIF_UINT32;
+    }
+  } else {
+    if (minval >= -0x80 && maxval <= 0x7F) {
+      return BCIF_INT8;
+    } else if (minval >= -0x8000 && maxval <= 0x7FFF) {
+      return BCIF_INT16;
+    } else if (minval >= -0x80000000LL && maxval <= 0x7FFFFFFF) {
+      return BCIF_INT32;
+    }
+  }
+  return -1;
+}
+
+/* Replace integers with the differences between consecutive values
+   (BinaryCIF Delta encoding). The first value becomes zero, so the caller
+   should store it as the origin first. */
+static void bcif_delta_encode(int64_t *data, size_t n)
+{
+  size_t i;
+  int64_t prev;
+  if (n == 0) return;
+  prev = data[0];
+  data[0] = 0;
+  for (i = 1; i < n; ++i) {
+    int64_t cur = data[i];
+    data[i] = cur - prev;
+    prev = cur;
+  }
+}
+
+/* Encode integers as (value, number of repeats) pairs (BinaryCIF RunLength
+   encoding). `out` must have room for 2*n values. Return the number of
+   values written to `out`. */
+static size_t bcif_run_length_encode(const int64_t *data, size_t n,
+                                     int64_t *out)
+{
+  size_t i, nout = 0;
+  for (i = 0; i < n; ++i) {
+    if (nout > 0 && out[nout - 2] == data[i]) {
+      out[nout - 1]++;
+    } else {
+      out[nout++] = data[i];
+      out[nout++] = 1;
+    }
+  }
+  return nout;
+}
+
+/* Return the size in bytes of each element of the given ByteArray type */
+static size_t bcif_type_size(int type)
+{
+  switch(type) {
+  case BCIF_INT8:
+  case BCIF_UINT8:
+    return 1;
+  case BCIF_INT16:
+  case BCIF_UINT16:
+    return 2;
+  case BCIF_FLOAT64:
+    return 8;
+  default:
+    return 4;
+  }
+}
+
+/* Store integers in `out` as little-endian values of the given ByteArray
+   type (which must be able to represent every value; see
+   bcif_int_type). `out` must have room for
+   n * bcif_type_size(type) bytes. */
+static void bcif_pack_ints(const int64_t *data, size_t n, int type, char *out)
+{
+  size_t i, j, size = bcif_type_size(type);
+  unsigned char *pt = (unsigned char *)out;
+  for (i = 0; i < n; ++i) {
+    /* Two's complement representation, truncated to the type size */
+    uint64_t v = (uint64_t)data[i];
+    for (j = 0; j < size; ++j) {
+      *pt++ = (unsigned char)(v >> (8 * j));
+    }
+  }
+}
+
+/* Store floating point values in `out` as little-endian single precision.
+   `out` must have room for n * 4 bytes. Return false if any finite value
+   is too large to be represented in single precision. */
+static bool bcif_pack_floats(const double *data, size_t n, char *out)
+{
+  size_t i, j;
+  unsigned char *pt = (unsigned char *)out;
+  for (i = 0; i < n; ++i) {
+    float f = (float)data[i];
+    uint32_t v;
+    if (isinf(f) && !isinf(data[i])) {
+      return false;
+    }
+    memcpy(&v, &f, sizeof(float));
+    for (j = 0; j < sizeof(float); ++j) {
+      *pt++ = (unsigned char)(v >> (8 * j));
+    }
+  }
+  return true;
+}
+
+/* Get the upper and lower limits of each BinaryCIF IntegerPacking value */
+static void get_integer_packing_limits(int byte_count, bool is_unsigned,
+                                       int64_t *upper, int64_t *lower)
+{
+  if (is_unsigned) {
+    *upper = byte_count == 1 ? 0xFF : 0xFFFF;
+    *lower = 0;
+  } else {
+    *upper = byte_count == 1 ? 0x7F : 0x7FFF;
+    *lower = -*upper - 1;
+  }
+}
+
+/* Return the number of values needed to store the given integers using
+   BinaryCIF IntegerPacking with the given byte count (1 or 2) */
+static size_t bcif_integer_packed_size(const int64_t *data, size_t n,
+                                       int byte_count, bool is_unsigned)
+{
+  size_t i, size = 0;
+  int64_t upper, lower;
+  get_integer_packing_limits(byte_count, is_unsigned, &upper, &lower);
+  for (i = 0; i < n; ++i) {
+    size += (data[i] >= 0 ? data[i] / upper : data[i] / lower) + 1;
+  }
+  return size;
+}
+
+/* Store integers as 8- or 16-bit values (BinaryCIF IntegerPacking).
+   `out` must have room for bcif_integer_packed_size() values. */
+static void bcif_integer_pack(const int64_t *data, size_t n, int byte_count,
+                              bool is_unsigned, int64_t *out)
+{
+  size_t i;
+  int64_t upper, lower;
+  get_integer_packing_limits(byte_count, is_unsigned, &upper, &lower);
+  for (i = 0; i < n; ++i) {
+    int64_t d = data[i];
+    if (d >= 0) {
+      for (; d >= upper; d -= upper) {
+        *out++ = upper;
+      }
+    } else {
+      for (; d <= lower; d -= lower) {
+        *out++ = lower;
+      }
+    }
+    *out++ = d;
+  }
+}
+
+/* Find the smallest factor 10^k (k <= max_digits) with which the given
+   values can be stored as 32-bit integers using BinaryCIF FixedPoint
+   encoding, without changing their single precision representation.
+   On success, set factor, store the n integers in `out`, and return
+   true. */
+static bool bcif_fixed_point(const double *data, size_t n, int max_digits,
+                             int32_t *factor, int64_t *out)
+{
+  size_t i;
+  int digits;
+  double f = 1.;
+  for (i = 0; i < n; ++i) {
+    if (!isfinite(data[i])) {
+      return false;
+    }
+  }
+  for (digits = 0; digits <= max_digits; ++digits, f *= 10.) {
+    for (i = 0; i < n; ++i) {
+      double r = nearbyint(data[i] * f);
+      if (r < -2147483648. || r > 2147483647.
+          || (float)(r / f) != (float)data[i]) {
+        break;
+      }
+      out[i] = (int64_t)r;
+    }
+    if (i == n) {
+      *factor = (int32_t)f;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Append a new encoding dict (created with Py_BuildValue) to a list */
+static bool append_bcif_encoding(PyObject *encs, PyObject *enc)
+{
+  bool ok = (enc && PyList_Append(encs, enc) == 0);
+  Py_XDECREF(enc);
+  return ok;
+}
+
+/* Approximate size in bytes of each BinaryCIF encoding dict in the file */
+#define BCIF_ENCODING_COST 32
+
+/* Largest FixedPoint factor (as a power of 10) to try */
+#define BCIF_MAX_FIXED_POINT_DIGITS 6
+
+/* Apply Delta (if `delta` is true) and then RunLength (if `rle` is true)
+   encoding to integers. `work` and `rlebuf` must have room for n and 2*n
+   values respectively. The encoded data are returned in *out and *nout,
+   and the source type of each step in delta_type and rle_type. Return
+   false if the data cannot be represented in BinaryCIF. */
+static bool bcif_int_chain(const int64_t *data, size_t n, bool delta,
+                           bool rle, int64_t *work, int64_t *rlebuf,
+                           const int64_t **out, size_t *nout,
+                           int *delta_type, int *rle_type)
+{
+  *out = data;
+  *nout = n;
+  if (delta) {
+    if ((*delta_type = bcif_int_type(data, n)) < 0) return false;
+    memcpy(work, data, n * sizeof(int64_t));
+    bcif_delta_encode(work, n);
+    *out = work;
+  }
+  if (rle) {
+    if ((*rle_type = bcif_int_type(*out, *nout)) < 0) return false;
+    *nout = bcif_run_length_encode(*out, *nout, rlebuf);
+    *out = rlebuf;
+  }
+  return bcif_int_type(*out, *nout) >= 0;
+}
+
+/* Encode integers using whichever combination of Delta, RunLength,
+   IntegerPacking and ByteArray encodings gives the smallest output,
+   exactly as _encode_ints_smallest in Python does. Return values are
+   as for encode_bcif_ints. */
+static PyObject *encode_bcif_ints_smallest(const int64_t *data, size_t n)
+{
+  int delta, rle, delta_type = 0, rle_type = 0, type, byte_count;
+  int best_delta = -1, best_rle = 0, best_byte_count = 0;
+  size_t i, nout, best_cost = 0;
+  const int64_t *out;
+  int64_t *work, *rlebuf, *packed = NULL, minval, maxval;
+  bool is_unsigned;
+  PyObject *bytes, *encs = NULL;
+
+  work = (int64_t *)PyMem_Malloc(n * sizeof(int64_t));
+  rlebuf = (int64_t *)PyMem_Malloc(2 * n * sizeof(int64_t));
+  if (!work || !rlebuf) {
+    PyErr_NoMemory();
+    goto error;
+  }
+
+  for (delta = 0; delta <= 1; ++delta) {
+    for (rle = 0; rle <= 1; ++rle) {
+      size_t nenc = delta + rle;
+      if (!bcif_int_chain(data, n, delta, rle, work, rlebuf, &out, &nout,
+                          &delta_type, &rle_type)) {
+        continue;
+      }
+      minval = maxval = out[0];
+      for (i = 1; i < nout; ++i) {
+        if (out[i] < minval) minval = out[i];
+        if (out[i] > maxval) maxval = out[i];
+      }
+      for (byte_count = 0; byte_count <= 2; ++byte_count) {
+        size_t cost;
+        if (byte_count == 0) {
+          cost = nout * bcif_type_size(bcif_int_type(out, nout))
+                 + BCIF_ENCODING_COST * nenc;
+        } else if (minval >= -0x80000000LL && maxval <= 0x7FFFFFFF) {
+          /* IntegerPacking only handles 32-bit signed input */
+          cost = byte_count * bcif_integer_packed_size(
+                        out, nout, byte_count, minval >= 0)
+                 + BCIF_ENCODING_COST * (nenc + 1);
+        } else {
+          continue;
+        }
+        if (best_delta < 0 || cost < best_cost) {
+          best_cost = cost;
+          best_delta = delta;
+          best_rle = rle;
+          best_byte_count = byte_count;
+        }
+      }
+    }
+  }
+  if (best_delta < 0) goto error;
+
+  if (!(encs = PyList_New(0))) goto error;
+  bcif_int_chain(data, n, best_delta, best_rle, work, rlebuf, &out, &nout,
+                 &delta_type, &rle_type);
+  if (best_delta && !append_bcif_encoding(encs, Py_BuildValue(
+                 "{s:s,s:L,s:i}", "kind", "Delta", "origin",
+                 (long long)data[0], "srcType", delta_type))) goto error;
+  if (best_rle && !append_bcif_encoding(encs, Py_BuildValue(
+                 "{s:s,s:i,s:n}", "kind", "RunLength", "srcType", rle_type,
+                 "srcSize", (Py_ssize_t)n))) goto error;
+  if (best_byte_count > 0) {
+    size_t npacked;
+    is_unsigned = true;
+    for (i = 0; i < nout; ++i) {
+      if (out[i] < 0) is_unsigned = false;
+    }
+    npacked = bcif_integer_packed_size(out, nout, best_byte_count,
+                                           is_unsigned);
+    if (!append_bcif_encoding(encs, Py_BuildValue(
+                 "{s:s,s:i,s:O,s:n}", "kind", "IntegerPacking",
+                 "byteCount", best_byte_count,
+                 "isUnsigned", is_unsigned ? Py_True : Py_False,
+                 "srcSize", (Py_ssize_t)nout))) goto error;
+    if (!(packed = (int64_t *)PyMem_Malloc(npacked * sizeof(int64_t)))) {
+      PyErr_NoMemory();
+      goto error;
+    }
+    bcif_integer_pack(out, nout, best_byte_count, is_unsigned, packed);
+    if (best_byte_count == 1) {
+      type = is_unsigned ? BCIF_UINT8 : BCIF_INT8;
+    } else {
+      type = is_unsigned ? BCIF_UINT16 : BCIF_INT16;
+    }
+    out = packed;
+    nout = npacked;
+  } else {
+    type = bcif_int_type(out, nout);
+  }
+
+  bytes = PyBytes_FromStringAndSize(NULL, nout * bcif_type_size(type));
+  if (!bytes) goto error;
+  bcif_pack_ints(out, nout, type, PyBytes_AS_STRING(bytes));
+  if (!append_bcif_encoding(encs, Py_BuildValue(
+               "{s:s,s:i}", "kind", "ByteArray", "type", type))) {
+    Py_DECREF(bytes);
+    goto error;
+  }
+  PyMem_Free(work);
+  PyMem_Free(rlebuf);
+  PyMem_Free(packed);
+  return Py_BuildValue("(NN)", bytes, encs);
+
+error:
+  PyMem_Free(work);
+  PyMem_Free(rlebuf);
+  PyMem_Free(packed);
+  Py_XDECREF(encs);
+  return NULL;
+}
+
+/* Encode integers using Delta, RunLength and ByteArray encodings, exactly
+   as the Python encoders in ihm.format_bcif do (or, if `optimize` is true,
+   using encode_bcif_ints_smallest). `data` is modified.
+   Return an (encoded bytes, [encoding dicts]) tuple, or NULL on error.
+   If the data cannot be represented in BinaryCIF, return NULL with no
+   Python exception set. */
+static PyObject *encode_bcif_ints(int64_t *data, size_t n, bool optimize)
+{
+  int type;
+  int64_t *rle = NULL;
+  PyObject *bytes, *encs;
+  if (optimize) {
+    return encode_bcif_ints_smallest(data, n);
+  }
+  if (!(encs = PyList_New(0))) return NULL;
+
+  /* Don't try to compress small arrays; the overhead of the compression
+     probably will exceed the space savings */
+  if (n > 40) {
+    int64_t origin = data[0];
+    size_t nrle;
+    if ((type = bcif_int_type(data, n)) < 0) goto error;
+    bcif_delta_encode(data, n);
+    if (!append_bcif_encoding(encs, Py_BuildValue(
+                 "{s:s,s:L,s:i}", "kind", "Delta", "origin",
+                 (long long)origin, "srcType", type))) goto error;
+
+    if ((type = bcif_int_type(data, n)) < 0) goto error;
+    rle = (int64_t *)PyMem_Malloc(2 * n * sizeof(int64_t));
+    if (!rle) {
+      PyErr_NoMemory();
+      goto error;
+    }
+    nrle = bcif_run_length_encode(data, n, rle);
+    /* Only use the run length encoding if it saved space */
+    if (nrle <= n) {
+      if (!append_bcif_encoding(encs, Py_BuildValue(
+                   "{s:s,s:i,s:n}", "kind", "RunLength", "srcType", type,
+                   "srcSize", (Py_ssize_t)n))) goto error;
+      data = rle;
+      n = nrle;
+    }
+  }
+
+  if ((type = bcif_int_type(data, n)) < 0) goto error;
+  bytes = PyBytes_FromStringAndSize(NULL, n * bcif_type_size(type));
+  if (!bytes) goto error;
+  bcif_pack_ints(data, n, type, PyBytes_AS_STRING(bytes));
+  if (!append_bcif_encoding(encs, Py_BuildValue(
+               "{s:s,s:i}", "kind", "ByteArray", "type", type))) {
+    Py_DECREF(bytes);
+    goto error;
+  }
+  PyMem_Free(rle);
+  return Py_BuildValue("(NN)", bytes, encs);
+
+error:
+  PyMem_Free(rle);
+  Py_DECREF(encs);
+  return NULL;
+}
+
+/* Encode floating point values as for encode_bcif_ints. If `optimize` is
+   true, use FixedPoint encoding instead of a ByteArray if possible and it
+   gives smaller output, as _encode_floats_smallest in Python does. */
+static PyObject *encode_bcif_floats(double *data, size_t n, bool optimize)
+{
+  PyObject *encs, *bytes;
+  int32_t factor;
+  int64_t *ints;
+
+  if (optimize) {
+    if (!(ints = (int64_t *)PyMem_Malloc(n * sizeof(int64_t)))) {
+      return PyErr_NoMemory();
+    }
+    if (bcif_fixed_point(data, n, BCIF_MAX_FIXED_POINT_DIGITS,
+                             &factor, ints)) {
+      PyObject *fixed = encode_bcif_ints_smallest(ints, n);
+      PyMem_Free(ints);
+      if (!fixed) return NULL;
+      if (PyBytes_GET_SIZE(PyTuple_GET_ITEM(fixed, 0))
+          + BCIF_ENCODING_COST * PyList_GET_SIZE(PyTuple_GET_ITEM(fixed, 1))
+          < (Py_ssize_t)(n * 4)) {
+        PyObject *fp = Py_BuildValue("{s:s,s:i,s:i}", "kind", "FixedPoint",
+                                     "factor", factor,
+                                     "srcType", BCIF_FLOAT32);
+        if (!fp || PyList_Insert(PyTuple_GET_ITEM(fixed, 1), 0, fp) < 0) {
+          Py_XDECREF(fp);
+          Py_DECREF(fixed);
+          return NULL;
+        }
+        Py_DECREF(fp);
+        return fixed;
+      }
+      Py_DECREF(fixed);
+    } else {
+      PyMem_Free(ints);
+    }
+  }
+
+  if (!(bytes = PyBytes_FromStringAndSize(NULL, n * 4))) return NULL;
+  if (!bcif_pack_floats(data, n, PyBytes_AS_STRING(bytes))) {
+    Py_DECREF(bytes);
+    return NULL;
+  }
+  encs = Py_BuildValue("[{s:s,s:i}]", "kind", "ByteArray",
+                       "type", BCIF_FLOAT32);
+  if (!encs) {
+    Py_DECREF(bytes);
+    return NULL;
+  }
+  return Py_BuildValue("(NN)", bytes, encs);
+}
+
+/* Encode values as strings using StringArray encoding, as for
+   encode_bcif_ints. Masked values (mask[i] != 0) are not encoded. */
+static PyObject *encode_bcif_strings(PyObject **items, size_t n,
+                                     const uint8_t *mask, bool optimize)
+{
+  size_t i;
+  int64_t *indices, *offsets = NULL;
+  PyObject *seen, *substrs, *string_data = NULL, *empty = NULL;
+  PyObject *enc_indices = NULL, *enc_offsets = NULL, *ret = NULL;
+
+  indices = (int64_t *)PyMem_Malloc(n * sizeof(int64_t));
+  seen = PyDict_New();
+  substrs = PyList_New(0);
+  if (!indices || !seen || !substrs) {
+    if (!indices) PyErr_NoMemory();
+    goto done;
+  }
+  for (i = 0; i < n; ++i) {
+    PyObject *s, *index;
+    if (mask && mask[i]) {
+      indices[i] = -1;
+      continue;
+    }
+    /* Map bool to YES/NO strings, and coerce any non-str data to str */
+    if (PyBool_Check(items[i])) {
+      s = PyUnicode_FromString(items[i] == Py_True ? "YES" : "NO");
+    } else if (PyUnicode_CheckExact(items[i])) {
+      s = items[i];
+      Py_INCREF(s);
+    } else {
+      s = PyObject_Str(items[i]);
+    }
+    if (!s) goto done;
+    index = PyDict_GetItemWithError(seen, s);
+    if (index) {
+      indices[i] = PyLong_AsLongLong(index);
+    } else if (PyErr_Occurred()) {
+      Py_DECREF(s);
+      goto done;
+    } else {
+      indices[i] = PyList_GET_SIZE(substrs);
+      index = PyLong_FromLongLong(indices[i]);
+      if (!index || PyDict_SetItem(seen, s, index) < 0
+          || PyList_Append(substrs, s) < 0) {
+        Py_XDECREF(index);
+        Py_DECREF(s);
+        goto done;
+      }
+      Py_DECREF(index);
+    }
+    Py_DECREF(s);
+  }
+
+  /* Offsets are in characters, not bytes */
+  offsets = (int64_t *)PyMem_Malloc((PyList_GET_SIZE(substrs) + 1)
+                                    * sizeof(int64_t));
+  if (!offsets) {
+    PyErr_NoMemory();
+    goto done;
+  }
+  offsets[0] = 0;
+  for (i = 0; i < (size_t)PyList_GET_SIZE(substrs); ++i) {
+    offsets[i + 1] = offsets[i]
+                     + PyUnicode_GET_LENGTH(PyList_GET_ITEM(substrs, i));
+  }
+  if (!(empty = PyUnicode_FromString(""))
+      || !(string_data = PyUnicode_Join(empty, substrs))
+      || !(enc_offsets = encode_bcif_ints(offsets,
+                                          PyList_GET_SIZE(substrs) + 1,
+                                          optimize))
+      || !(enc_indices = encode_bcif_ints(indices, n, optimize))) {
+    goto done;
+  }
+  ret = Py_BuildValue("(O[{s:s,s:O,s:O,s:O,s:O}])",
+                      PyTuple_GET_ITEM(enc_indices, 0),
+                      "kind", "StringArray",
+                      "dataEncoding", PyTuple_GET_ITEM(enc_indices, 1),
+                      "stringData", string_data,
+                      "offsetEncoding", PyTuple_GET_ITEM(enc_offsets, 1),
+                      "offsets", PyTuple_GET_ITEM(enc_offsets, 0));
+
+done:
+  PyMem_Free(indices);
+  PyMem_Free(offsets);
+  Py_XDECREF(seen);
+  Py_XDECREF(substrs);
+  Py_XDECREF(empty);
+  Py_XDECREF(string_data);
+  Py_XDECREF(enc_indices);
+  Py_XDECREF(enc_offsets);
+  return ret;
+}
+
+/* Encode values as integers or floats (is_float=true), as for
+   encode_bcif_ints. Masked values are replaced with -1 (integers)
+   or 0. (floats). */
+static PyObject *encode_bcif_numbers(PyObject **items, size_t n,
+                                     const uint8_t *mask, bool is_float,
+                                     bool optimize)
+{
+  size_t i;
+  PyObject *ret = NULL;
+  int64_t *ivals = NULL;
+  double *fvals = NULL;
+  if (is_float) {
+    fvals = (double *)PyMem_Malloc(n * sizeof(double));
+  } else {
+    ivals = (int64_t *)PyMem_Malloc(n * sizeof(int64_t));
+  }
+  if (!fvals && !ivals) {
+    return PyErr_NoMemory();
+  }
+  for (i = 0; i < n; ++i) {
+    if (is_float) {
+      fvals[i] = (mask && mask[i]) ? 0. : PyFloat_AsDouble(items[i]);
+    } else {
+      ivals[i] = (mask && mask[i]) ? -1 : PyLong_AsLongLong(items[i]);
+    }
+    if (PyErr_Occurred()) {
+      /* Value out of range; let the Python encoder report the error */
+      PyErr_Clear();
+      goto done;
+    }
+  }
+  ret = is_float ? encode_bcif_floats(fvals, n, optimize)
+                 : encode_bcif_ints(ivals, n, optimize);
+done:
+  PyMem_Free(ivals);
+  PyMem_Free(fvals);
+  return ret;
+}
+%}
+
+%inline %{
+/* Encode a column of data for BinaryCIF. This does the same thing as
+   BinaryCifWriter._encode_data in Python, returning the same
+   (mask, encoded data, encodings) tuple, but is much faster. If the data
+   cannot be handled here (it contains types other than None, `unknown`,
+   str, int, float or bool, or values out of range), None is returned
+   and the caller should fall back to the Python encoders. If `optimize`
+   is true, choose the encodings that give the smallest output (see
+   BinaryCifWriter). */
+PyObject *bcif_encode_data(PyObject *data, PyObject *unknown, bool optimize)
+{
+  size_t i, n;
+  PyObject **items, *seq, *mask_obj = NULL, *encoded = NULL;
+  uint8_t *mask = NULL;
+  bool seen_str = false, seen_float = false, seen_int = false;
+
+  if (!(seq = PySequence_Fast(data, "data should be a sequence"))) {
+    return NULL;
+  }
+  n = PySequence_Fast_GET_SIZE(seq);
+  items = PySequence_Fast_ITEMS(seq);
+  /* Categories with no data are never written */
+  if (n == 0) goto fallback;
+
+  /* Detect missing/omitted values and determine the type of the rest;
+     a mix of types is coerced to the one of highest precedence
+     (see _get_mask_and_type) */
+  for (i = 0; i < n; ++i) {
+    PyObject *val = items[i];
+    if (val == Py_None || val == unknown) {
+      if (!mask) {
+        if (!(mask = (uint8_t *)PyMem_Calloc(n, sizeof(uint8_t)))) {
+          PyErr_NoMemory();
+          goto done;
+        }
+      }
+      mask[i] = (val == Py_None) ? 1 : 2;
+    } else if (PyUnicode_CheckExact(val) || PyBool_Check(val)) {
+      seen_str = true;
+    } else if (PyFloat_CheckExact(val)) {
+      seen_float = true;
+    } else if (PyLong_CheckExact(val)) {
+      seen_int = true;
+    } else {
+      goto fallback;
+    }
+  }
+
+  if (seen_str || (!seen_float && !seen_int)) {
+    encoded = encode_bcif_strings(items, n, mask, optimize);
+  } else {
+    encoded = encode_bcif_numbers(items, n, mask, seen_float, optimize);
+  }
+  if (!encoded) {
+    if (PyErr_Occurred()) goto done;
+    goto fallback;
+  }
+
+  if (mask) {
+    int64_t *mask_data = (int64_t *)PyMem_Malloc(n * sizeof(int64_t));
+    PyObject *enc_mask;
+    if (!mask_data) {
+      PyErr_NoMemory();
+      goto done;
+    }
+    for (i = 0; i < n; ++i) {
+      mask_data[i] = mask[i];
+    }
+    enc_mask = encode_bcif_ints(mask_data, n, optimize);
+    PyMem_Free(mask_data);
+    if (!enc_mask) goto done;
+    mask_obj = Py_BuildValue("{s:O,s:O}", "data", PyTuple_GET_ITEM(enc_mask, 0),
+                             "encoding", PyTuple_GET_ITEM(enc_mask, 1));
+    Py_DECREF(enc_mask);
+    if (!mask_obj) goto done;
+  } else {
+    mask_obj = Py_None;
+    Py_INCREF(mask_obj);
+  }
+  Py_DECREF(seq);
+  PyMem_Free(mask);
+  /* Steal our reference to mask_obj */
+  data = Py_BuildValue("(NOO)", mask_obj, PyTuple_GET_ITEM(encoded, 0),
+                       PyTuple_GET_ITEM(encoded, 1));
+  Py_DECREF(encoded);
+  return data;
+
+fallback:
+  Py_DECREF(seq);
+  Py_XDECREF(encoded);
+  PyMem_Free(mask);
+  Py_INCREF(Py_None);
+  return Py_None;
+
+done:
+  Py_DECREF(seq);
+  Py_XDECREF(encoded);
+  Py_XDECREF(mask_obj);
+  PyMem_Free(mask);
+  return NULL;
+}
+%}
+
+%{
+/* A simple growable buffer used to build mmCIF text */
+struct cif_text {
+  char *buf;
+  size_t len, alloc;
+};
+
+static bool cif_text_append(struct cif_text *t, const char *str, size_t len)
+{
+  if (t->len + len > t->alloc) {
+    size_t alloc = (t->len + len) * 2;
+    char *buf = (char *)PyMem_Realloc(t->buf, alloc);
+    if (!buf) {
+      PyErr_NoMemory();
+      return false;
+    }
+    t->buf = buf;
+    t->alloc = alloc;
+  }
+  memcpy(t->buf + t->len, str, len);
+  t->len += len;
+  return true;
+}
+
+/* Return true iff the given string can be written to mmCIF without
+   quoting; this matches the checks in CifWriter._repr */
+static bool cif_string_is_bare(const char *str, size_t len)
+{
+  static const char *reserved[] = {"data_", "save_", "loop_", "stop_",
+                                   "global_", "_", "[", NULL};
+  const char **r;
+  if (len == 0 || (len == 1 && (str[0] == '?' || str[0] == '.'))
+      || memchr(str, '"', len) || memchr(str, '\'', len)
+      || memchr(str, ' ', len)) {
+    return false;
+  }
+  for (r = reserved; *r; ++r) {
+    size_t rlen = strlen(*r);
+    if (len >= rlen && strncmp(str, *r, rlen) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Get the UTF-8 representation of a Python string, and its length
+   in characters */
+static const char *cif_utf8(PyObject *str, Py_ssize_t *len,
+                            Py_ssize_t *nchar)
+{
+  *nchar = PyUnicode_GET_LENGTH(str);
+  return PyUnicode_AsUTF8AndSize(str, len);
+}
+
+/* Format a single value as CifWriter._repr does and add it to the text,
+   wrapping lines as _LineWriter does. Return false on error. */
+static bool cif_format_value(struct cif_text *t, PyObject *val,
+                             size_t line_len, size_t *column)
+{
+  char numbuf[32];
+  const char *str;
+  char *dstr = NULL;
+  Py_ssize_t len, nchar;
+  PyObject *tmp = NULL;
+  bool ok;
+
+  if (val == Py_None) {
+    str = ".";
+    len = nchar = 1;
+  } else if (PyUnicode_Check(val)) {
+    if (!(str = cif_utf8(val, &len, &nchar))) return false;
+    if (memchr(str, '\n', len)) {
+      /* Multiline strings are written as a semicolon-delimited block */
+      ok = cif_text_append(t, "\n;", 2) && cif_text_append(t, str, len)
+           && (str[len - 1] == '\n' || cif_text_append(t, "\n", 1))
+           && cif_text_append(t, ";\n", 2);
+      *column = 0;
+      return ok;
+    } else if (!cif_string_is_bare(str, len)) {
+      if (!(tmp = PyObject_Repr(val))
+          || !(str = cif_utf8(tmp, &len, &nchar))) {
+        Py_XDECREF(tmp);
+        return false;
+      }
+    }
+  } else if (PyFloat_Check(val)) {
+    double d = PyFloat_AsDouble(val);
+    if (d == -1. && PyErr_Occurred()) return false;
+    if (fabs(d) < 1e-3) {
+      dstr = PyOS_double_to_string(d, 'g', 3, 0, NULL);
+    } else {
+      dstr = PyOS_double_to_string(d, 'f', 3, 0, NULL);
+    }
+    if (!dstr) return false;
+    str = dstr;
+    len = nchar = strlen(dstr);
+  } else if (PyBool_Check(val)) {
+    str = (val == Py_True) ? "YES" : "NO";
+    len = nchar = strlen(str);
+  } else {
+    int overflow = 0;
+    long long ival = 0;
+    if (PyLong_CheckExact(val)) {
+      ival = PyLong_AsLongLongAndOverflow(val, &overflow);
+      if (ival == -1 && PyErr_Occurred()) return false;
+    }
+    if (PyLong_CheckExact(val) && !overflow) {
+      len = nchar = ihm_itoa(numbuf, ival);
+      str = numbuf;
+    } else if (!(tmp = PyObject_Str(val))
+               || !(str = cif_utf8(tmp, &len, &nchar))) {
+      Py_XDECREF(tmp);
+      return false;
+    }
+  }
+
+  ok = true;
+  if (*column > 0) {
+    if (line_len && *column + nchar + 1 > line_len) {
+      ok = cif_text_append(t, "\n", 1);
+      *column = 0;
+    } else {
+      ok = cif_text_append(t, " ", 1);
+      (*column)++;
+    }
+  }
+  ok = ok && cif_text_append(t, str, len);
+  *column += nchar;
+  Py_XDECREF(tmp);
+  PyMem_Free(dstr);
+  return ok;
+}
+%}
+
+%inline %{
+/* Format a single row of an mmCIF loop, given a sequence of values.
+   This does the same thing as writing each value with _LineWriter using
+   the default CifWriter._repr (wrapping lines at line_len characters,
+   or not at all if line_len is 0), but is much faster. The formatted row,
+   terminated with a newline, is returned as a string. */
+PyObject *cif_format_row(PyObject *values, size_t line_len)
+{
+  Py_ssize_t i, n;
+  size_t column = 0;
+  PyObject *seq, *ret = NULL;
+  struct cif_text t = {NULL, 0, 0};
+
+  if (!(seq = PySequence_Fast(values, "values should be a sequence"))) {
+    return NULL;
+  }
+  n = PySequence_Fast_GET_SIZE(seq);
+  for (i = 0; i < n; ++i) {
+    if (!cif_format_value(&t, PySequence_Fast_GET_ITEM(seq, i), line_len,
+                          &column)) {
+      goto done;
+    }
+  }
+  if (cif_text_append(&t, "\n", 1)) {
+    ret = PyUnicode_DecodeUTF8(t.buf, t.len, NULL);
+  }
+done:
+  Py_DECREF(seq);
+  PyMem_Free(t.buf);
+  return ret;
+}
+
+/* Format rows start through end-1 of an mmCIF loop, given a list of
+   columns. Each column is either a list (or tuple) of values, or None if
+   all values are omitted. Values are formatted as for cif_format_row.
+   The formatted rows are returned as a single string. */
+PyObject *cif_format_columns(PyObject *columns, size_t start, size_t end,
+                             size_t line_len)
+{
+  Py_ssize_t i, ncol;
+  size_t irow;
+  PyObject *seq, *ret = NULL;
+  struct cif_text t = {NULL, 0, 0};
+
+  if (!(seq = PySequence_Fast(columns, "columns should be a sequence"))) {
+    return NULL;
+  }
+  ncol = PySequence_Fast_GET_SIZE(seq);
+  for (i = 0; i < ncol; ++i) {
+    PyObject *col = PySequence_Fast_GET_ITEM(seq, i);
+    if (col != Py_None && ((!PyList_Check(col) && !PyTuple_Check(col))
+                           || (size_t)PySequence_Fast_GET_SIZE(col) < end)) {
+      PyErr_SetString(PyExc_ValueError,
+                      "each column should be a list of at least end values");
+      goto done;
+    }
+  }
+  for (irow = start; irow < end; ++irow) {
+    size_t column = 0;
+    for (i = 0; i < ncol; ++i) {
+      PyObject *col = PySequence_Fast_GET_ITEM(seq, i);
+      PyObject *val = col == Py_None ? Py_None
+                      : PySequence_Fast_GET_ITEM(col, irow);
+      if (!cif_format_value(&t, val, line_len, &column)) {
+        goto done;
+      }
+    }
+    if (!cif_text_append(&t, "\n", 1)) goto done;
+  }
+  ret = PyUnicode_DecodeUTF8(t.buf ? t.buf : "", t.len, NULL);
+done:
+  Py_DECREF(seq);
+  PyMem_Free(t.buf);
+  return ret;
+}
 %}
 
 %include "ihm_format.h"
@@ -43,6 +43,11 @@ def _get_dumper_bcif_output(dumper, system):
     return fh.data
 
 
+class UnseekableStringIO(StringIO):
+    def tell(self):
+        raise OSError("not seekable")
+
+
 class Tests(unittest.TestCase):
     def test_write(self):
         """Test write() function"""
@@ -5630,6 +5635,94 @@ _flr_relaxation_time_analysis.details
                                               'AUDIT_CONFORM']))
         self.assertNotIn('_ihm_struct_assembly', fh.getvalue())
 
+    def test_write_progress(self):
+        """Test write() function with progress reports"""
+        sys1 = ihm.System(id='system1')
+        sys1.entities.append(ihm.Entity('AHC'))
+        sys2 = ihm.System(id='system2')
+        calls = []
+        fh = StringIO()
+        ihm.dumper.write(fh, [sys1, sys2],
+                         progress=lambda *args: calls.append(args))
+        ndumpers = len(ihm.dumper.IHMVariant().get_dumpers())
+        self.assertEqual(len(calls), ndumpers * 2 + 1)
+        # Last call should be once the file is complete
+        nbytes, total, rows, category = calls[-1]
+        self.assertEqual(nbytes, len(fh.getvalue()))
+        self.assertIsNone(total)
+        self.assertGreater(rows, 3)
+        self.assertIsInstance(category, str)
+        # First call is after _entry is written
+        self.assertEqual(calls[0][2:], (1, '_entry'))
+        # Counts should never go down
+        for prev, cur in zip(calls, calls[1:]):
+            self.assertGreaterEqual(cur[0], prev[0])
+            self.assertGreaterEqual(cur[2], prev[2])
+        # Unseekable files should report unknown size
+        calls = []
+        ihm.dumper.write(UnseekableStringIO(), [sys1],
+                         progress=lambda *args: calls.append(args))
+        self.assertIsNone(calls[-1][0])
+
+    def test_write_progress_interval(self):
+        """Test write() reports progress within a single Dumper"""
+        class BigDumper(ihm.dumper.Dumper):
+            def dump(self, system, writer):
+                with writer.loop('_foo', ['x', 'y']) as lp:
+                    for i in range(5000):
+                        lp.write(x=i, y='some longer text value')
+                with writer.loop('_bar', ['x']) as lp:
+                    lp.write_columns(x=list(range(5000)))
+
+        def get_calls(fh, **keys):
+            calls = []
+            ihm.dumper.write(fh, [ihm.System(id='system1')],
+                             dumpers=[BigDumper],
+                             progress=lambda *args: calls.append(args),
+                             **keys)
+            return calls
+
+        ndumpers = len(ihm.dumper.IHMVariant().get_dumpers()) + 1
+        # No extra calls with the default (large) interval
+        self.assertEqual(len(get_calls(StringIO())), ndumpers + 1)
+        # Periodic calls while BigDumper is writing
+        calls = get_calls(StringIO(), progress_interval=4096)
+        self.assertGreater(len(calls), ndumpers + 10)
+        foo_calls = [c for c in calls if c[3] == '_foo'
+                     and c[2] < 5000]
+        self.assertGreater(len(foo_calls), 5)
+        for prev, cur in zip(calls, calls[1:]):
+            self.assertGreaterEqual(cur[0], prev[0])
+            self.assertGreaterEqual(cur[2], prev[2])
+        # Unseekable files should fall back to reporting by row count
+        calls = get_calls(UnseekableStringIO(), progress_interval=64 * 500)
+        foo_calls = [c for c in calls if c[3] == '_foo']
+        self.assertGreaterEqual(len(foo_calls), 9)
+        self.assertIsNone(foo_calls[0][0])
+
+    def test_progress_writer(self):
+        """Test _ProgressWriter utility class"""
+        class BaseWriter:
+            def flush(self):
+                return 'flush called'
+
+            def write_comment(self, comment):
+                return 'write comment ' + comment
+
+            def loop(self, category, keys):
+                return ihm.dumper._NullLoopCategoryWriter()
+
+        s = ihm.dumper._ProgressWriter(BaseWriter())
+        self.assertEqual(s.flush(), 'flush called')
+        self.assertEqual(s.write_comment('foo'), 'write comment foo')
+        with s.loop('_foo', ['a', 'b']) as lp:
+            lp.write(a=1)
+            lp.write_columns(a=None, b=[1, 2, 3])
+            # Rows given as an iterator can't be counted
+            lp.write_columns(a=iter([1, 2]))
+        self.assertEqual(s.rows, 4)
+        self.assertEqual(s.current_category, '_foo')
+
     def test_dumper_unwrapped(self):
         """Test dumper output with line wrapping disabled"""
         system = ihm.System()
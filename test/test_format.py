@@ -2,6 +2,9 @@ import utils
 import os
 import unittest
 import sys
+import array
+import math
+import threading
 try:
     import numpy
 except ImportError:
@@ -52,6 +55,16 @@ class _TestFinalizeHandler(GenericHandler):
         _add_c_handler = _format._test_finalize_callback
 
 
+class _TestColumnarHandler(GenericHandler):
+    if _format is not None:
+        _add_c_handler = _format.add_columnar_category_handler
+
+    def _add_columns(self, *columns):
+        self.data.append('COLUMNS')
+        for row in zip(*columns):
+            self(*row)
+
+
 class StringWriter:
     def __init__(self):
         self.fh = StringIO()
@@ -180,6 +193,81 @@ x
 #
 """)
 
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_format_row_c(self):
+        """Test C formatting of loop rows matches _LineWriter"""
+        vals = [None, ihm.unknown, True, False, 0, -5, 2 ** 70, 1.0, -0.0,
+                1e-5, -3.14159, float('nan'), '', 'a', 'a b', "it's",
+                '_x', 'global_x', '[x', 'data_a', '?', '.', 'x\ny', 'x\n',
+                'h\u00e9llo', '\u00fc' * 40, 'x' * 100]
+        for line_len in (0, 15, 80):
+            writer = StringWriter()
+            writer._repr = ihm.format.CifWriter(None)._repr
+            lw = ihm.format._LineWriter(writer, line_len=line_len)
+            for v in vals:
+                lw.write(v)
+            self.assertEqual(_format.cif_format_row(vals, line_len),
+                             writer.getvalue() + '\n')
+
+    def test_loop_custom_repr(self):
+        """Test LoopWriter class with a writer that overrides _repr"""
+        class MyWriter(ihm.format.CifWriter):
+            def _repr(self, obj):
+                return 'X'
+        fh = StringIO()
+        writer = MyWriter(fh)
+        with writer.loop('foo', ["bar", "baz"]) as loc:
+            loc.write(bar='x', baz=1)
+        self.assertEqual(fh.getvalue(), "#\nloop_\nfoo.bar\nfoo.baz\nX X\n#\n")
+
+        # _repr can also be overridden on the writer object itself
+        fh = StringIO()
+        writer = ihm.format.CifWriter(fh)
+        writer._repr = lambda obj: 'Y'
+        with writer.loop('foo', ["bar", "baz"]) as loc:
+            loc.write(bar='x', baz=1)
+            loc.write_columns(bar=['x'], baz=[2])
+        self.assertEqual(fh.getvalue(),
+                         "#\nloop_\nfoo.bar\nfoo.baz\nY Y\nY Y\n#\n")
+
+    def test_loop_write_columns(self):
+        """Test LoopWriter.write_columns()"""
+        class ReprWriter(ihm.format.CifWriter):
+            # Force use of the Python implementation
+            def _repr(self, obj):
+                return super()._repr(obj)
+        for cls in ihm.format.CifWriter, ReprWriter:
+            fh = StringIO()
+            writer = cls(fh)
+            with writer.loop('foo', ["bar", "baz", "qux"]) as loc:
+                loc.write_columns(bar=['x', None, ihm.unknown, 'a b'],
+                                  baz=array.array('d', [1., 2., 3., 4.]),
+                                  other=[1, 2])
+                loc.write_columns(bar=[])
+                loc.write(bar='y')
+                self.assertRaises(ValueError, loc.write_columns,
+                                  bar=[1, 2], baz=[1])
+            self.assertEqual(fh.getvalue(), """#
+loop_
+foo.bar
+foo.baz
+foo.qux
+x 1.000 .
+. 2.000 .
+? 3.000 .
+'a b' 4.000 .
+y . .
+#
+""")
+
+    def test_loop_write_columns_empty(self):
+        """Test LoopWriter.write_columns() with no data"""
+        fh = StringIO()
+        writer = ihm.format.CifWriter(fh)
+        with writer.loop('foo', ["bar", "baz"]) as loc:
+            loc.write_columns(bar=[], baz=())
+        self.assertEqual(fh.getvalue(), "")
+
     def test_write_comment(self):
         """Test CifWriter.write_comment()"""
         fh = StringIO()
@@ -750,6 +838,376 @@ x y
 #
 """, real_file, {'_foo': h})
 
+    def _feed_cif(self, cif, chunk_size, handlers, unknown=None):
+        """Read cif by feeding chunks of the given size to a push reader"""
+        r = ihm.format.CifReader(None, handlers, unknown)
+        for i in range(0, len(cif), chunk_size):
+            done = r.feed(cif[i:i + chunk_size])
+            while done:
+                # Read any remaining data, which belongs to the next block
+                for h in handlers.values():
+                    h.data.append('BLOCK')
+                done = r.feed(cif[:0])
+        while r.finish():
+            for h in handlers.values():
+                h.data.append('BLOCK')
+
+    def test_feed(self):
+        """Test pushing data to the reader in small pieces"""
+        cif = """data_first
+_exptl.method 'foo bar'
+_exptl.var1
+;line1
+line2
+;
+loop_
+_foo.bar
+_foo.baz
+_foo.var1
+x y z
+'a b' ? .
+u
+;multi
+line
+;
+.
+_unk.cat foo
+data_second
+save_frame
+_exptl.method baz
+save_
+loop_
+_foo.var2
+_foo.var3
+"q" "r"
+data_third
+"""
+
+        def read_all(read_func):
+            handlers = {'_exptl': GenericHandler(), '_foo': GenericHandler()}
+            unknown = []
+            read_func(handlers, lambda cat, line: unknown.append((cat, line)))
+            return ({k: h.data for k, h in handlers.items()}, unknown)
+
+        def read_file(handlers, unknown):
+            r = ihm.format.CifReader(StringIO(cif), handlers, unknown)
+            while r.read_file():
+                for h in handlers.values():
+                    h.data.append('BLOCK')
+        expected = read_all(read_file)
+        self.assertEqual(expected[0]['_foo'][1],
+                         {'bar': 'a b', 'baz': ihm.unknown})
+        self.assertEqual(expected[1], [('_unk', 18)])
+        for data in cif, cif.encode('ascii'):
+            for chunk_size in range(1, 8):
+                got = read_all(lambda h, u: self._feed_cif(data, chunk_size,
+                                                           h, u))
+                self.assertEqual(got, expected)
+
+    def test_feed_errors(self):
+        """Test errors from pushing data to the reader"""
+        h = GenericHandler()
+        r = ihm.format.CifReader(StringIO(""), {'_foo': h})
+        self.assertRaises(ValueError, r.feed, "_foo.bar x\n")
+        self.assertRaises(ValueError, r.finish)
+
+        r = ihm.format.CifReader(None, {'_foo': h})
+        self.assertRaises(ValueError, r.read_file)
+        r.feed("_foo.bar x\n")
+        self.assertFalse(r.finish())
+        self.assertEqual(h.data, [{'bar': 'x'}])
+        self.assertRaises(ValueError, r.feed, "_foo.bar x\n")
+
+        # Errors should be reported at the correct line
+        h = GenericHandler()
+        r = ihm.format.CifReader(None, {'_foo': h})
+        with self.assertRaises(ihm.format.CifParserError) as cm:
+            for c in "_foo.bar x\n\nloop_\n_foo.bar\n_foo.baz\nx y z\n":
+                r.feed(c)
+            r.finish()
+        self.assertIn('Wrong number of data values in loop', str(cm.exception))
+        with self.assertRaises(ihm.format.CifParserError) as cm:
+            self._feed_cif("_foo.bar\n;abc\n", 1, {'_foo': h})
+        self.assertIn('multiline string which started on line 2',
+                      str(cm.exception))
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_feed_line_endings(self):
+        """Test pushing data with line endings split between pieces"""
+        cif = ("_struct_keywords.pdbx_keywords\r\n"
+               ";COMPLEX \r\n(HYDROLASE/PEPTIDE)\r\n;\r\n"
+               "loop_\r\n_foo.bar\r\n_foo.baz\r\nx\r\ny\r\n")
+        for chunk_size in range(1, 5):
+            h1, h2 = GenericHandler(), GenericHandler()
+            self._feed_cif(cif, chunk_size, {'_struct_keywords': h1,
+                                             '_foo': h2})
+            self.assertEqual(
+                h1.data, [{'pdbx_keywords': 'COMPLEX \n(HYDROLASE/PEPTIDE)'}])
+            self.assertEqual(h2.data, [{'bar': 'x', 'baz': 'y'}])
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_get_stats(self):
+        """Test reader statistics"""
+        cif = ("data_foo\n_exptl.method 'foo bar'\n_unk.cat x\n"
+               "loop_\n_foo.bar\n_foo.baz\nx y\n1 2\n;multi\n;\n3\n")
+        handlers = {'_exptl': GenericHandler(), '_foo': GenericHandler()}
+        r = ihm.format.CifReader(StringIO(cif), handlers,
+                                 lambda cat, line: None)
+        st = r.get_stats()
+        self.assertEqual(st.bytes_read, 0)
+        self.assertEqual(st.categories, {})
+        r.set_timing()
+        self.assertFalse(r.read_file())
+        st = r.get_stats()
+        self.assertEqual(st.bytes_read, len(cif))
+        self.assertGreaterEqual(st.lines, 11)
+        self.assertEqual(st.tokens, 14)
+        self.assertGreaterEqual(st.buffer_max, len(cif))
+        self.assertGreater(st.buffer_grows, 0)
+        self.assertEqual(sorted(st.categories.keys()), ['_exptl', '_foo'])
+        self.assertEqual(st.categories['_exptl'][0], 1)
+        self.assertEqual(st.categories['_foo'][0], 3)
+        self.assertGreater(st.total_time, 0.)
+        self.assertGreaterEqual(st.callback_time,
+                                sum(c[1] for c in st.categories.values()))
+        self.assertAlmostEqual(st.total_time,
+                               st.io_time + st.parse_time + st.callback_time,
+                               delta=1e-6)
+        self.assertIn('ReaderStats', repr(st))
+
+        # Push readers should also collect statistics; timing is off
+        # by default
+        r = ihm.format.CifReader(None, handlers)
+        r.feed(cif)
+        r.finish()
+        st = r.get_stats()
+        self.assertEqual(st.bytes_read, len(cif))
+        self.assertEqual(st.categories['_foo'][0], 3)
+        self.assertEqual(st.total_time, 0.)
+        self.assertEqual(st.categories['_foo'][1], 0.)
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_progress(self):
+        """Test progress reports"""
+        # Add a large unhandled category so that the file is read in
+        # more than one chunk
+        cif = ("loop_\n_foo.bar\n_foo.baz\n" + "x y\n" * 500
+               + "loop_\n_unk.bar\n" + "abcdefghijklmno\n" * 200000)
+        calls = []
+        h = GenericHandler()
+        with utils.temporary_directory() as tmpdir:
+            fname = os.path.join(tmpdir, 'test.cif')
+            with open(fname, 'w') as fh:
+                fh.write(cif)
+            with open(fname) as fh:
+                r = ihm.format.CifReader(fh, {'_foo': h})
+                r.set_progress_handler(
+                    lambda *args: calls.append(args), interval=0)
+                r.read_file()
+        self.assertEqual(len(h.data), 500)
+        self.assertGreater(len(calls), 1)
+        for nbytes, total, rows, category in calls:
+            self.assertGreater(nbytes, 0)
+            self.assertEqual(total, len(cif))
+        self.assertEqual(calls[-1][0], len(cif))
+        self.assertEqual(calls[0][2:], (0, None))
+        self.assertEqual(calls[-1][2:], (500, '_foo'))
+
+        # Large interval should give no reports
+        calls = []
+        r = ihm.format.CifReader(StringIO(cif), {'_foo': GenericHandler()})
+        r.set_progress_handler(lambda *args: calls.append(args),
+                               interval=len(cif) * 2)
+        r.read_file()
+        self.assertEqual(calls, [])
+
+        # Exceptions should abort the read
+        class _Abort(Exception):
+            pass
+
+        def abort(nbytes, total, rows, category):
+            raise _Abort()
+        for fh in (StringIO(cif), None):
+            r = ihm.format.CifReader(fh, {'_foo': GenericHandler()})
+            r.set_progress_handler(abort, interval=0)
+            if fh is None:
+                self.assertRaises(_Abort, r.feed, cif)
+            else:
+                self.assertRaises(_Abort, r.read_file)
+
+    def test_get_stats_python(self):
+        """Test reader statistics without the C extension"""
+        r = ihm.format.CifReader(StringIO(""), {})
+        if _format is None:
+            self.assertIsNone(r.get_stats())
+        # Turning on timing should be harmless
+        r.set_timing(True)
+        r.read_file()
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_read_threads(self):
+        """Test reading files in several threads at once"""
+        cif = "loop_\n_exptl.method\n_exptl.intkey1\n" + "".join(
+            "foo%d %d\n" % (i, i) for i in range(5000))
+        handlers = [GenericHandler(), GenericHandler(),
+                    _TestColumnarHandler(), _TestColumnarHandler()]
+
+        def read(h):
+            self._read_cif(cif, True, {'_exptl': h})
+        threads = [threading.Thread(target=read, args=(h,))
+                   for h in handlers]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        expected = [{'method': 'foo%d' % i, 'intkey1': i}
+                    for i in range(5000)]
+        for h in handlers:
+            self.assertEqual([d for d in h.data if d != 'COLUMNS'],
+                             expected)
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_read_nested(self):
+        """Test reading a file from within a handler for another file"""
+        class NestedHandler(GenericHandler):
+            def __call__(self, *args):
+                super(NestedHandler, self).__call__(*args)
+                self.inner = GenericHandler()
+                r = ihm.format.CifReader(StringIO("_exptl.method bar\n"),
+                                         {'_exptl': self.inner})
+                r.read_file()
+        h = NestedHandler()
+        self._read_cif("_exptl.method foo\n", True, {'_exptl': h})
+        self.assertEqual(h.data, [{'method': 'foo'}])
+        self.assertEqual(h.inner.data, [{'method': 'bar'}])
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_repeated_strings(self):
+        """Test that C parser reuses objects for repeated strings"""
+        long_val = 'x' * 40
+        cif = "loop_\n_exptl.method\n_exptl.var1\n" + "".join(
+            "foo %s\nfoo %s\nfoo v%d\n" % (long_val, long_val, i)
+            for i in range(300))
+        for real_file in (True, False):
+            h = GenericHandler()
+            self._read_cif(cif, real_file, {'_exptl': h})
+            self.assertEqual(len(h.data), 900)
+            # Short repeated values should share the same object
+            self.assertIs(h.data[0]['method'], h.data[899]['method'])
+            # Long values, and new values once the cache is full,
+            # should still be read correctly
+            self.assertEqual(h.data[0]['var1'], long_val)
+            self.assertEqual(h.data[1]['var1'], long_val)
+            self.assertEqual([d['var1'] for d in h.data[2::3]],
+                             ['v%d' % i for i in range(300)])
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_columnar_handler(self):
+        """Test C parser columnar handler"""
+        cif = """
+loop_
+_exptl.method
+_exptl.intkey1
+_exptl.floatkey1
+_exptl.boolkey1
+_exptl.var1
+foo 1 1.5 YES ?
+foo 1 . NO x
+bar 42 -2.0 ? x
+save_foo
+_exptl.method baz
+save_
+"""
+        for real_file in (True, False):
+            h = _TestColumnarHandler()
+            self._read_cif(cif, real_file, {'_exptl': h})
+            expected = [{'method': 'foo', 'intkey1': 1, 'floatkey1': 1.5,
+                         'boolkey1': True, 'var1': ihm.unknown},
+                        {'method': 'foo', 'intkey1': 1, 'boolkey1': False,
+                         'var1': 'x'},
+                        {'method': 'bar', 'intkey1': 42, 'floatkey1': -2.0,
+                         'boolkey1': ihm.unknown, 'var1': 'x'},
+                        {'method': 'baz'}, 'SAVE']
+            # Buffered rows should be passed in a single call at the
+            # end of the save frame
+            self.assertEqual(h.data, ['COLUMNS'] + expected)
+            # Repeated strings should share a Python object
+            self.assertIs(h.data[1]['method'], h.data[2]['method'])
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_grouped_columnar_handler(self):
+        """Test C parser columnar handler grouped by first column"""
+        cif = """
+loop_
+_exptl.method
+_exptl.intkey1
+foo 1
+foo 2
+bar 3
+foo 4
+"""
+        h = _TestColumnarHandler()
+        h._add_c_handler = _format.add_grouped_columnar_category_handler
+        self._read_cif(cif, True, {'_exptl': h})
+        # Each run of rows with the same first column should be passed
+        # in a separate call
+        self.assertEqual(h.data, [
+            'COLUMNS', {'method': 'foo', 'intkey1': 1},
+            {'method': 'foo', 'intkey1': 2},
+            'COLUMNS', {'method': 'bar', 'intkey1': 3},
+            'COLUMNS', {'method': 'foo', 'intkey1': 4}])
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_columnar_handler_large(self):
+        """Test C parser columnar handler with many rows"""
+        cif = "loop_\n_exptl.method\n_exptl.intkey1\n" + "".join(
+            "foo %d\n" % i for i in range(70000))
+        h = _TestColumnarHandler()
+        self._read_cif(cif, True, {'_exptl': h})
+        # Rows should be passed to Python in chunks, not all at once
+        self.assertEqual(h.data.count('COLUMNS'), 2)
+        rows = [d for d in h.data if d != 'COLUMNS']
+        self.assertEqual([d['intkey1'] for d in rows], list(range(70000)))
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_columnar_handler_raw_numeric(self):
+        """Test C parser columnar handler with raw numeric columns"""
+        class _RawHandler(GenericHandler):
+            _add_c_handler = _format.add_columnar_category_handler
+            _raw_numeric_columns = True
+
+            def _add_columns(self, *columns):
+                self.data.append(columns)
+
+        cif = """
+loop_
+_exptl.method
+_exptl.intkey1
+_exptl.floatkey1
+_exptl.boolkey1
+foo 1 1.5 YES
+bar . ? NO
+"""
+        h = _RawHandler()
+        self._read_cif(cif, True, {'_exptl': h})
+        columns, = h.data
+        d = dict(zip(h._keys, columns))
+        # Strings and bools should be passed as lists as usual
+        self.assertEqual(d['method'], ['foo', 'bar'])
+        self.assertEqual(d['boolkey1'], [True, False])
+        self.assertEqual(d['var1'], [None, None])
+        # Ints and floats should be raw native values
+        ints = array.array('q')
+        ints.frombytes(d['intkey1'])
+        self.assertEqual(list(ints), [1, -2 ** 63])
+        ints = array.array('q')
+        ints.frombytes(d['intkey2'])
+        self.assertEqual(list(ints), [-2 ** 63, -2 ** 63])
+        floats = array.array('d')
+        floats.frombytes(d['floatkey1'])
+        self.assertAlmostEqual(floats[0], 1.5, delta=1e-6)
+        self.assertTrue(math.isnan(floats[1]))
+
     def test_finalize_handler(self):
         """Make sure that C parser finalize callback works"""
         for real_file in (True, False):
@@ -3,7 +3,9 @@ import os
 import unittest
 import sys
 import struct
-from io import BytesIO
+import array
+import math
+from io import BytesIO, StringIO
 
 TOPDIR = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
 utils.set_search_paths(TOPDIR)
@@ -14,6 +16,11 @@ try:
 except ImportError:
     _format = None
 
+try:
+    import msgpack
+except ImportError:
+    msgpack = None
+
 
 # Provide dummy implementations of msgpack.unpack() and msgpack.pack() which
 # just return the data unchanged. We can use these to test the Python BinaryCIF
@@ -138,7 +145,9 @@ class Category:
 
 
 class Block(list):
-    pass
+    def __init__(self, categories, header='ihm'):
+        super().__init__(categories)
+        self.header = header
 
 
 class _BadMsgPackType:
@@ -187,7 +196,7 @@ def _add_msgpack(d, fh):
 
 
 def _make_bcif_file(blocks):
-    blocks = [{'header': 'ihm',
+    blocks = [{'header': block.header,
                'categories': [c.get_bcif() for c in block]}
               for block in blocks]
     d = {'version': '0.1', 'encoder': 'python-ihm test suite',
@@ -350,6 +359,43 @@ class Tests(unittest.TestCase):
                           get_decoded, ihm.format_bcif._Uint32,
                           struct.pack('<I', 5))
 
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_numeric_to_string_c(self):
+        """Test conversion of numeric BinaryCIF data to strings"""
+        def get_decoded(data, data_type):
+            c = {'name': 'method',
+                 'data': {'data': data,
+                          'encoding': [{'kind': 'ByteArray',
+                                        'type': data_type}]}}
+            d = {'dataBlocks': [{'categories': [{'name': '_exptl',
+                                                 'columns': [c]}]}]}
+            h = GenericHandler()
+            self._read_bcif_raw(d, {'_exptl': h})
+            return [x['method'] for x in h.data]
+
+        ints = [-2147483648, -42, 0, 7, 10, 99, 100, 2147483647]
+        data = get_decoded(struct.pack('<%di' % len(ints), *ints),
+                           ihm.format_bcif._Int32)
+        self.assertEqual(data, [str(x) for x in ints])
+
+        # Doubles should be output in shortest round-trip form, like repr()
+        doubles = [0.0, -0.0, 1.0, -42.5, 0.1, 1. / 3., 2. / 3., 1e-4,
+                   1.5e-5, 1e16, 1e15, 123456789012345678.0, -78.123,
+                   5e-324, 1.7976931348623157e308, 681636455607468.25,
+                   float('inf'), float('-inf'), float('nan')]
+        data = get_decoded(struct.pack('<%dd' % len(doubles), *doubles),
+                           ihm.format_bcif._Float64)
+        self.assertEqual(data, [repr(x) for x in doubles])
+
+        # Single precision values should be output in the shortest form
+        # that reads back as the same single precision value
+        floats = [0.1, -42.25, 1.234, 1e-3, 3.4028234663852886e+38,
+                  345831552.0]
+        data = get_decoded(struct.pack('<%df' % len(floats), *floats),
+                           ihm.format_bcif._Float32)
+        self.assertEqual(data, ['0.1', '-42.25', '1.234', '0.001',
+                                '3.4028235e+38', '345831550.0'])
+
     def test_integer_packing_decoder_signed(self):
         """Test IntegerPacking decoder with signed data"""
         d = ihm.format_bcif._IntegerPackingDecoder()
@@ -407,6 +453,12 @@ class Tests(unittest.TestCase):
         self.assertAlmostEqual(data[1], 1.23, delta=0.01)
         self.assertAlmostEqual(data[2], 0.12, delta=0.01)
 
+        # Single precision source data should be rounded accordingly
+        data = list(d({'factor': 100, 'srcType': ihm.format_bcif._Float32},
+                      [123]))
+        self.assertEqual(data, list(struct.unpack('<f',
+                                                  struct.pack('<f', 1.23))))
+
     def test_interval_quantization_decoder(self):
         """Test IntervalQuantization decoder"""
         d = ihm.format_bcif._IntervalQuantizationDecoder()
@@ -419,6 +471,11 @@ class Tests(unittest.TestCase):
         self.assertAlmostEqual(data[1], 1.5, delta=0.01)
         self.assertAlmostEqual(data[2], 2.0, delta=0.01)
 
+        data = list(d({'min': 1.0, 'max': 2.0, 'numSteps': 4,
+                       'srcType': ihm.format_bcif._Float32}, [1]))
+        self.assertEqual(data, list(struct.unpack('<f',
+                                                  struct.pack('<f', 4. / 3.))))
+
     def test_decode(self):
         """Test _decode function"""
         data = b'\x01\x03\x02\x01\x03\x02'
@@ -936,6 +993,175 @@ class Tests(unittest.TestCase):
             self._read_bcif_raw(d, {'_foo': h})
             self.assertEqual(h.data, [{'bar': ''}])
 
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_get_stats(self):
+        """Test BinaryCIF reader statistics"""
+        fh = _make_bcif_file([Block([Category('_foo', {'bar': ['x', 'y']}),
+                                     Category('_unk', {'bar': ['x']})]),
+                              Block([Category('_foo', {'bar': ['z']})])])
+        size = len(fh.getvalue())
+        h = GenericHandler()
+        r = ihm.format_bcif.BinaryCifReader(fh, {'_foo': h})
+        r.set_timing()
+        while r.read_file():
+            pass
+        self.assertEqual(len(h.data), 3)
+        st = r.get_stats()
+        self.assertEqual(st.bytes_read, size)
+        self.assertEqual(st.lines, 0)
+        self.assertEqual(st.tokens, 0)
+        self.assertGreaterEqual(st.buffer_max, size)
+        self.assertEqual(list(st.categories.keys()), ['_foo'])
+        self.assertEqual(st.categories['_foo'][0], 3)
+        self.assertGreater(st.total_time, 0.)
+        self.assertGreaterEqual(st.callback_time, st.categories['_foo'][1])
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_progress(self):
+        """Test BinaryCIF progress reports"""
+        fh = _make_bcif_file([Block([Category('_foo', {'bar': ['x', 'y']})])])
+        size = len(fh.getvalue())
+        calls = []
+        r = ihm.format_bcif.BinaryCifReader(fh, {'_foo': GenericHandler()})
+        r.set_progress_handler(lambda *args: calls.append(args), interval=0)
+        r.read_file()
+        self.assertEqual(calls, [(size, size, 0, None)])
+
+    @unittest.skipIf(msgpack is None, "No msgpack module")
+    def test_feed(self):
+        """Test BinaryCifReader.feed() and finish()"""
+        # Undo any mocking of msgpack by other tests
+        sys.modules['msgpack'] = msgpack
+        fh = BytesIO()
+        writer = ihm.format_bcif.BinaryCifWriter(fh)
+        for header in ('ihm', 'second'):
+            writer.start_block(header)
+            with writer.loop('_foo', ['bar', 'baz']) as lp:
+                for i in range(50):
+                    lp.write(bar=i, baz='x%d' % (i % 3))
+        writer.flush()
+        data = fh.getvalue()
+
+        handlers = [GenericHandler(), GenericHandler()]
+        r = ihm.format_bcif.BinaryCifReader(None, {'_foo': handlers[0]})
+        self.assertRaises(ValueError, r.read_file)
+        blocks_done = 0
+        for i in range(0, len(data), 50):
+            chunk = data[i:i + 50]
+            while r.feed(chunk):
+                blocks_done += 1
+                r.category_handler = {'_foo': handlers[1]}
+                chunk = b''
+        if _format is not None:
+            # The first block should have been read as data arrived
+            self.assertEqual(blocks_done, 1)
+            self.assertEqual(len(handlers[0].data), 50)
+        while r.finish():
+            r.category_handler = {'_foo': handlers[1]}
+        for h in handlers:
+            self.assertEqual(len(h.data), 50)
+            self.assertEqual(h.data[1], {'bar': '1', 'baz': 'x1'})
+        self.assertRaises(ValueError, r.feed, data)
+
+        # feed() and finish() need a reader with no file handle
+        r = ihm.format_bcif.BinaryCifReader(BytesIO(data), {})
+        self.assertRaises(ValueError, r.feed, data)
+        self.assertRaises(ValueError, r.finish)
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_feed_c(self):
+        """Test pushing BinaryCIF data to the C reader"""
+        fh = _make_bcif_file([Block([Category('_foo', {'bar': ['x', 'y']})]),
+                              Block([Category('_foo', {'bar': ['z']})])])
+        data = fh.read()
+        h = GenericHandler()
+        reader = _format.ihm_reader_new(_format.ihm_file_new_push(), True)
+        try:
+            _format.add_category_handler(reader, '_foo', h._keys,
+                                         h._int_keys, h._float_keys,
+                                         h._bool_keys, h)
+            # Each category should be decoded as soon as all of its data
+            # are available
+            first_block_done = None
+            for i in range(0, len(data), 5):
+                ret_ok, block_done = _format.ihm_reader_feed(
+                    reader, data[i:i + 5])
+                if block_done:
+                    self.assertIsNone(first_block_done)
+                    first_block_done = i
+                    self.assertEqual(h.data, [{'bar': 'x'}, {'bar': 'y'}])
+                    # Rest of the data should be decoded by the next call
+                    ret_ok, block_done = _format.ihm_reader_feed(reader, b'')
+                    self.assertFalse(block_done)
+            self.assertLess(first_block_done, len(data) - 10)
+            self.assertEqual(h.data, [{'bar': 'x'}, {'bar': 'y'},
+                                      {'bar': 'z'}])
+            # The end of the last block is only handled by finish
+            ret_ok, more_data = _format.ihm_reader_finish(reader)
+            self.assertFalse(more_data)
+            self.assertEqual(len(h.data), 3)
+            self.assertRaises(ValueError, _format.ihm_reader_feed, reader,
+                              data)
+        finally:
+            _format.ihm_reader_free(reader)
+
+        # Data should not be kept once it has been decoded
+        fh = _make_bcif_file([Block([Category('_foo',
+                                              {'bar': list(range(100)) * 2})
+                                     for i in range(100)])])
+        data = fh.read()
+        h = GenericHandler()
+        reader = _format.ihm_reader_new(_format.ihm_file_new_push(), True)
+        try:
+            _format.add_category_handler(reader, '_foo', h._keys,
+                                         h._int_keys, h._float_keys,
+                                         h._bool_keys, h)
+            for i in range(0, len(data), 500):
+                _format.ihm_reader_feed(reader, data[i:i + 500])
+            self.assertEqual(len(h.data), 20000)
+            ret_ok, more_data = _format.ihm_reader_finish(reader)
+            self.assertFalse(more_data)
+            stats = _format.ihm_reader_get_stats(reader)
+            self.assertLess(stats['buffer_max'], len(data) // 10)
+        finally:
+            _format.ihm_reader_free(reader)
+
+        # Truncated data should give an error
+        reader = _format.ihm_reader_new(_format.ihm_file_new_push(), True)
+        try:
+            _format.ihm_reader_feed(reader, data[:20])
+            self.assertRaises(IOError, _format.ihm_reader_finish, reader)
+        finally:
+            _format.ihm_reader_free(reader)
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_string_array_dictionary_c(self):
+        """Test that StringArray values are shared between rows"""
+        def make_cat(name, string_data, offsets, indices):
+            uint8 = ihm.format_bcif._Uint8
+            c = {'name': 'bar',
+                 'data': {'data': struct.pack('%db' % len(indices), *indices),
+                          'encoding':
+                          [{'kind': 'StringArray', 'stringData': string_data,
+                            'dataEncoding': [{'kind': 'ByteArray',
+                                              'type': ihm.format_bcif._Int8}],
+                            'offsetEncoding': [{'kind': 'ByteArray',
+                                                'type': uint8}],
+                            'offsets': bytes(offsets)}]}}
+            return {'name': name, 'columns': [c]}
+
+        d = {'dataBlocks': [{'categories': [
+            make_cat('_foo', 'aAB', [0, 1, 3], [0, 1, 0, -1, 1]),
+            make_cat('_foo', 'xyz', [0, 2, 3], [1, 0, 1])]}]}
+        h = GenericHandler()
+        self._read_bcif_raw(d, {'_foo': h})
+        self.assertEqual([x['bar'] for x in h.data],
+                         ['a', 'AB', 'a', '', 'AB', 'z', 'xy', 'z'])
+        # Each distinct string in a column should be converted only once
+        self.assertIs(h.data[0]['bar'], h.data[2]['bar'])
+        self.assertIs(h.data[1]['bar'], h.data[4]['bar'])
+        self.assertIs(h.data[5]['bar'], h.data[7]['bar'])
+
     @unittest.skipIf(_format is None, "No C tokenizer")
     def test_fixed_point_encoding_c(self):
         """Test handling of various BinaryCIF FixedPoint encodings"""
@@ -978,6 +1204,71 @@ class Tests(unittest.TestCase):
         self.assertRaises(_format.FileFormatError, self._read_bcif_raw,
                           d, {'_foo': h})
 
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_src_type_c(self):
+        """Test handling of BinaryCIF srcType"""
+        def make_bcif(data, encoding, key='bar'):
+            c = {'name': key,
+                 'data': {'data': data, 'encoding': encoding}}
+            return {'dataBlocks': [{'categories': [{'name': '_foo',
+                                                    'columns': [c]}]}]}
+
+        def get_decoded(data, encoding, key='bar'):
+            h = GenericHandler()
+            self._read_bcif_raw(make_bcif(data, encoding, key), {'_foo': h})
+            return [x[key] for x in h.data]
+
+        int8 = {'kind': 'ByteArray', 'type': ihm.format_bcif._Int8}
+        int16 = {'kind': 'ByteArray', 'type': ihm.format_bcif._Int16}
+        f32 = ihm.format_bcif._Float32
+        # Single precision FixedPoint data should stay single precision
+        data = get_decoded(struct.pack('<h', 123),
+                           [{'kind': 'FixedPoint', 'factor': 100,
+                             'srcType': f32}, int16], key='floatkey1')
+        self.assertEqual(data, list(struct.unpack('<f',
+                                                  struct.pack('<f', 1.23))))
+        data = get_decoded(struct.pack('<h', 123),
+                           [{'kind': 'FixedPoint', 'factor': 100}, int16],
+                           key='floatkey1')
+        self.assertEqual(data, [1.23])
+        data = get_decoded(struct.pack('b', 1),
+                           [{'kind': 'IntervalQuantization',
+                             'min': 1.0, 'max': 2.0, 'numSteps': 4,
+                             'srcType': f32}, int8], key='floatkey1')
+        self.assertEqual(data, list(struct.unpack('<f',
+                                                  struct.pack('<f', 4. / 3.))))
+
+        # Narrow integer srcType should be honored, falling back to
+        # a wider type if the data doesn't fit
+        for src_type in (ihm.format_bcif._Int8, ihm.format_bcif._Uint8,
+                         ihm.format_bcif._Int16, ihm.format_bcif._Uint16,
+                         ihm.format_bcif._Int32):
+            data = get_decoded(struct.pack('3b', 0, 100, 100),
+                               [{'kind': 'Delta', 'origin': 10,
+                                 'srcType': src_type}, int8], key='intkey1')
+            self.assertEqual(data, [10, 110, 210])
+            data = get_decoded(struct.pack('<4h', 300, 2, -4, 1),
+                               [{'kind': 'RunLength',
+                                 'srcType': src_type}, int16], key='intkey1')
+            self.assertEqual(data, [300, 300, -4])
+
+        # IntegerPacking output of various ranges
+        for values in ([0, 255], [-128, 127], [0, 65535], [-32768, 32767],
+                       [-40000, 70000]):
+            packed = []
+            for v in values:
+                while v >= 127:
+                    packed.append(127)
+                    v -= 127
+                while v <= -128:
+                    packed.append(-128)
+                    v += 128
+                packed.append(v)
+            data = get_decoded(struct.pack('%db' % len(packed), *packed),
+                               [{'kind': 'IntegerPacking', 'byteCount': 1,
+                                 'isUnsigned': False}, int8], key='intkey1')
+            self.assertEqual(data, values)
+
     @unittest.skipIf(_format is None, "No C tokenizer")
     def test_run_length_encoding_c(self):
         """Test handling of various BinaryCIF RunLength encodings"""
@@ -1025,6 +1316,14 @@ class Tests(unittest.TestCase):
         self._read_bcif_raw(d, {'_foo': h})
         self.assertEqual(h.data, [{'bar': '5'}] * 3)
 
+        # Test normal usage with unsigned 32-bit integer data
+        # (used for large counts)
+        d = make_bcif(data=struct.pack('<2I', 5, 70000),
+                      data_type=ihm.format_bcif._Uint32)
+        h = GenericHandler()
+        self._read_bcif_raw(d, {'_foo': h})
+        self.assertEqual(h.data, [{'bar': '5'}] * 70000)
+
         # Data size should be even
         d = make_bcif(data=struct.pack('<3H', 5, 3, 8),
                       data_type=ihm.format_bcif._Uint16)
@@ -1317,6 +1616,65 @@ class Tests(unittest.TestCase):
         self.assertRaises(_format.FileFormatError, self._read_bcif_raw,
                           d, {'_foo': h})
 
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_chunked_decoding_c(self):
+        """Test decoding of BinaryCIF categories in chunks"""
+        # Write a file using a variety of encodings, including runs and
+        # deltas that span chunk boundaries
+        fh = MockFh()
+        sys.modules['msgpack'] = MockMsgPack
+        writer = ihm.format_bcif.BinaryCifWriter(fh)
+        writer.start_block('ihm')
+        with writer.loop('_foo', ['bar', 'intkey1', 'intkey2',
+                                  'floatkey1']) as lp:
+            for i in range(100):
+                lp.write(bar=['x', None, 'y', ihm.unknown, 'x'][i % 5],
+                         intkey1=i // 7, intkey2=i * 3 + 1000,
+                         floatkey1=None if i % 9 == 0 else i * 0.5)
+        writer.flush()
+
+        def read(d, chunk_size):
+            h = GenericHandler()
+            r = ihm.format_bcif.BinaryCifReader(_python_to_msgpack(d),
+                                                {'_foo': h},
+                                                chunk_size=chunk_size)
+            r.read_file()
+            return h.data
+
+        full = read(fh.data, 0)
+        self.assertEqual(len(full), 100)
+        self.assertEqual(full[7], {'bar': 'y', 'intkey1': 1,
+                                   'intkey2': 1021, 'floatkey1': 3.5})
+        for chunk_size in (1, 7, 64, 99, 100, 1000):
+            self.assertEqual(read(fh.data, chunk_size), full)
+
+        # Data that doesn't match the row count should be rejected
+        def make_bcif(row_count, data):
+            c = {'name': 'bar',
+                 'data': {'data': data,
+                          'encoding':
+                          [{'kind': 'RunLength'},
+                           {'kind': 'IntegerPacking', 'byteCount': 1,
+                            'isUnsigned': True},
+                           {'kind': 'ByteArray',
+                            'type': ihm.format_bcif._Uint8}]}}
+            return {'dataBlocks': [{'categories': [
+                {'name': '_foo', 'columns': [c], 'rowCount': row_count}]}]}
+
+        d = make_bcif(300, struct.pack('5B', 1, 255, 45, 3, 0))
+        self.assertEqual([x['bar'] for x in read(d, 7)],
+                         ['1'] * 300)
+        self.assertRaises(_format.FileFormatError, read,
+                          make_bcif(301, struct.pack('5B', 1, 255, 45, 3, 0)),
+                          7)
+        self.assertRaises(_format.FileFormatError, read,
+                          make_bcif(299, struct.pack('5B', 1, 255, 45, 3, 0)),
+                          7)
+        # Errors in the data should be reported
+        self.assertRaises(_format.FileFormatError, read,
+                          make_bcif(300, struct.pack('4B', 1, 255, 45, 3)),
+                          7)
+
     @unittest.skipIf(_format is None, "No C tokenizer")
     def test_read_error(self):
         """Test handling of errors from filelike read()"""
@@ -1494,6 +1852,111 @@ class Tests(unittest.TestCase):
         self.assertFalse(r.read_file())
         self.assertEqual(h.data, [])
 
+    def test_skip_to_block(self):
+        """Test skipping to a given data block"""
+        def make_reader():
+            blocks = [Block([Category('_foo', {'var1': ['test%d' % i]})],
+                            header=name)
+                      for i, name in enumerate(('first', 'second', 'third'))]
+            fh = _make_bcif_file(blocks)
+            h = GenericHandler()
+            sys.modules['msgpack'] = MockMsgPack
+            return ihm.format_bcif.BinaryCifReader(fh, {'_foo': h}), h
+
+        r, h = make_reader()
+        self.assertTrue(r.skip_to_block(1))
+        self.assertTrue(r.read_file())
+        self.assertEqual(h.data, [{'var1': 'test1'}])
+        # Cannot go backwards
+        self.assertRaises(ValueError, r.skip_to_block, 0)
+        # Skipping to the next block is a noop
+        self.assertTrue(r.skip_to_block(2))
+        h.data = []
+        self.assertFalse(r.read_file())
+        self.assertEqual(h.data, [{'var1': 'test2'}])
+
+        r, h = make_reader()
+        self.assertTrue(r.skip_to_block('second'))
+        # Skip a block whose header we have already looked at
+        self.assertTrue(r.skip_to_block('third'))
+        self.assertFalse(r.read_file())
+        self.assertEqual(h.data, [{'var1': 'test2'}])
+
+        r, h = make_reader()
+        self.assertFalse(r.skip_to_block('nosuch'))
+        self.assertFalse(r.read_file())
+        self.assertEqual(h.data, [])
+
+        r, h = make_reader()
+        self.assertFalse(r.skip_to_block(5))
+        self.assertFalse(r.read_file())
+        self.assertEqual(h.data, [])
+
+    def test_get_contents(self):
+        """Test getting data block and category names"""
+        blocks = [Block([Category('_foo', {'var1': ['test1']}),
+                         Category('_bar', {'var2': ['test2']})],
+                        header='first'),
+                  Block([], header='second')]
+        fh = _make_bcif_file(blocks)
+        h = GenericHandler()
+        sys.modules['msgpack'] = MockMsgPack
+        r = ihm.format_bcif.BinaryCifReader(fh, {'_foo': h})
+        self.assertEqual(r.get_contents(),
+                         [('first', ['_foo', '_bar']), ('second', [])])
+        self.assertFalse(r.read_file())
+        self.assertEqual(h.data, [])
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_read_nested_c(self):
+        """Test BinaryCIF reads from within a handler for another file"""
+        blocks = [Block([Category('_foo', {'var1': ['test%d' % i]})],
+                        header=name)
+                  for i, name in enumerate(('first', 'second', 'third'))]
+        data = _make_bcif_file(blocks).getvalue()
+
+        class NestedHandler(GenericHandler):
+            def __call__(self, *args):
+                super(NestedHandler, self).__call__(*args)
+                r = ihm.format_bcif.BinaryCifReader(BytesIO(data), {})
+                self.contents = r.get_contents()
+                self.inner = GenericHandler()
+                r = ihm.format_bcif.BinaryCifReader(BytesIO(data),
+                                                    {'_foo': self.inner})
+                self.found = [r.skip_to_block(1), r.skip_to_block('third')]
+                r.read_file()
+        h = NestedHandler()
+        r = ihm.format.CifReader(StringIO("_exptl.method foo\n"),
+                                 {'_exptl': h})
+        r.read_file()
+        self.assertEqual(h.data, [{'method': 'foo'}])
+        self.assertEqual([c[0] for c in h.contents],
+                         ['first', 'second', 'third'])
+        self.assertEqual(h.found, [True, True])
+        self.assertEqual(h.inner.data, [{'var1': 'test2'}])
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_block_header_after_categories_c(self):
+        """Test skipping to a block whose header follows its categories"""
+        def make_reader():
+            cat = Category('_foo', {'var1': ['test1']}).get_bcif()
+            d = {'dataBlocks': [{'categories': [cat], 'header': 'first'},
+                                {'categories': [cat], 'header': 'second'}]}
+            h = GenericHandler()
+            return (ihm.format_bcif.BinaryCifReader(_python_to_msgpack(d),
+                                                    {'_foo': h}), h)
+
+        r, h = make_reader()
+        self.assertEqual(r.get_contents(),
+                         [('first', ['_foo']), ('second', ['_foo'])])
+        r, h = make_reader()
+        self.assertRaises(_format.FileFormatError, r.skip_to_block, 'first')
+        # Skipping by index works fine
+        r, h = make_reader()
+        self.assertTrue(r.skip_to_block(1))
+        self.assertFalse(r.read_file())
+        self.assertEqual(h.data, [{'var1': 'test1'}])
+
     def test_encoder(self):
         """Test _Encoder base class"""
         e = ihm.format_bcif._Encoder()
@@ -1741,6 +2204,74 @@ class Tests(unittest.TestCase):
         self.assertEqual(encs, [{'kind': 'ByteArray',
                                  'type': ihm.format_bcif._Float32}])
 
+    def test_integer_pack(self):
+        """Test IntegerPacking encoding"""
+        data = [0, 127, -128, 300, -300, 5]
+        packed = ihm.format_bcif._integer_pack(data, 1, False)
+        self.assertEqual(packed, [0, 127, 0, -128, 0, 127, 127, 46,
+                                  -128, -128, -44, 5])
+        self.assertEqual(ihm.format_bcif._integer_packed_size(data, 1, False),
+                         len(packed))
+        d = ihm.format_bcif._IntegerPackingDecoder()
+        self.assertEqual(list(d({'byteCount': 1, 'isUnsigned': False},
+                                packed)), data)
+        data = [0, 255, 70000]
+        packed = ihm.format_bcif._integer_pack(data, 2, True)
+        self.assertEqual(packed, [0, 255, 65535, 4465])
+        self.assertEqual(ihm.format_bcif._integer_packed_size(data, 2, True),
+                         4)
+        self.assertEqual(list(d({'byteCount': 2, 'isUnsigned': True},
+                                packed)), data)
+
+    def test_encode_ints_smallest(self):
+        """Test choice of smallest integer encoding"""
+        def check(data, kinds):
+            encdata, encs = ihm.format_bcif._encode_ints_smallest(data)
+            self.assertEqual([e['kind'] for e in encs], kinds)
+            self.assertEqual(list(ihm.format_bcif._decode(encdata, encs)),
+                             data)
+        # Small data is not compressed
+        check([1, 2, 3], ['ByteArray'])
+        # Sequential data is best encoded as Delta+RunLength
+        check(list(range(1000)), ['Delta', 'RunLength', 'ByteArray'])
+        # Repeated data is best encoded as RunLength
+        check([5] * 100 + [1000] * 100, ['RunLength', 'ByteArray'])
+        # Mostly-small data with a few large values benefits from packing
+        check([1, 2, 3, 4] * 50 + [100000], ['IntegerPacking', 'ByteArray'])
+        self.assertRaises(TypeError, ihm.format_bcif._encode_ints_smallest,
+                          [2 ** 40])
+
+    def test_encode_floats_smallest(self):
+        """Test choice of smallest floating point encoding"""
+        def check(data, kinds, factor=None):
+            encdata, encs = ihm.format_bcif._encode_floats_smallest(data)
+            self.assertEqual([e['kind'] for e in encs], kinds)
+            if factor is not None:
+                self.assertEqual(encs[0]['factor'], factor)
+            self.assertEqual(
+                list(ihm.format_bcif._decode(encdata, encs)),
+                list(array.array('f', data)))
+        # Data with few decimal places can be stored as FixedPoint
+        check([i * 0.01 for i in range(100)],
+              ['FixedPoint', 'Delta', 'RunLength', 'ByteArray'], factor=100)
+        check([1.234, -5.678] * 50, ['FixedPoint', 'ByteArray'],
+              factor=1000)
+        # Small data, or data that would lose precision, is left alone
+        check([1.5, 2.5], ['ByteArray'])
+        check([math.pi, math.e] * 50, ['ByteArray'])
+        check([float('inf')] * 50, ['ByteArray'])
+
+    def test_writer_optimize(self):
+        """Test BinaryCifWriter with optimize=True"""
+        writer = ihm.format_bcif.BinaryCifWriter(MockFh(), optimize=True)
+        mask, encdata, encs = writer._encode_data_python(
+            [0.5 * i for i in range(99)] + [None])
+        self.assertEqual(encs[0], {'kind': 'FixedPoint', 'factor': 10,
+                                   'srcType': ihm.format_bcif._Float32})
+        self.assertEqual(list(ihm.format_bcif._decode(mask['data'],
+                                                      mask['encoding'])),
+                         [0] * 99 + [1])
+
     def test_category(self):
         """Test CategoryWriter class"""
         fh = MockFh()
@@ -1795,6 +2326,81 @@ class Tests(unittest.TestCase):
         self.assertEqual(cols[0]['mask']['data'],
                          b'\x00\x01\x02\x00\x00\x01')
 
+    def test_loop_write_columns(self):
+        """Test LoopWriter.write_columns()"""
+        fh = MockFh()
+        sys.modules['msgpack'] = MockMsgPack
+        writer = ihm.format_bcif.BinaryCifWriter(fh)
+        writer.start_block('ihm')
+        with writer.loop('foo', ["bar", "baz"]) as lp:
+            lp.write(bar='x')
+            lp.write_columns(bar=('y', None),
+                             baz=array.array('i', [1, 2]))
+            self.assertRaises(ValueError, lp.write_columns,
+                              bar=[1, 2], baz=[1])
+        writer.flush()
+        block, = fh.data['dataBlocks']
+        category, = block['categories']
+        self.assertEqual(category['rowCount'], 3)
+        bar, baz = category['columns']
+        self.assertEqual(bar['mask']['data'], b'\x00\x00\x01')
+        self.assertEqual(baz['mask']['data'], b'\x01\x00\x00')
+        self.assertEqual(baz['data']['data'], b'\xff\x01\x02')
+
+    @unittest.skipIf(msgpack is None, "No msgpack module")
+    def test_stream(self):
+        """Test streaming BinaryCifWriter"""
+        def write(fh, stream):
+            writer = ihm.format_bcif.BinaryCifWriter(fh, stream=stream)
+            for header in ('ihm', 'second'):
+                writer.start_block(header)
+                with writer.loop('_foo', ['bar', 'baz']) as lp:
+                    for i in range(50):
+                        lp.write(bar=i, baz='x%d' % (i % 3))
+                with writer.category('_cat') as loc:
+                    loc.write(x=1.5)
+                with writer.loop('_empty', ['bar']):
+                    pass
+            writer.flush()
+        # Undo any mocking of msgpack by other tests
+        sys.modules['msgpack'] = msgpack
+        fh = BytesIO()
+        write(fh, False)
+        sfh = BytesIO()
+        write(sfh, True)
+        self.assertEqual(msgpack.unpackb(sfh.getvalue()),
+                         msgpack.unpackb(fh.getvalue()))
+        # File must be seekable
+        fh = MockFh()
+        fh.seekable = lambda: False
+        self.assertRaises(ValueError, write, fh, True)
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_encode_data_c(self):
+        """Test C encoding of BinaryCIF data matches the Python encoders"""
+        for optimize in (False, True):
+            writer = ihm.format_bcif.BinaryCifWriter(MockFh(),
+                                                     optimize=optimize)
+            for data in ([1], [None], [ihm.unknown], ['a', 'b', 'a', None],
+                         [True, False, None, 'x'], [1.5, 2, None, ihm.unknown],
+                         list(range(100)), [i // 7 for i in range(100)],
+                         [5] * 41, [-1, 1] * 30, [2 ** 31 - 1, -2 ** 31],
+                         [1, 'foo\u00e9', 2.5, None] * 20,
+                         [1, 2, 3, 4] * 50 + [100000], [1.234, -5.678] * 50,
+                         [math.pi, math.e] * 50, [float('nan')] * 50,
+                         [None if i % 9 else i * 0.5 for i in range(100)]):
+                self.assertEqual(writer._encode_data(data),
+                                 writer._encode_data_python(data))
+        writer = ihm.format_bcif.BinaryCifWriter(MockFh())
+        # Data that can't be handled in C should fall back to Python
+        for data in ([2 ** 31 - 1, -2 ** 31] * 30, [2 ** 64], [1e300],
+                     [object(), 'a']):
+            self.assertIsNone(
+                _format.bcif_encode_data(data, ihm.unknown, False))
+        self.assertRaises(TypeError, writer._encode_data, [2 ** 64])
+        self.assertEqual(writer._encode_data([MockFh(), 'a'])[2][0]['kind'],
+                         'StringArray')
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -1,6 +1,7 @@
 import utils
 import os
 import unittest
+import pickle
 import urllib.request
 
 TOPDIR = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
@@ -1350,6 +1351,8 @@ class Tests(unittest.TestCase):
         self.assertFalse(u > u)
         # Should act like False
         self.assertFalse(u)
+        # Should still be the singleton when pickled
+        self.assertIs(pickle.loads(pickle.dumps(u)), u)
 
     def test_branch_descriptor(self):
         """Test the BranchDescriptor class"""
@@ -1,5 +1,6 @@
 import utils
 import os
+import pickle
 import unittest
 
 TOPDIR = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
@@ -7,6 +8,10 @@ utils.set_search_paths(TOPDIR)
 import ihm.model
 
 
+class _ExtraAtom(ihm.model.Atom):
+    __slots__ = ['extra']
+
+
 class Tests(unittest.TestCase):
 
     def test_sphere(self):
@@ -23,6 +28,27 @@ class Tests(unittest.TestCase):
         self.assertEqual(s.asym_unit, 'foo')
         self.assertEqual(s.seq_id, 1)
 
+    def test_pickle(self):
+        """Test pickling of Atom and Sphere objects"""
+        a = ihm.model.Atom(asym_unit='foo', seq_id=1, atom_id='N',
+                           type_symbol='N', x=1.0, y=2.0, z=3.0, het=True,
+                           biso=4.0, occupancy=0.5, alt_id='A')
+        s = ihm.model.Sphere(asym_unit='foo', seq_id_range=(1, 5), x=1.0,
+                             y=2.0, z=3.0, radius=4.0, rmsf=5.0)
+        for obj in a, s:
+            newobj = pickle.loads(pickle.dumps(obj))
+            self.assertIsInstance(newobj, type(obj))
+            for attr in type(obj).__slots__:
+                self.assertEqual(getattr(newobj, attr), getattr(obj, attr))
+
+        # Subclasses should keep any extra attributes
+        a = _ExtraAtom(asym_unit='foo', seq_id=1, atom_id='N',
+                       type_symbol='N', x=1.0, y=2.0, z=3.0)
+        a.extra = 42
+        newobj = pickle.loads(pickle.dumps(a))
+        self.assertIsInstance(newobj, _ExtraAtom)
+        self.assertEqual(newobj.extra, 42)
+
     def test_model(self):
         """Test Model class"""
         m = ihm.model.Model(assembly='foo', protocol='bar',
@@ -66,6 +92,60 @@ class Tests(unittest.TestCase):
         m.add_atom(atoms[1])
         self.assertEqual(m._atoms, atoms)
 
+    def test_columnar_model_atoms(self):
+        """Test ColumnarModel atom storage"""
+        m = ihm.model.ColumnarModel(assembly='foo', protocol='bar',
+                                    representation='baz')
+        asym1, asym2 = object(), object()
+        m.add_atom(ihm.model.Atom(asym_unit=asym1, seq_id=1, atom_id='CA',
+                                  type_symbol='C', x=1.0, y=2.0, z=3,
+                                  occupancy=0.5))
+        m.add_atom(ihm.model.Atom(asym_unit=asym2, seq_id=None, atom_id='N',
+                                  type_symbol='N', x=4.0, y=5.0, z=6.0,
+                                  het=True, biso=42.0, alt_id='A'))
+        a1, a2 = list(m.get_atoms())
+        self.assertIsInstance(a1, ihm.model.Atom)
+        self.assertIs(a1.asym_unit, asym1)
+        self.assertIs(a2.asym_unit, asym2)
+        self.assertEqual((a1.seq_id, a1.atom_id, a1.type_symbol),
+                         (1, 'CA', 'C'))
+        self.assertIsNone(a2.seq_id)
+        self.assertEqual((a1.x, a1.y, a1.z), (1.0, 2.0, 3.0))
+        self.assertAlmostEqual(a1.occupancy, 0.5, delta=1e-6)
+        self.assertIsNone(a1.biso)
+        self.assertAlmostEqual(a2.biso, 42.0, delta=1e-6)
+        self.assertFalse(a1.het)
+        self.assertTrue(a2.het)
+        self.assertIsNone(a1.alt_id)
+        self.assertEqual(a2.alt_id, 'A')
+        # Atoms are views into the model's storage
+        self.assertEqual(len(m._atoms), 2)
+        a1.seq_id = 4
+        a1.asym_unit = asym2
+        a1.het = True
+        a = m._atoms[-2]
+        self.assertEqual(a.seq_id, 4)
+        self.assertIs(a.asym_unit, asym2)
+        self.assertTrue(a.het)
+        self.assertRaises(IndexError, m._atoms.__getitem__, 2)
+        # Distinct values are only stored once
+        self.assertEqual(len(m._atoms.asym_unit.values), 2)
+
+    def test_columnar_model_spheres(self):
+        """Test ColumnarModel sphere storage"""
+        m = ihm.model.ColumnarModel(assembly='foo', protocol='bar',
+                                    representation='baz')
+        m.add_sphere(ihm.model.Sphere(asym_unit='foo', seq_id_range=(1, 5),
+                                      x=1.0, y=2.0, z=3.0, radius=4.0))
+        s, = list(m.get_spheres())
+        self.assertIsInstance(s, ihm.model.Sphere)
+        self.assertEqual(s.asym_unit, 'foo')
+        self.assertEqual(s.seq_id_range, (1, 5))
+        self.assertEqual((s.x, s.y, s.z, s.radius), (1.0, 2.0, 3.0, 4.0))
+        self.assertIsNone(s.rmsf)
+        s.seq_id_range = (2, 3)
+        self.assertEqual(m._spheres[0].seq_id_range, (2, 3))
+
     def test_model_group(self):
         """Test ModelGroup class"""
         m = ihm.model.Model(assembly='foo', protocol='bar',
@@ -1,6 +1,9 @@
 import utils
+import asyncio
 import datetime
 import os
+import sys
+import time
 import unittest
 import gzip
 import operator
@@ -77,6 +80,23 @@ _ihm_geometric_object_transformation.tr_vector[3]
 """
 
 
+class _CountingStructHandler(ihm.reader.Handler):
+    """Count the number of times _struct is read"""
+    category = '_struct'
+    count = 0
+
+    def __call__(self, title):
+        _CountingStructHandler.count += 1
+
+
+class _SlowHandler(ihm.reader.Handler):
+    """Take a long time to read the (custom) _slow category"""
+    category = '_slow'
+
+    def __call__(self, seconds: float):
+        time.sleep(seconds)
+
+
 class Tests(unittest.TestCase):
     def test_read(self):
         """Test read() function"""
@@ -2240,6 +2260,327 @@ ATOM 3 N N . SER 3 3 . A 54.401 -49.984 -35.287 1 A . 1 1
         asym, = s.asym_units
         self.assertEqual(asym.auth_seq_id_map, {1: (2, 'A'), 2: ('20A', None)})
 
+    def test_atom_site_handler_models(self):
+        """Test AtomSiteHandler with interleaved atoms from several models"""
+        cif = """
+loop_
+_atom_site.group_PDB
+_atom_site.id
+_atom_site.type_symbol
+_atom_site.label_atom_id
+_atom_site.label_comp_id
+_atom_site.label_seq_id
+_atom_site.auth_seq_id
+_atom_site.pdbx_PDB_ins_code
+_atom_site.label_asym_id
+_atom_site.Cartn_x
+_atom_site.Cartn_y
+_atom_site.Cartn_z
+_atom_site.pdbx_PDB_model_num
+ATOM 1 N N SER 1 1 ? A 1.0 2.0 3.0 1
+ATOM 2 C CA SER 1 1 ? B 4.0 5.0 6.0 2
+ATOM 3 C CA CYS 2 12 ? A 7.0 8.0 9.0 1
+HETATM 4 C C1 HEM . 90 X C 1.0 2.0 3.0 2
+HETATM 5 C C2 HEM . 90 X C 1.0 2.0 3.0 2
+"""
+        for model_class in ihm.model.Model, ihm.model.ColumnarModel:
+            for fh in cif_file_handles(cif):
+                s, = ihm.reader.read(fh, model_class=model_class)
+                (g1, m1), (g2, m2) = s._all_models()
+                self.assertIsInstance(m1, model_class)
+                self.assertEqual(
+                    [(a.asym_unit._id, a.seq_id, a.atom_id, a.het, a.x)
+                     for a in m1.get_atoms()],
+                    [('A', 1, 'N', False, 1.0), ('A', 2, 'CA', False, 7.0)])
+                self.assertEqual(
+                    [(a.asym_unit._id, a.seq_id, a.atom_id, a.het, a.x)
+                     for a in m2.get_atoms()],
+                    [('B', 1, 'CA', False, 4.0), ('C', 1, 'C1', True, 1.0),
+                     ('C', 1, 'C2', True, 1.0)])
+                a, b, c = s.asym_units
+                self.assertEqual(a.auth_seq_id_map, {2: (12, ihm.unknown)})
+                self.assertEqual(b.auth_seq_id_map, 0)
+                self.assertEqual(c.auth_seq_id_map, {1: (90, 'X')})
+
+    def test_atom_site_handler_large_model(self):
+        """Test AtomSiteHandler with models too large to buffer at once"""
+        cif = """
+loop_
+_atom_site.group_PDB
+_atom_site.type_symbol
+_atom_site.label_atom_id
+_atom_site.label_comp_id
+_atom_site.label_seq_id
+_atom_site.auth_seq_id
+_atom_site.label_asym_id
+_atom_site.Cartn_x
+_atom_site.Cartn_y
+_atom_site.Cartn_z
+_atom_site.occupancy
+_atom_site.B_iso_or_equiv
+_atom_site.pdbx_PDB_model_num
+""" + "".join("ATOM C CA ALA %d %d A %d.5 2.0 3.0 . . 1\n"
+              % (i, i, i) for i in range(1, 70001)) + """
+HETATM C C1 HEM . 90 B 4.0 5.0 6.0 0.5 7.5 2
+"""
+        for model_class in ihm.model.Model, ihm.model.ColumnarModel:
+            for fh in cif_file_handles(cif):
+                s, = ihm.reader.read(fh, model_class=model_class)
+                (g1, m1), (g2, m2) = s._all_models()
+                atoms = list(m1.get_atoms())
+                self.assertEqual(len(atoms), 70000)
+                self.assertEqual(
+                    [(a.seq_id, a.x, a.het, a.occupancy, a.biso)
+                     for a in (atoms[0], atoms[-1])],
+                    [(1, 1.5, False, None, None),
+                     (70000, 70000.5, False, None, None)])
+                a, = m2.get_atoms()
+                self.assertEqual(
+                    (a.asym_unit._id, a.seq_id, a.atom_id, a.het, a.x,
+                     a.occupancy, a.biso),
+                    ('B', 1, 'C1', True, 4.0, 0.5, 7.5))
+                self.assertEqual(s.asym_units[1].auth_seq_id_map,
+                                 {1: (90, None)})
+
+        # Models split over several calls should only be returned once
+        for fh in cif_file_handles(cif):
+            self.assertEqual([len(list(m.get_atoms()))
+                              for m in ihm.reader.iter_models(fh)],
+                             [70000, 1])
+
+    def test_lazy_coordinates(self):
+        """Test read with lazy_coordinates"""
+        def get_coords(s):
+            models = [[(a.asym_unit._id, a.seq_id, a.atom_id, a.x)
+                       for a in m.get_atoms()]
+                      + [(a.asym_unit._id, a.seq_id_range, a.x)
+                         for a in m.get_spheres()]
+                      for g, m in s._all_models()]
+            # Numbering should be available once coordinates are read
+            asyms = [(type(a).__name__, a._id, a.auth_seq_id_map,
+                      a.orig_auth_seq_id_map) for a in s.asym_units]
+            return models, asyms
+
+        for name in ('docking.cif', 'mini_nonpoly.cif'):
+            fname = utils.get_input_file_name(TOPDIR, name)
+            with open(fname) as fh:
+                cif = fh.read()
+            s, = ihm.reader.read(StringIO(cif))
+            expected = get_coords(s)
+            for fh in cif_file_handles(cif):
+                s, = ihm.reader.read(fh, lazy_coordinates=True)
+                # Coordinates should not be read until needed
+                self.assertTrue(hasattr(s, '_coordinate_loader'))
+                self.assertEqual(get_coords(s), expected)
+                self.assertFalse(hasattr(s, '_coordinate_loader'))
+
+            # We should get the same warnings, even though not all
+            # categories are read at once
+            def get_warnings(lazy_coordinates):
+                with warnings.catch_warnings(record=True) as w:
+                    warnings.simplefilter("always")
+                    s, = ihm.reader.read(
+                        StringIO(cif), warn_unknown_category=True,
+                        warn_unknown_keyword=True,
+                        lazy_coordinates=lazy_coordinates)
+                    ihm.reader.load_coordinates(s)
+                return sorted(str(x.message) for x in w)
+            self.assertEqual(get_warnings(True), get_warnings(False))
+
+        # Coordinates should be read from the correct data block, and
+        # can be explicitly loaded
+        cif = """data_first
+_struct.title first
+data_second
+loop_
+_ihm_model_list.model_id
+_ihm_model_list.model_name
+_ihm_model_list.assembly_id
+_ihm_model_list.protocol_id
+_ihm_model_list.representation_id
+1 . 1 1 1
+#
+loop_
+_ihm_model_group.id
+_ihm_model_group.name
+_ihm_model_group.details
+1 "Cluster 1" .
+#
+loop_
+_ihm_model_group_link.group_id
+_ihm_model_group_link.model_id
+1 1
+#
+loop_
+_ihm_starting_model_details.starting_model_id
+_ihm_starting_model_details.entity_id
+_ihm_starting_model_details.entity_description
+_ihm_starting_model_details.asym_id
+_ihm_starting_model_details.entity_poly_segment_id
+_ihm_starting_model_details.starting_model_source
+_ihm_starting_model_details.starting_model_auth_asym_id
+_ihm_starting_model_details.starting_model_sequence_offset
+_ihm_starting_model_details.dataset_list_id
+1 1 foo A . 'experimental model' A 0 1
+#
+loop_
+_ihm_sphere_obj_site.id
+_ihm_sphere_obj_site.entity_id
+_ihm_sphere_obj_site.seq_id_begin
+_ihm_sphere_obj_site.seq_id_end
+_ihm_sphere_obj_site.asym_id
+_ihm_sphere_obj_site.Cartn_x
+_ihm_sphere_obj_site.Cartn_y
+_ihm_sphere_obj_site.Cartn_z
+_ihm_sphere_obj_site.object_radius
+_ihm_sphere_obj_site.rmsf
+_ihm_sphere_obj_site.model_id
+1 1 1 6 A 389.993 145.089 134.782 4.931 . 1
+""" + self.get_starting_model_coord()
+        for fh in cif_file_handles(cif):
+            s1, s2 = ihm.reader.read(fh, lazy_coordinates=True)
+            self.assertEqual(list(s1._all_models()), [])
+            ihm.reader.load_coordinates(s2)
+            self.assertFalse(hasattr(s2, '_coordinate_loader'))
+            ihm.reader.load_coordinates(s2)
+            (g, m), = s2._all_models()
+            self.assertEqual([a.x for a in m.get_spheres()], [389.993])
+            sm, = s2.orphan_starting_models
+            self.assertEqual([a.seq_id for a in sm.get_atoms()], [7, None])
+
+        fh = StringIO(cif)
+        self.assertRaises(ValueError, ihm.reader.read, fh,
+                          lazy_coordinates=True, add_to_system=s1)
+
+    def test_lazy_coordinates_gzip(self):
+        """Test read with lazy_coordinates from a compressed file"""
+        for name, mode, fmt in (('6ep0.cif.gz', 'rt', 'mmCIF'),
+                                ('6ep0.bcif.gz', 'rb', 'BCIF')):
+            if fmt == 'BCIF' and _format is None:
+                continue
+            fname = utils.get_input_file_name(TOPDIR, name)
+            # The compressed file must be read through the original handle,
+            # not reopened by name
+            with gzip.open(fname, mode) as fh:
+                s, = ihm.reader.read(fh, format=fmt, lazy_coordinates=True)
+                self.assertTrue(hasattr(s, '_coordinate_loader'))
+                m = s.state_groups[0][0][0][0]
+                atoms = list(m.get_atoms())
+            self.assertEqual(len(atoms), 3528)
+            self.assertAlmostEqual(atoms[0].x, -23.51, delta=0.01)
+
+    def test_read_cache(self):
+        """Test read with cache_dir"""
+        fname = utils.get_input_file_name(TOPDIR, 'docking.cif')
+
+        def get_atoms(s):
+            return [[(a.asym_unit._id, a.seq_id, a.atom_id, a.x)
+                     for a in m.get_atoms()] for g, m in s._all_models()]
+
+        def read(**kwargs):
+            with open(fname) as fh:
+                s, = ihm.reader.read(fh, cache_dir=cache_dir,
+                                     handlers=[_CountingStructHandler],
+                                     **kwargs)
+            return s
+        with open(fname) as fh:
+            s, = ihm.reader.read(fh)
+        expected = get_atoms(s)
+        with utils.temporary_directory() as tmpdir:
+            cache_dir = os.path.join(tmpdir, 'cache')
+            _CountingStructHandler.count = 0
+            s = read()
+            self.assertEqual(get_atoms(s), expected)
+            self.assertEqual(_CountingStructHandler.count, 1)
+            cache_file, = os.listdir(cache_dir)
+            # Second read should use the cache rather than the file
+            s = read()
+            self.assertEqual(get_atoms(s), expected)
+            self.assertEqual(_CountingStructHandler.count, 1)
+            # Different options should not use the same cache
+            s = read(model_class=ihm.model.ColumnarModel)
+            self.assertIsInstance(s.state_groups[0][0][0][0],
+                                  ihm.model.ColumnarModel)
+            self.assertEqual(get_atoms(s), expected)
+            self.assertEqual(_CountingStructHandler.count, 2)
+            self.assertEqual(len(os.listdir(cache_dir)), 2)
+            # Corrupt cache files should be ignored
+            with open(os.path.join(cache_dir, cache_file), 'w') as fh:
+                fh.write('garbage')
+            with warnings.catch_warnings(record=True) as w:
+                warnings.simplefilter("always")
+                s = read()
+            self.assertEqual(len(w), 1)
+            self.assertIn('Could not read cache file', str(w[0].message))
+            self.assertEqual(get_atoms(s), expected)
+            self.assertEqual(_CountingStructHandler.count, 3)
+            self.assertRaises(ValueError, read, lazy_coordinates=True)
+
+    def test_iter_models(self):
+        """Test iter_models() function"""
+        cif = """
+loop_
+_ihm_model_list.model_id
+_ihm_model_list.model_name
+_ihm_model_list.assembly_id
+_ihm_model_list.protocol_id
+_ihm_model_list.representation_id
+1 'model 1' . . .
+2 'model 2' . . .
+3 'model 3' . . .
+#
+loop_
+_ihm_model_group.id
+_ihm_model_group.name
+_ihm_model_group.details
+1 "Cluster 1" .
+#
+loop_
+_ihm_model_group_link.group_id
+_ihm_model_group_link.model_id
+1 1
+1 2
+1 3
+#
+loop_
+_atom_site.group_PDB
+_atom_site.id
+_atom_site.type_symbol
+_atom_site.label_atom_id
+_atom_site.label_comp_id
+_atom_site.label_seq_id
+_atom_site.label_asym_id
+_atom_site.Cartn_x
+_atom_site.Cartn_y
+_atom_site.Cartn_z
+_atom_site.pdbx_PDB_model_num
+ATOM 1 N N SER 1 A 1.0 2.0 3.0 2
+ATOM 2 C CA SER 1 A 4.0 5.0 6.0 2
+ATOM 3 N N SER 1 A 7.0 8.0 9.0 1
+"""
+        for fh in cif_file_handles(cif):
+            models = []
+            for m in ihm.reader.iter_models(fh):
+                # Each model should be complete when it is returned
+                models.append((m, m.name, [a.x for a in m.get_atoms()]))
+            self.assertEqual([m[1:] for m in models],
+                             [('model 2', [1.0, 4.0]), ('model 1', [7.0]),
+                              ('model 3', [])])
+            # Coordinates should be discarded once we move on
+            for m in models:
+                self.assertEqual(list(m[0].get_atoms()), [])
+
+        # Stopping early should also stop the reader
+        for fh in cif_file_handles(cif):
+            for m in ihm.reader.iter_models(fh):
+                break
+            self.assertEqual(m.name, 'model 2')
+
+        # Errors should be passed to the caller
+        fh = StringIO(cif + "_exptl.method 'foo\n")
+        it = ihm.reader.iter_models(fh)
+        self.assertRaises(ihm.format.CifParserError, list, it)
+
     def test_atom_site_handler_no_asym_id(self):
         """Test AtomSiteHandler with missing asym_id"""
         fh = StringIO("""
@@ -3447,6 +3788,329 @@ _ihm_ordered_ensemble.model_group_id_end
             s, = ihm.reader.read(f)
         self._check_pdbx(s)
 
+    def test_read_many(self):
+        """Test read_many() function"""
+        mini = utils.get_input_file_name(TOPDIR, 'mini.cif')
+        with open(mini) as fh:
+            cif = fh.read()
+        with utils.temporary_directory() as tmpdir:
+            fnames = []
+            for i in range(3):
+                fnames.append(os.path.join(tmpdir, 'test%d.cif' % i))
+                with open(fnames[-1], 'w') as fh:
+                    fh.write(cif)
+
+            def get_atoms(systems):
+                s, = systems
+                return [(type(m), [(a.atom_id, a.x, a.biso) for a in
+                                   m.get_atoms()])
+                        for g, m in s._all_models()]
+            with open(mini) as fh:
+                expected = get_atoms(ihm.reader.read(
+                    fh, model_class=ihm.model.ColumnarModel))
+            for workers in (1, 2):
+                results = dict(ihm.reader.read_many(
+                    fnames, workers=workers,
+                    model_class=ihm.model.ColumnarModel))
+                self.assertEqual(sorted(results.keys()), fnames)
+                for systems in results.values():
+                    self.assertEqual(get_atoms(systems), expected)
+                    # Special values should survive transfer between
+                    # processes
+                    s, = systems
+                    self.assertIs(s.asym_units[0].details, ihm.unknown)
+
+            # Files should only be submitted a few at a time
+            submitted = []
+
+            def get_fnames():
+                for i in range(20):
+                    submitted.append(i)
+                    yield fnames[i % 3]
+            it = ihm.reader.read_many(get_fnames(), workers=2)
+            next(it)
+            self.assertEqual(len(submitted), 4)
+            self.assertEqual(len(list(it)), 19)
+            self.assertEqual(len(submitted), 20)
+            # Errors should be raised when the result is reached
+            bad = os.path.join(tmpdir, 'bad.cif')
+            with open(bad, 'w') as fh:
+                fh.write("_exptl.method 'foo\n")
+            for workers in (1, 2):
+                self.assertRaises(
+                    ihm.format.CifParserError, list,
+                    ihm.reader.read_many([bad], workers=workers))
+            # Stopping early should not wait for files still being read
+            slow = os.path.join(tmpdir, 'slow.cif')
+            with open(slow, 'w') as fh:
+                fh.write("_slow.seconds 2\n")
+            start = time.time()
+            it = ihm.reader.read_many([slow, fnames[0]], workers=2,
+                                      handlers=[_SlowHandler])
+            fname, systems = next(it)
+            it.close()
+            self.assertEqual(fname, fnames[0])
+            self.assertLess(time.time() - start, 1.5)
+        self.assertRaises(ValueError, list,
+                          ihm.reader.read_many([mini], add_to_system=True))
+
+    def test_read_async(self):
+        """Test read_async() function"""
+        class Stream:
+            """Minimal asyncio stream that returns the data in pieces"""
+            def __init__(self, data):
+                self.data, self.nread = data, 0
+
+            async def read(self, n):
+                await asyncio.sleep(0)
+                self.nread += 1
+                ret, self.data = self.data[:n], self.data[n:]
+                return ret
+
+        def get_atoms(systems):
+            return [[(a.atom_id, a.x, a.biso) for g, m in s._all_models()
+                     for a in m.get_atoms()] for s in systems]
+
+        mini = utils.get_input_file_name(TOPDIR, 'mini.cif')
+        with open(mini) as fh:
+            cif = fh.read()
+        # Two copies of the file, so two data blocks
+        cif = cif + cif.replace('data_model', 'data_model2')
+        expected_systems = ihm.reader.read(StringIO(cif))
+        expected = get_atoms(expected_systems)
+        self.assertEqual(len(expected), 2)
+        for data in (cif, cif.encode('utf-8')):
+            for chunk_size in (7, 100, 65536):
+                stream = Stream(data)
+                systems = asyncio.run(ihm.reader.read_async(
+                    stream, chunk_size=chunk_size))
+                self.assertEqual(get_atoms(systems), expected)
+                self.assertEqual([s.id for s in systems],
+                                 [s.id for s in expected_systems])
+                self.assertGreaterEqual(stream.nread,
+                                        len(data) // chunk_size)
+
+        # Other tasks should run while the file is being read
+        async def read_with_ticker():
+            ticks = []
+
+            async def ticker():
+                while True:
+                    ticks.append(None)
+                    await asyncio.sleep(0)
+            t = asyncio.create_task(ticker())
+            with open(mini) as fh:
+                systems = await ihm.reader.read_async(fh, chunk_size=100)
+            t.cancel()
+            return systems, ticks
+        systems, ticks = asyncio.run(read_with_ticker())
+        self.assertEqual(get_atoms(systems), expected[:1])
+        self.assertGreater(len(ticks), 10)
+
+        # Errors should be raised
+        self.assertRaises(ihm.format.CifParserError, asyncio.run,
+                          ihm.reader.read_async(Stream("_exptl.method 'foo")))
+        self.assertRaises(TypeError, asyncio.run,
+                          ihm.reader.read_async(Stream(cif), bad_arg=True))
+        self.assertRaises(ValueError, asyncio.run,
+                          ihm.reader.read_async(Stream(cif),
+                                                lazy_coordinates=True))
+
+    def test_read_profile(self):
+        """Test read() with a ReadProfile"""
+        class MyHandler(ihm.reader.Handler):
+            category = "_modeller"
+
+            def __call__(self, version):
+                self.version = version
+
+            def finalize(self):
+                self.sysr.system.modeller_version = self.version
+
+        mini = utils.get_input_file_name(TOPDIR, 'mini.cif')
+        with open(mini) as fh:
+            cif = fh.read()
+        # Two copies of the file, so two data blocks
+        cif = cif + cif.replace('data_model', 'data_model2')
+        natom = cif.count('\nATOM ')
+        profile = ihm.reader.ReadProfile()
+        systems = ihm.reader.read(StringIO(cif), handlers=[MyHandler],
+                                  profile=profile)
+        self.assertEqual(len(systems), 2)
+        self.assertEqual(systems[1].modeller_version, '9.24')
+        self.assertEqual(len(list(systems[0]._all_models())), 1)
+
+        t = profile.handlers[MyHandler]
+        self.assertEqual(t.category, '_modeller')
+        self.assertEqual(t.calls, 2)
+        self.assertEqual(t.rows, 2)
+        self.assertGreater(t.finalize_time, 0.)
+        self.assertAlmostEqual(t.total_time, t.call_time + t.finalize_time
+                               + t.end_save_frame_time)
+        self.assertEqual(profile.handlers[ihm.reader._StructAsymHandler].rows,
+                         4)
+        atom_site, = [t for t in profile.handlers.values()
+                      if t.category == '_atom_site']
+        self.assertEqual(atom_site.rows, natom)
+        self.assertGreaterEqual(atom_site.calls, 1)
+        # Handlers for categories not in the file should never be called
+        self.assertEqual(
+            profile.handlers[ihm.reader._CollectionHandler].calls, 0)
+        sorted_timings = profile.get_sorted()
+        self.assertEqual(len(sorted_timings), len(profile.handlers))
+        self.assertGreaterEqual(sorted_timings[0].total_time,
+                                sorted_timings[-1].total_time)
+        self.assertGreater(profile.system_finalize_time, 0.)
+        self.assertIn('MyHandler', str(profile))
+        if _format is None:
+            self.assertIsNone(profile.reader_stats)
+        else:
+            self.assertEqual(profile.reader_stats.bytes_read, len(cif))
+            self.assertEqual(
+                profile.reader_stats.categories['_atom_site'][0], natom)
+
+        # Profile should accumulate over multiple reads
+        ihm.reader.read(StringIO(cif), handlers=[MyHandler], profile=profile)
+        self.assertEqual(profile.handlers[MyHandler].calls, 4)
+
+        self.assertRaises(ValueError, ihm.reader.read, StringIO(cif),
+                          profile=profile, cache_dir='foo')
+        self.assertRaises(ValueError, list,
+                          ihm.reader.read_many([mini], profile=profile))
+
+    def test_read_progress(self):
+        """Test read() with progress reports"""
+        mini = utils.get_input_file_name(TOPDIR, 'mini.cif')
+        calls = []
+        with open(mini) as fh:
+            s, = ihm.reader.read(fh, progress=lambda *a: calls.append(a),
+                                 progress_interval=0)
+        if _format is None:
+            self.assertEqual(calls, [])
+        else:
+            self.assertEqual(calls, [(os.path.getsize(mini),
+                                      os.path.getsize(mini), 0, None)])
+        # Progress reporting should not affect the cache
+        with utils.temporary_directory() as tmpdir:
+            with open(mini) as fh:
+                ihm.reader.read(fh, cache_dir=tmpdir)
+            with open(mini) as fh:
+                ihm.reader.read(fh, cache_dir=tmpdir,
+                                progress=lambda *a: calls.append(a))
+            self.assertEqual(len(os.listdir(tmpdir)), 1)
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_read_async_stall(self):
+        """Test that read_async() does not block the event loop for long"""
+        # Undo any mocking of msgpack by other tests
+        sys.modules.pop('msgpack', None)
+        try:
+            import msgpack  # noqa: F401
+        except ImportError:
+            self.skipTest("this test requires msgpack")
+
+        def write(writer):
+            n = 200000
+            writer.start_block('model')
+            with writer.loop('_struct_asym', ['id', 'entity_id']) as lp:
+                lp.write(id='A', entity_id=1)
+            with writer.loop('_entity_poly_seq',
+                             ['entity_id', 'num', 'mon_id']) as lp:
+                lp.write(entity_id=1, num=1, mon_id='VAL')
+            with writer.loop('_atom_site',
+                             ['group_PDB', 'type_symbol', 'label_atom_id',
+                              'label_comp_id', 'label_asym_id',
+                              'label_seq_id', 'Cartn_x', 'Cartn_y', 'Cartn_z',
+                              'id', 'pdbx_PDB_model_num']) as lp:
+                lp.write_columns(
+                    group_PDB=['ATOM'] * n, type_symbol=['C'] * n,
+                    label_atom_id=['CA'] * n, label_comp_id=['VAL'] * n,
+                    label_asym_id=['A'] * n, label_seq_id=[1] * n,
+                    Cartn_x=[float(i) for i in range(n)],
+                    Cartn_y=[2.0] * n, Cartn_z=[3.0] * n,
+                    id=list(range(1, n + 1)), pdbx_PDB_model_num=[1] * n)
+            writer.flush()
+        cif = StringIO()
+        write(ihm.format.CifWriter(cif))
+        bcif = BytesIO()
+        write(ihm.format_bcif.BinaryCifWriter(bcif))
+
+        async def read(data, format):
+            gaps = []
+            done = False
+
+            async def ticker():
+                last = time.perf_counter()
+                while not done:
+                    await asyncio.sleep(0.001)
+                    now = time.perf_counter()
+                    gaps.append(now - last)
+                    last = now
+            t = asyncio.ensure_future(ticker())
+            start = time.perf_counter()
+            s, = await ihm.reader.read_async(BytesIO(data), format=format)
+            total = time.perf_counter() - start
+            done = True
+            await t
+            self.assertEqual(len(s.state_groups[0][0][0][0]._atoms), 200000)
+            return max(gaps), total
+
+        for data, format in ((cif.getvalue().encode('utf-8'), 'mmCIF'),
+                             (bcif.getvalue(), 'BCIF')):
+            max_gap, total = asyncio.run(read(data, format))
+            # Other tasks should get to run many times during the read
+            self.assertLess(max_gap, total / 4)
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_read_async_profile(self):
+        """Test read_async() with a ReadProfile"""
+        mini = utils.get_input_file_name(TOPDIR, 'mini.cif')
+        profile = ihm.reader.ReadProfile()
+        with open(mini) as fh:
+            s, = asyncio.run(ihm.reader.read_async(fh, chunk_size=100,
+                                                   profile=profile))
+        self.assertEqual(profile.handlers[ihm.reader._StructAsymHandler].rows,
+                         2)
+        self.assertIsNotNone(profile.reader_stats)
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_read_async_bcif(self):
+        """Test read_async() function with BinaryCIF"""
+        fname = utils.get_input_file_name(TOPDIR, '6ep0.bcif.gz')
+        with gzip.open(fname, 'rb') as f:
+            s, = asyncio.run(ihm.reader.read_async(f, format='BCIF'))
+        self._check_pdbx(s)
+
+    @unittest.skipIf(_format is None, "No C tokenizer")
+    def test_read_async_bcif_blocks(self):
+        """Test read_async() with multiple BinaryCIF data blocks"""
+        # Undo any mocking of msgpack by other tests
+        sys.modules.pop('msgpack', None)
+        try:
+            import msgpack  # noqa: F401
+        except ImportError:
+            self.skipTest("this test requires msgpack")
+        fh = BytesIO()
+        writer = ihm.format_bcif.BinaryCifWriter(fh)
+        for name in ('foo', 'bar'):
+            writer.start_block(name)
+            with writer.category('_struct') as loc:
+                loc.write(entry_id=name)
+        writer.flush()
+
+        class Stream:
+            def __init__(self, data):
+                self.data = data
+
+            async def read(self, n):
+                data, self.data = self.data[:n], self.data[n:]
+                return data
+
+        s1, s2 = asyncio.run(ihm.reader.read_async(
+            Stream(fh.getvalue()), format='BCIF', chunk_size=10))
+        self.assertEqual(s1.id, 'foo')
+        self.assertEqual(s2.id, 'bar')
+
     @unittest.skipIf(_format is None, "No C tokenizer")
     def test_read_full_pdbx_bcif(self):
         """Test reading a full PDBx file in BinaryCIF format"""